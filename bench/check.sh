@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+#
+# Check the output of scriptinterpreter on synthetic recordings.
+#
+# Usage: bench/check.sh
+#
+# For every workload a recording of CHECK_SIZE megabytes is generated
+# and converted with keyframes, which processxml must be able to read
+# as well-formed XML. Keyframes render the rows of the screen model,
+# so a character cut in half by a cell or a row shows up as invalid
+# UTF-8. Conversions with -j must be byte for byte the same as without,
+# for the workloads and for recordings made to need state carried
+# from one segment to the next.
+#
+# Environment:
+#   CHECK_SIZE       megabytes of typescript per workload (default 2)
+#   CHECK_WORKLOADS  workloads to check (default: all)
+#   CHECK_DIR        directory for generated files (default: temporary)
+
+set -e
+
+BENCH_SOURCE="$(cd "$(dirname "$0")" && pwd)"
+TOP="$(dirname "${BENCH_SOURCE}")"
+CHECK_SIZE="${CHECK_SIZE:-2}"
+CHECK_WORKLOADS="${CHECK_WORKLOADS:-plain log sgr fullscreen osc keystrokes unicode}"
+GENERATE="${BENCH_SOURCE}/generate"
+
+for PROGRAM in "${TOP}/scriptinterpreter" "${TOP}/processxml" "${GENERATE}" ; do
+	if [[ ! -x "${PROGRAM}" ]] ; then
+		echo "Missing ${PROGRAM}, run 'make check' instead" >&2
+		exit 1
+	fi
+done
+
+if [[ -n "${CHECK_DIR}" ]] ; then
+	mkdir -p "${CHECK_DIR}"
+else
+	CHECK_DIR="$(mktemp -d /tmp/scriptinterpreter-check-XXXXXX)"
+	trap 'rm -rf "${CHECK_DIR}"' EXIT
+fi
+
+FAILURES=0
+
+# Report a failed check
+fail() {
+	echo "FAILED: $*"
+	FAILURES=$(( FAILURES + 1 ))
+}
+
+# Compare conversions of a recording with -j to one without
+check_parallel() {
+	local NAME="$1" TIMING="$2" TYPESCRIPT="$3"
+	local SERIAL="${CHECK_DIR}/${NAME}.serial.xml" PARALLEL="${CHECK_DIR}/${NAME}.parallel.xml"
+	"${TOP}/scriptinterpreter" "${TIMING}" "${TYPESCRIPT}" "${SERIAL}" || fail "${NAME}: conversion"
+	for THREADS in 2 4 ; do
+		if ! "${TOP}/scriptinterpreter" -j "${THREADS}" "${TIMING}" "${TYPESCRIPT}" "${PARALLEL}" ; then
+			fail "${NAME}: conversion with -j ${THREADS}"
+		elif ! cmp "${SERIAL}" "${PARALLEL}" ; then
+			fail "${NAME}: output with -j ${THREADS} differs"
+		fi
+	done
+	rm -f "${SERIAL}" "${PARALLEL}"
+}
+
+for WORKLOAD in ${CHECK_WORKLOADS} ; do
+	TYPESCRIPT="${CHECK_DIR}/${WORKLOAD}.typescript"
+	TIMING="${CHECK_DIR}/${WORKLOAD}.timing"
+
+	"${GENERATE}" "${WORKLOAD}" "${CHECK_SIZE}" "${TYPESCRIPT}" "${TIMING}"
+
+	# Keyframes every 4 KB, also on a narrow screen to make rows wrap often
+	for SIZE in 24x80 5x7 ; do
+		KEYFRAMES="${CHECK_DIR}/${WORKLOAD}.keyframes-${SIZE}.xml"
+		if ! "${TOP}/scriptinterpreter" --keyframe-bytes=4096 --screen-size="${SIZE}" "${TIMING}" "${TYPESCRIPT}" "${KEYFRAMES}" ; then
+			fail "${WORKLOAD}: conversion with keyframes on a ${SIZE} screen"
+		elif ! "${TOP}/processxml" "${KEYFRAMES}" "${CHECK_DIR}/${WORKLOAD}.processed.xml" 2>"${CHECK_DIR}/processxml.log" ; then
+			fail "${WORKLOAD}: keyframes on a ${SIZE} screen are not well-formed XML"
+			grep -v '^Warning' "${CHECK_DIR}/processxml.log" | head -n 3
+		fi
+		rm -f "${KEYFRAMES}" "${CHECK_DIR}/${WORKLOAD}.processed.xml"
+	done
+
+	check_parallel "${WORKLOAD}" "${TIMING}" "${TYPESCRIPT}"
+
+	rm -f "${TYPESCRIPT}" "${TIMING}"
+	echo "${WORKLOAD}: checked"
+done
+
+# A REP repeating a character from two segments before, with a segment
+# of nothing but cursor movements in between (segments are 1 MB)
+TYPESCRIPT="${CHECK_DIR}/repeat.typescript"
+TIMING="${CHECK_DIR}/repeat.timing"
+STEPS=10000
+{
+	printf 'Script started\nA'
+	yes "$(printf '\e[H%.0s' {1..100})" | tr -d '\n' | head -c $(( STEPS * 300 ))
+	printf '\e[3b'
+} >"${TYPESCRIPT}"
+{
+	echo "0.001 1"
+	yes "0.001 300" | head -n "${STEPS}"
+	echo "0.001 4"
+} >"${TIMING}"
+check_parallel repeat "${TIMING}" "${TYPESCRIPT}"
+rm -f "${TYPESCRIPT}" "${TIMING}"
+echo "repeat: checked"
+
+if (( FAILURES > 0 )) ; then
+	echo "${FAILURES} check(s) failed"
+	exit 1
+fi
+echo "All checks passed"
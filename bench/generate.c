@@ -0,0 +1,345 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Largest number of bytes in a single timing step
+#define STEP_SIZE 65536
+/// Size of the simulated terminal
+#define ROWS 24
+#define COLUMNS 80
+
+/**
+ * Synthetic recording under construction: the bytes of the
+ * current timing step and the files both are written to.
+ */
+struct generator {
+    FILE *typescript, *timing;
+    char step[STEP_SIZE];
+    size_t step_len;
+    size_t total; ///< bytes written to the typescript so far
+    unsigned long long random_state;
+};
+
+static const char *words[] = {
+    "request", "worker", "connection", "cache", "build", "target", "linking", "object",
+    "config", "module", "session", "timeout", "socket", "handler", "queue", "buffer",
+    "compile", "warning", "install", "update", "package", "thread", "server", "client"
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+/**
+ * Pseudo-random number in [0, @p limit), reproducible for a given seed
+ * (xorshift64*).
+ */
+static unsigned int next_random(struct generator *gen, unsigned int limit)
+{
+    gen->random_state ^= gen->random_state >> 12;
+    gen->random_state ^= gen->random_state << 25;
+    gen->random_state ^= gen->random_state >> 27;
+    return (unsigned int)((gen->random_state * 2685821657736338717ULL) >> 33) % limit;
+}
+
+/**
+ * Append formatted text to the current step.
+ */
+static void append(struct generator *gen, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(gen->step + gen->step_len, STEP_SIZE - gen->step_len, format, args);
+    va_end(args);
+    if (len > 0)
+        gen->step_len += (size_t)len < STEP_SIZE - gen->step_len ? (size_t)len : STEP_SIZE - 1 - gen->step_len;
+}
+
+/**
+ * Append a random word to the current step.
+ */
+static void append_word(struct generator *gen)
+{
+    append(gen, "%s", words[next_random(gen, WORD_COUNT)]);
+}
+
+/**
+ * Write the current step to the typescript and a matching line
+ * to the timing file, with a delay of @p delay microseconds.
+ */
+static int flush_step(struct generator *gen, unsigned int delay)
+{
+    if (gen->step_len == 0)
+        return 0;
+    if (fwrite(gen->step, 1, gen->step_len, gen->typescript) != gen->step_len || fprintf(gen->timing, "%u.%06u %zu\n", delay / 1000000, delay % 1000000, gen->step_len) < 0) {
+        fprintf(stderr, "Cannot write recording\n");
+        return 1;
+    }
+    gen->total += gen->step_len;
+    gen->step_len = 0;
+    return 0;
+}
+
+/**
+ * Plain log output: a few lines of text per step.
+ */
+static int generate_plain(struct generator *gen)
+{
+    unsigned int lines = 1 + next_random(gen, 4);
+    for (unsigned int i = 0; i < lines; ++i) {
+        append(gen, "2026-01-%02u %02u:%02u:%02u.%03u INFO ", 1 + next_random(gen, 28), next_random(gen, 24), next_random(gen, 60), next_random(gen, 60), next_random(gen, 1000));
+        append_word(gen);
+        append(gen, "[%u]: ", next_random(gen, 32768));
+        unsigned int count = 3 + next_random(gen, 8);
+        for (unsigned int j = 0; j < count; ++j) {
+            append_word(gen);
+            append(gen, j + 1 < count ? " " : " in %u ms\r\n", next_random(gen, 500));
+        }
+    }
+    return flush_step(gen, 1000 + next_random(gen, 200000));
+}
+
+/**
+ * Service or build logs: long lines with tab-separated fields, many
+ * per step. Only every eighth step has a colored warning in it.
+ */
+static int generate_log(struct generator *gen)
+{
+    unsigned int lines = 8 + next_random(gen, 24);
+    unsigned int warning = next_random(gen, 8) == 0 ? next_random(gen, lines) : lines;
+    for (unsigned int i = 0; i < lines; ++i) {
+        append(gen, "2026-01-%02u %02u:%02u:%02u.%06u\t", 1 + next_random(gen, 28), next_random(gen, 24), next_random(gen, 60), next_random(gen, 60), next_random(gen, 1000000));
+        append(gen, i == warning ? "\033[1;33mWARN\033[0m\t" : "INFO\t");
+        append_word(gen);
+        append(gen, ".");
+        append_word(gen);
+        append(gen, "[%u]\t", next_random(gen, 32768));
+        unsigned int count = 10 + next_random(gen, 20);
+        for (unsigned int j = 0; j < count; ++j) {
+            append_word(gen);
+            append(gen, j + 1 < count ? (next_random(gen, 6) == 0 ? "=%u " : " ") : " took %u us\r\n", next_random(gen, 100000));
+        }
+    }
+    return flush_step(gen, 1000 + next_random(gen, 50000));
+}
+
+/**
+ * Colored output like ls or a compiler: short runs of text,
+ * each with its own SGR sequence.
+ */
+static int generate_sgr(struct generator *gen)
+{
+    static const char *styles[] = { "01;34", "01;32", "01;36", "00;33", "01;31", "40;33;01", "30;42", "37;41", "01;35", "90", "93" };
+    unsigned int lines = 1 + next_random(gen, 4);
+    for (unsigned int i = 0; i < lines; ++i) {
+        unsigned int count = 2 + next_random(gen, 6);
+        for (unsigned int j = 0; j < count; ++j) {
+            append(gen, "\033[%sm", styles[next_random(gen, sizeof(styles) / sizeof(styles[0]))]);
+            append_word(gen);
+            append(gen, next_random(gen, 2) ? "\033[00m  " : "\033[39;49m  ");
+        }
+        append(gen, "\r\n");
+    }
+    return flush_step(gen, 1000 + next_random(gen, 100000));
+}
+
+/**
+ * Full-screen application like vim or top: every step repaints
+ * part of the screen with cursor positioning and erasing.
+ */
+static int generate_fullscreen(struct generator *gen)
+{
+    if (next_random(gen, 20) == 0) {
+        /// Occasionally repaint everything
+        append(gen, "\033[?25l\033[H\033[2J");
+        for (unsigned int row = 1; row < ROWS; ++row) {
+            append(gen, "\033[%u;1H%5u ", row, next_random(gen, 100000));
+            unsigned int count = next_random(gen, 10);
+            for (unsigned int j = 0; j < count; ++j) {
+                append_word(gen);
+                append(gen, " ");
+            }
+            append(gen, "\033[K");
+        }
+    } else {
+        unsigned int rows = 1 + next_random(gen, 8);
+        for (unsigned int i = 0; i < rows; ++i) {
+            append(gen, "\033[%u;%uH", 1 + next_random(gen, ROWS - 1), 1 + next_random(gen, COLUMNS / 2));
+            append(gen, "\033[%sm%5.1f\033[00m ", next_random(gen, 2) ? "01;31" : "01;32", next_random(gen, 1000) / 10.0);
+            append_word(gen);
+            append(gen, "\033[K");
+        }
+    }
+    /// Status line in inverse video, cursor back to the editing position
+    append(gen, "\033[%u;1H\033[07m-- %s -- %u,%u\033[27m\033[K\033[%u;%uH\033[?25h", ROWS, words[next_random(gen, WORD_COUNT)], next_random(gen, 1000), next_random(gen, COLUMNS), 1 + next_random(gen, ROWS - 1), 1 + next_random(gen, COLUMNS));
+    return flush_step(gen, 10000 + next_random(gen, 90000));
+}
+
+/**
+ * Shell prompt that sets the window title before every command,
+ * followed by a line of output.
+ */
+static int generate_osc(struct generator *gen)
+{
+    append(gen, "\033]0;user@host: ~/src/");
+    append_word(gen);
+    append(gen, "\007\033[01;32muser@host\033[00m:\033[01;34m~/src\033[00m$ ");
+    append_word(gen);
+    append(gen, "\r\n");
+    append_word(gen);
+    append(gen, " ");
+    append_word(gen);
+    append(gen, "\r\n");
+    return flush_step(gen, 50000 + next_random(gen, 500000));
+}
+
+/**
+ * Localized output and box drawing as in TUIs: mostly multi-byte
+ * UTF-8 text, with steps sometimes ending inside a character.
+ */
+static int generate_unicode(struct generator *gen)
+{
+    static const char *texts[] = {
+        "Größe", "Übersetzung", "café", "naïve", "Ошибка", "соединение", "επεξεργασία",
+        "ファイル", "接続がタイムアウトしました", "설정", "─────", "│", "┌──┬──┐", "✓", "⚠", "😀"
+    };
+    unsigned int lines = 1 + next_random(gen, 4);
+    for (unsigned int i = 0; i < lines; ++i) {
+        unsigned int count = 3 + next_random(gen, 8);
+        for (unsigned int j = 0; j < count; ++j) {
+            append(gen, "%s", texts[next_random(gen, sizeof(texts) / sizeof(texts[0]))]);
+            append(gen, j + 1 < count ? " " : "\r\n");
+        }
+    }
+    if (next_random(gen, 4) == 0) {
+        /// Split the last character like a read of the terminal may do
+        append(gen, "%s", texts[next_random(gen, sizeof(texts) / sizeof(texts[0]))]);
+        char last = gen->step[--gen->step_len];
+        if (flush_step(gen, 1000 + next_random(gen, 200000)) != 0)
+            return 1;
+        gen->step[gen->step_len++] = last;
+    }
+    return flush_step(gen, 1000 + next_random(gen, 200000));
+}
+
+/**
+ * Interactive typing: every key stroke is a step of its own,
+ * with an occasional command line finished by Enter.
+ */
+static int generate_keystrokes(struct generator *gen)
+{
+    const char *word = words[next_random(gen, WORD_COUNT)];
+    for (; *word != '\0'; ++word) {
+        append(gen, "%c", *word);
+        if (flush_step(gen, 30000 + next_random(gen, 250000)) != 0)
+            return 1;
+    }
+    if (next_random(gen, 4) == 0) {
+        /// Backspace over the last character and retype it
+        append(gen, "\b\033[K");
+        if (flush_step(gen, 100000 + next_random(gen, 200000)) != 0)
+            return 1;
+        append(gen, "x");
+    } else
+        append(gen, next_random(gen, 5) == 0 ? "\r\n$ " : " ");
+    return flush_step(gen, 30000 + next_random(gen, 250000));
+}
+
+/**
+ * Write a synthetic recording of one of several kinds of terminal
+ * sessions, for benchmarking.
+ */
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *name;
+        int (*generate)(struct generator *gen);
+    } workloads[] = {
+        { "plain", generate_plain },
+        { "log", generate_log },
+        { "sgr", generate_sgr },
+        { "fullscreen", generate_fullscreen },
+        { "osc", generate_osc },
+        { "keystrokes", generate_keystrokes },
+        { "unicode", generate_unicode }
+    };
+    const size_t workload_count = sizeof(workloads) / sizeof(workloads[0]);
+
+    struct generator gen;
+    gen.random_state = 0x2545f4914f6cdd1dULL;
+    int arg = 1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        gen.random_state ^= strtoull(argv[2], NULL, 10);
+        arg = 3;
+    }
+
+    if (argc - arg != 4) {
+        fprintf(stderr, "Usage: %s [-s SEED] WORKLOAD MEGABYTES TYPESCRIPT TIMING\n", argv[0]);
+        fprintf(stderr, "Workloads:");
+        for (size_t i = 0; i < workload_count; ++i)
+            fprintf(stderr, " %s", workloads[i].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    size_t workload = 0;
+    while (workload < workload_count && strcmp(workloads[workload].name, argv[arg]) != 0)
+        ++workload;
+    if (workload == workload_count) {
+        fprintf(stderr, "Unknown workload \"%s\"\n", argv[arg]);
+        return 1;
+    }
+    double megabytes = atof(argv[arg + 1]);
+    if (megabytes <= 0.0) {
+        fprintf(stderr, "Invalid size \"%s\"\n", argv[arg + 1]);
+        return 1;
+    }
+
+    gen.typescript = fopen(argv[arg + 2], "w");
+    if (gen.typescript == NULL) {
+        fprintf(stderr, "Cannot open typescript file \"%s\"\n", argv[arg + 2]);
+        return 2;
+    }
+    gen.timing = fopen(argv[arg + 3], "w");
+    if (gen.timing == NULL) {
+        fclose(gen.typescript);
+        fprintf(stderr, "Cannot open timing file \"%s\"\n", argv[arg + 3]);
+        return 2;
+    }
+    gen.step_len = gen.total = 0;
+
+    /// The first line of a typescript is not part of the timing file
+    fprintf(gen.typescript, "Script started on 2026-01-01 00:00:00+00:00 [workload=\"%s\"]\n", workloads[workload].name);
+
+    int result = 0;
+    const size_t target = (size_t)(megabytes * 1024 * 1024);
+    while (result == 0 && gen.total < target)
+        result = workloads[workload].generate(&gen);
+
+    if (fclose(gen.typescript) != 0 || fclose(gen.timing) != 0) {
+        fprintf(stderr, "Cannot write recording\n");
+        result = 1;
+    }
+    return result;
+}
@@ -0,0 +1,70 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Run a command and print its wall-clock time in seconds and its
+ * peak resident set size in kilobytes, separated by a space.
+ * The command's own standard output is discarded, so that it cannot
+ * be mistaken for the measurement. The exit status is the command's.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s COMMAND [ARGUMENTS]\n", argv[0]);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Cannot start \"%s\"\n", argv[1]);
+        return 1;
+    } else if (pid == 0) {
+        if (freopen("/dev/null", "w", stdout) == NULL)
+            _exit(127);
+        execvp(argv[1], argv + 1);
+        fprintf(stderr, "Cannot execute \"%s\"\n", argv[1]);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        fprintf(stderr, "Cannot wait for \"%s\"\n", argv[1]);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("%.6f %ld\n", (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, usage.ru_maxrss);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,55 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#include <stdio.h>
+
+#include "recording.h"
+
+/**
+ * Event sink that only counts the events, so that no time
+ * goes into writing any output.
+ */
+static void count_event(void *context, const struct event *event)
+{
+    (void)event;
+    ++*(unsigned long long *)context;
+}
+
+/**
+ * Parse a recording without writing any output and print the
+ * number of events the parser passed on.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s TIMINGFILE TYPESCRIPTFILE\n", argv[0]);
+        return 1;
+    }
+
+    unsigned long long events = 0;
+    const struct event_sink sink = { count_event, &events };
+    int result = recording_parse(argv[1], argv[2], &sink);
+    if (result != 0)
+        return result;
+
+    printf("%llu\n", events);
+    return 0;
+}
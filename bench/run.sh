@@ -0,0 +1,153 @@
+#!/usr/bin/env bash
+#
+# Benchmark scriptinterpreter and processxml on synthetic recordings.
+#
+# Usage: bench/run.sh [--save]
+#
+# For every workload a recording of BENCH_SIZE megabytes is generated,
+# parsed without any output by bench/parse, converted to XML by
+# scriptinterpreter and post-processed by processxml. Throughput in
+# MB/s (of the program's input), events/s (parser events for
+# bench/parse, XML elements otherwise) and peak resident memory are
+# reported and compared to the stored baseline. With --save the
+# results become the new baseline instead.
+#
+# Environment:
+#   BENCH_SIZE       megabytes of typescript per workload (default 8)
+#   BENCH_RUNS       runs per measurement, the fastest counts (default 3)
+#   BENCH_TOLERANCE  allowed slow-down or memory growth in percent (default 15)
+#   BENCH_WORKLOADS  workloads to run (default: all)
+#   BENCH_DIR        directory for generated files (default: temporary)
+#   BENCH_BASELINE   baseline file (default: bench/baseline.txt)
+
+set -e
+
+BENCH_SOURCE="$(cd "$(dirname "$0")" && pwd)"
+TOP="$(dirname "${BENCH_SOURCE}")"
+BENCH_SIZE="${BENCH_SIZE:-8}"
+BENCH_RUNS="${BENCH_RUNS:-3}"
+BENCH_TOLERANCE="${BENCH_TOLERANCE:-15}"
+BENCH_WORKLOADS="${BENCH_WORKLOADS:-plain log sgr fullscreen osc keystrokes unicode}"
+BENCH_BASELINE="${BENCH_BASELINE:-${BENCH_SOURCE}/baseline.txt}"
+GENERATE="${BENCH_SOURCE}/generate"
+MEASURE="${BENCH_SOURCE}/measure"
+PARSE="${BENCH_SOURCE}/parse"
+
+SAVE=0
+[[ "$1" == "--save" ]] && SAVE=1
+
+for PROGRAM in "${TOP}/scriptinterpreter" "${TOP}/processxml" "${GENERATE}" "${MEASURE}" "${PARSE}" ; do
+	if [[ ! -x "${PROGRAM}" ]] ; then
+		echo "Missing ${PROGRAM}, run 'make bench' instead" >&2
+		exit 1
+	fi
+done
+
+if [[ -n "${BENCH_DIR}" ]] ; then
+	mkdir -p "${BENCH_DIR}"
+else
+	BENCH_DIR="$(mktemp -d /tmp/scriptinterpreter-bench-XXXXXX)"
+	trap 'rm -rf "${BENCH_DIR}"' EXIT
+fi
+
+# Run a command BENCH_RUNS times, print fastest time and largest peak RSS
+measure() {
+	local BEST_TIME="" MAX_RSS=0 TIME RSS
+	for (( RUN = 0 ; RUN < BENCH_RUNS ; ++RUN )) ; do
+		read -r TIME RSS < <("${MEASURE}" "$@" 2>/dev/null || echo "failed 0")
+		if [[ "${TIME}" == "failed" ]] ; then
+			echo "Failed to run: $*" >&2
+			return 1
+		fi
+		if [[ -z "${BEST_TIME}" ]] || awk "BEGIN { exit !(${TIME} < ${BEST_TIME}) }" ; then
+			BEST_TIME="${TIME}"
+		fi
+		(( RSS > MAX_RSS )) && MAX_RSS="${RSS}"
+	done
+	echo "${BEST_TIME} ${MAX_RSS}"
+}
+
+# Number of XML elements in a file
+count_events() {
+	grep -o '<[a-z]' "$1" | wc -l
+}
+
+RESULTS="${BENCH_DIR}/results.txt"
+{
+	echo "# size=${BENCH_SIZE}MB runs=${BENCH_RUNS} host=$(uname -m) cpus=$(getconf _NPROCESSORS_ONLN) date=$(date '+%Y-%m-%d')"
+	echo "# workload program MB/s events/s peak_rss_kB"
+} >"${RESULTS}"
+
+for WORKLOAD in ${BENCH_WORKLOADS} ; do
+	TYPESCRIPT="${BENCH_DIR}/${WORKLOAD}.typescript"
+	TIMING="${BENCH_DIR}/${WORKLOAD}.timing"
+	XML="${BENCH_DIR}/${WORKLOAD}.xml"
+	PROCESSED="${BENCH_DIR}/${WORKLOAD}.processed.xml"
+
+	"${GENERATE}" "${WORKLOAD}" "${BENCH_SIZE}" "${TYPESCRIPT}" "${TIMING}"
+	BYTES=$(( $(wc -c <"${TYPESCRIPT}") + $(wc -c <"${TIMING}") ))
+
+	# The parser alone, measure drops the number of events it prints
+	read -r TIME RSS < <(measure "${PARSE}" "${TIMING}" "${TYPESCRIPT}")
+	EVENTS=$("${PARSE}" "${TIMING}" "${TYPESCRIPT}")
+	awk -v w="${WORKLOAD}" -v b="${BYTES}" -v e="${EVENTS}" -v t="${TIME}" -v r="${RSS}" \
+		'BEGIN { if (t <= 0) t = 0.001; printf "%s parser %.1f %.0f %d\n", w, b / 1048576 / t, e / t, r }' >>"${RESULTS}"
+
+	read -r TIME RSS < <(measure "${TOP}/scriptinterpreter" "${TIMING}" "${TYPESCRIPT}" "${XML}")
+	EVENTS=$(count_events "${XML}")
+	awk -v w="${WORKLOAD}" -v b="${BYTES}" -v e="${EVENTS}" -v t="${TIME}" -v r="${RSS}" \
+		'BEGIN { if (t <= 0) t = 0.001; printf "%s scriptinterpreter %.1f %.0f %d\n", w, b / 1048576 / t, e / t, r }' >>"${RESULTS}"
+
+	read -r TIME RSS < <(measure "${TOP}/processxml" "${XML}" "${PROCESSED}")
+	BYTES=$(wc -c <"${XML}")
+	awk -v w="${WORKLOAD}" -v b="${BYTES}" -v e="${EVENTS}" -v t="${TIME}" -v r="${RSS}" \
+		'BEGIN { if (t <= 0) t = 0.001; printf "%s processxml %.1f %.0f %d\n", w, b / 1048576 / t, e / t, r }' >>"${RESULTS}"
+
+	rm -f "${TYPESCRIPT}" "${TIMING}" "${XML}" "${PROCESSED}"
+done
+
+if (( SAVE )) ; then
+	cp "${RESULTS}" "${BENCH_BASELINE}"
+	cat "${BENCH_BASELINE}"
+	echo "Saved baseline to ${BENCH_BASELINE}"
+	exit 0
+fi
+
+if [[ ! -f "${BENCH_BASELINE}" ]] ; then
+	cat "${RESULTS}"
+	echo "No baseline in ${BENCH_BASELINE}, create one with 'make bench-baseline'"
+	exit 0
+fi
+
+# Compare to baseline, a regression is a drop in MB/s or a growth
+# in peak memory by more than the tolerance
+awk -v tolerance="${BENCH_TOLERANCE}" -v baseline_size="$(sed -n 's/^# size=\([0-9.]*\)MB.*/\1/p' "${BENCH_BASELINE}")" -v size="${BENCH_SIZE}" '
+	BEGIN {
+		if (baseline_size != size)
+			printf "Note: baseline was measured with %sMB per workload, this run uses %sMB\n", baseline_size, size
+		printf "%-11s %-17s %9s %8s %12s %12s %8s\n", "workload", "program", "MB/s", "change", "events/s", "peak RSS kB", "change"
+	}
+	/^#/ { next }
+	FNR == NR { speed[$1 " " $2] = $3; rss[$1 " " $2] = $5; next }
+	{
+		key = $1 " " $2
+		if (!(key in speed)) {
+			printf "%-11s %-17s %9.1f %8s %12.0f %12d %8s\n", $1, $2, $3, "new", $4, $5, "new"
+			next
+		}
+		speed_change = (speed[key] > 0) ? 100 * ($3 - speed[key]) / speed[key] : 0
+		rss_change = (rss[key] > 0) ? 100 * ($5 - rss[key]) / rss[key] : 0
+		mark = ""
+		if (speed_change < -tolerance || rss_change > tolerance) {
+			mark = "  REGRESSION"
+			++regressions
+		}
+		printf "%-11s %-17s %9.1f %+7.1f%% %12.0f %12d %+7.1f%%%s\n", $1, $2, $3, speed_change, $4, $5, rss_change, mark
+	}
+	END {
+		if (regressions > 0) {
+			printf "%d regression(s) beyond %s%%\n", regressions, tolerance
+			exit 1
+		}
+	}
+' "${BENCH_BASELINE}" "${RESULTS}"
@@ -0,0 +1,264 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "binaryoutput.h"
+
+/**
+ * Open @p spill to write to a new temporary file, which is
+ * removed again right away and disappears once it is closed.
+ * Returns 0 on success.
+ */
+static int open_spill(struct xmloutput *spill)
+{
+    const char *directory = getenv("TMPDIR");
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/scriptinterpreter-XXXXXX", directory != NULL && directory[0] != '\0' ? directory : "/tmp");
+    int fd = mkstemp(filename);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create temporary file \"%s\": %s\n", filename, strerror(errno));
+        return 1;
+    }
+    unlink(filename);
+    if (xmloutput_open(spill, fd, BINARYOUTPUT_SPILL_BUFFER_SIZE) != 0) {
+        close(fd);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Close the temporary file of @p spill and release its buffer
+ */
+static void close_spill(struct xmloutput *spill)
+{
+    int fd = spill->fd;
+    free(spill->buffer);
+    spill->buffer = NULL;
+    close(fd);
+}
+
+/**
+ * Append the contents of the temporary file of @p spill to
+ * @p output, reading it through the buffer of @p spill.
+ * Returns 0 on success.
+ */
+static int copy_spill(struct xmloutput *spill, struct xmloutput *output)
+{
+    if (xmloutput_flush(spill) != 0 || spill->error || lseek(spill->fd, 0, SEEK_SET) != 0)
+        return 1;
+    for (size_t left = xmloutput_position(spill); left > 0;) {
+        ssize_t len = read(spill->fd, spill->buffer, left < spill->size ? left : spill->size);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0) {
+            fprintf(stderr, "Cannot read temporary file of binary output\n");
+            return 1;
+        }
+        xmloutput_write(output, spill->buffer, (size_t)len);
+        left -= (size_t)len;
+    }
+    return 0;
+}
+
+/**
+ * Start a binary event file in @p output, which has to write
+ * to a seekable file. Returns 0 on success.
+ */
+int binaryoutput_open(struct binaryoutput *binary, struct xmloutput *output)
+{
+    binary->output = output;
+    binary->header_offset = lseek(output->fd, 0, SEEK_CUR);
+    if (binary->header_offset < 0) {
+        fprintf(stderr, "Binary output requires a seekable output file\n");
+        return 1;
+    }
+    binary->header_offset += output->length;
+    binary->event_count = 0;
+    binary->text_pending = 0;
+    if (open_spill(&binary->timesteps) != 0)
+        return 1;
+    if (open_spill(&binary->pool) != 0) {
+        close_spill(&binary->timesteps);
+        return 1;
+    }
+
+    /// Placeholder, an incomplete file is recognized by its missing magic
+    struct eventfile_header header;
+    memset(&header, 0, sizeof(header));
+    xmloutput_write(output, (const char *)&header, sizeof(header));
+    return 0;
+}
+
+/**
+ * Write a single event record
+ */
+static void write_record(struct binaryoutput *binary, const struct eventfile_record *record)
+{
+    xmloutput_write(binary->output, (const char *)record, sizeof(struct eventfile_record));
+    ++binary->event_count;
+}
+
+/**
+ * Write the text record held back so far, if any
+ */
+static void write_pending_text(struct binaryoutput *binary)
+{
+    if (binary->text_pending) {
+        write_record(binary, &binary->text);
+        binary->text_pending = 0;
+    }
+}
+
+/**
+ * Add @p len bytes of text to the pool and to the pending text
+ * record, which is started if needed. Texts too long for a
+ * single record are continued in further records.
+ */
+static void append_text(struct binaryoutput *binary, const char *text, size_t len, int continued)
+{
+    if (!continued)
+        write_pending_text(binary);
+    while (len > 0) {
+        if (binary->text_pending && binary->text.length == UINT32_MAX) {
+            binary->text.kind |= EVENTFILE_TEXT_CONTINUES;
+            write_pending_text(binary);
+        }
+        if (!binary->text_pending) {
+            memset(&binary->text, 0, sizeof(binary->text));
+            binary->text.type = EVENT_TEXT;
+            binary->text.position = xmloutput_position(&binary->pool);
+            binary->text_pending = 1;
+        }
+        size_t piece = UINT32_MAX - binary->text.length;
+        if (piece > len)
+            piece = len;
+        xmloutput_write(&binary->pool, text, piece);
+        binary->text.length += (uint32_t)piece;
+        text += piece;
+        len -= piece;
+    }
+}
+
+/**
+ * Event sink callback appending @p event to the struct
+ * binaryoutput passed as @p context.
+ */
+void binaryoutput_write(void *context, const struct event *event)
+{
+    struct binaryoutput *binary = (struct binaryoutput *)context;
+
+    if (event->type == EVENT_TEXT) {
+        append_text(binary, event->text, event->length, event->continued);
+        return;
+    }
+    write_pending_text(binary);
+
+    struct eventfile_record record;
+    memset(&record, 0, sizeof(record));
+    record.type = (uint8_t)event->type;
+    record.kind = (uint8_t)event->kind;
+    record.value = (uint8_t)event->value;
+    record.intensity = (uint8_t)event->intensity;
+
+    switch (event->type) {
+    case EVENT_TIMESTEP:
+        binary->timestep.delay = event->delay;
+        binary->timestep.first_event = binary->event_count;
+        break;
+    case EVENT_TIMESTEP_END:
+        binary->timestep.event_count = binary->event_count - binary->timestep.first_event;
+        xmloutput_write(&binary->timesteps, (const char *)&binary->timestep, sizeof(binary->timestep));
+        break;
+    case EVENT_TEXT:
+    case EVENT_TEXT_END:
+        break; ///< end of text is implied by the next record
+    case EVENT_OSC:
+        if (event->length > UINT32_MAX)
+            break; ///< cannot happen, command strings are short
+        record.position = xmloutput_position(&binary->pool);
+        record.length = (uint32_t)event->length;
+        xmloutput_write(&binary->pool, event->text, event->length);
+        write_record(binary, &record);
+        break;
+    case EVENT_CURSOR:
+        record.length = (uint32_t)(int32_t)event->row;
+        record.position = (uint64_t)(int64_t)event->column;
+        write_record(binary, &record);
+        break;
+    case EVENT_EDIT:
+        record.value = 0;
+        record.length = (uint32_t)event->value;
+        write_record(binary, &record);
+        break;
+    case EVENT_SCROLL_REGION:
+        record.value = 0;
+        record.length = (uint32_t)event->row;
+        record.position = (uint64_t)event->value;
+        write_record(binary, &record);
+        break;
+    default:
+        write_record(binary, &record);
+        break;
+    }
+}
+
+/**
+ * Append timesteps and texts, complete the header and release
+ * all memory. Steps not ended yet are left out. The output
+ * itself is flushed, but not closed. Returns 0 on success.
+ */
+int binaryoutput_close(struct binaryoutput *binary)
+{
+    write_pending_text(binary);
+
+    struct eventfile_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EVENTFILE_MAGIC, sizeof(header.magic));
+    header.version = EVENTFILE_VERSION;
+    header.byte_order = EVENTFILE_BYTE_ORDER;
+    header.event_count = binary->event_count;
+    header.event_offset = sizeof(header);
+    header.timestep_count = xmloutput_position(&binary->timesteps) / sizeof(struct eventfile_timestep);
+    header.timestep_offset = header.event_offset + header.event_count * sizeof(struct eventfile_record);
+    header.pool_size = xmloutput_position(&binary->pool);
+    header.pool_offset = header.timestep_offset + xmloutput_position(&binary->timesteps);
+
+    int ret = copy_spill(&binary->timesteps, binary->output) != 0 || copy_spill(&binary->pool, binary->output) != 0;
+    close_spill(&binary->timesteps);
+    close_spill(&binary->pool);
+    if (xmloutput_flush(binary->output) != 0)
+        ret = 1;
+
+    /// Only now the file is complete and may be recognized as such
+    if (ret == 0 && pwrite(binary->output->fd, &header, sizeof(header), binary->header_offset) != (ssize_t)sizeof(header)) {
+        fprintf(stderr, "Cannot write header of binary output: %s\n", strerror(errno));
+        ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,72 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_BINARYOUTPUT_H
+#define SCRIPTINTERPRETER_BINARYOUTPUT_H
+
+#include <sys/types.h>
+
+#include "eventfile.h"
+#include "xmloutput.h"
+
+/// Buffer size for the temporary files of timesteps and texts
+#define BINARYOUTPUT_SPILL_BUFFER_SIZE (1 << 16)
+
+/**
+ * Writer for binary event files. Event records are streamed to
+ * the output file as they come; timesteps and texts are streamed
+ * to two temporary files, so memory use does not grow with the
+ * recording. They are copied behind the event records when the
+ * output is closed, followed by filling in the header at the
+ * beginning of the file. The temporary files are created in
+ * $TMPDIR, or /tmp if it is not set.
+ */
+struct binaryoutput {
+    struct xmloutput *output; ///< buffered output file, must be seekable
+    off_t header_offset; ///< position of the header in the output file
+    struct xmloutput timesteps; ///< table of struct eventfile_timestep, in a temporary file
+    struct xmloutput pool; ///< bytes of all texts, in a temporary file
+    uint64_t event_count;
+    struct eventfile_timestep timestep; ///< timestep currently written
+    struct eventfile_record text; ///< text record not yet written
+    int text_pending; ///< @c text holds a text that may still grow
+};
+
+/**
+ * Start a binary event file in @p output, which has to write
+ * to a seekable file. Returns 0 on success.
+ */
+int binaryoutput_open(struct binaryoutput *binary, struct xmloutput *output);
+
+/**
+ * Event sink callback appending @p event to the struct
+ * binaryoutput passed as @p context.
+ */
+void binaryoutput_write(void *context, const struct event *event);
+
+/**
+ * Append timesteps and texts, complete the header and release
+ * all memory. Steps not ended yet are left out. The output
+ * itself is flushed, but not closed. Returns 0 on success.
+ */
+int binaryoutput_close(struct binaryoutput *binary);
+
+#endif // SCRIPTINTERPRETER_BINARYOUTPUT_H
@@ -0,0 +1,79 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "eventfile.h"
+#include "xmlevents.h"
+#include "xmloutput.h"
+
+/**
+ * Convert a binary event file written by 'scriptinterpreter
+ * --format=binary' into the XML that scriptinterpreter would
+ * have written for the same recording.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Require two parameters: eventfilename xmloutputfilename, got %d parameters\n", argc - 1);
+        return 1;
+    }
+
+    struct eventfile eventfile;
+    if (eventfile_open(&eventfile, argv[1]) != 0)
+        return 1;
+
+    char *xmloutputfilename = argv[2];
+    int xmloutputfd;
+    if (xmloutputfilename[0] == '-' && xmloutputfilename[1] == '\0')
+        xmloutputfd = STDOUT_FILENO;
+    else
+        xmloutputfd = open(xmloutputfilename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    struct xmloutput xmloutput;
+    if (xmloutputfd < 0 || xmloutput_open(&xmloutput, xmloutputfd, XMLOUTPUT_BUFFER_SIZE) != 0) {
+        if (xmloutputfd > STDOUT_FILENO)
+            close(xmloutputfd);
+        eventfile_close(&eventfile);
+        fprintf(stderr, "Cannot open xmloutputfilename \"%s\"\n", xmloutputfilename);
+        return 1;
+    }
+
+    struct event_sink sink = { xmlevents_write, &xmloutput };
+    xmlevents_begin(&xmloutput);
+    int ret = eventfile_replay(&eventfile, 0, eventfile.header->timestep_count, &sink);
+    if (ret != 0)
+        fprintf(stderr, "Event file \"%s\" contains invalid events\n", argv[1]);
+    else
+        xmlevents_end(&xmloutput);
+
+    if (xmloutput_close(&xmloutput) != 0)
+        ret = 1;
+    if (xmloutputfd != STDOUT_FILENO)
+        close(xmloutputfd);
+    eventfile_close(&eventfile);
+
+    return ret;
+}
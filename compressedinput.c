@@ -0,0 +1,379 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compressedinput.h"
+
+/// Size of the buffer for compressed data read from the file
+#define COMPRESSED_READ_SIZE (1 << 16)
+
+/**
+ * State of the decompressing thread
+ */
+struct compressed_decoder {
+    unsigned char *buffer; ///< compressed data read from the file
+    size_t length; ///< bytes in @c buffer
+    size_t used; ///< bytes of @c buffer passed to the decompressor
+    int end_of_file; ///< nothing left to read from the file
+    int inside_frame; ///< inside a gzip member or zstd frame
+    z_stream gzip;
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx *zstd;
+#endif
+};
+
+/**
+ * Name of a compression format, like "gzip".
+ */
+const char *compression_name(int compression)
+{
+    return compression == COMPRESSION_GZIP ? "gzip" : (compression == COMPRESSION_ZSTD ? "zstd" : "none");
+}
+
+/**
+ * Recognize the compression of @p file by the magic number at its
+ * current position, which is left unchanged. Only files that can be
+ * positioned are recognized, anything else is taken as uncompressed.
+ */
+int compression_detect(FILE *file)
+{
+    long position = ftell(file);
+    if (position < 0)
+        return COMPRESSION_NONE;
+
+    unsigned char magic[4];
+    size_t len = fread(magic, 1, sizeof(magic), file);
+    if (fseek(file, position, SEEK_SET) != 0)
+        return COMPRESSION_NONE;
+
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return COMPRESSION_GZIP;
+    if (len == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+/**
+ * Read the next block of compressed data once the previous
+ * one has been used up. Returns 0 on success.
+ */
+static int refill(struct compressed_input *input, struct compressed_decoder *decoder)
+{
+    if (decoder->used < decoder->length || decoder->end_of_file)
+        return 0;
+    decoder->length = fread(decoder->buffer, 1, COMPRESSED_READ_SIZE, input->file);
+    decoder->used = 0;
+    if (decoder->length < COMPRESSED_READ_SIZE) {
+        if (ferror(input->file)) {
+            fprintf(stderr, "Error while reading %s compressed file\n", compression_name(input->compression));
+            return 1;
+        }
+        decoder->end_of_file = 1;
+    }
+    return 0;
+}
+
+/**
+ * Pass the compressed data left in the decoder's buffer on to the
+ * decompressor, writing to @p out of @p size bytes from offset
+ * @p *done on, which is advanced. Returns 0 on success.
+ */
+static int decompress(struct compressed_input *input, struct compressed_decoder *decoder, char *out, size_t size, size_t *done)
+{
+    if (input->compression == COMPRESSION_GZIP) {
+        if (!decoder->inside_frame) {
+            /// Concatenated members, as written by pigz or 'cat a.gz b.gz'
+            inflateReset(&decoder->gzip);
+            decoder->inside_frame = 1;
+        }
+        decoder->gzip.next_in = decoder->buffer + decoder->used;
+        decoder->gzip.avail_in = (uInt)(decoder->length - decoder->used);
+        decoder->gzip.next_out = (Bytef *)out + *done;
+        decoder->gzip.avail_out = (uInt)(size - *done);
+        int ret = inflate(&decoder->gzip, Z_NO_FLUSH);
+        decoder->used = decoder->length - decoder->gzip.avail_in;
+        *done = size - decoder->gzip.avail_out;
+        if (ret == Z_STREAM_END)
+            decoder->inside_frame = 0;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            fprintf(stderr, "Cannot decompress gzip data: %s\n", decoder->gzip.msg != NULL ? decoder->gzip.msg : "unknown error");
+            return 1;
+        }
+        return 0;
+    }
+
+#ifdef HAVE_ZSTD
+    ZSTD_inBuffer in = { decoder->buffer + decoder->used, decoder->length - decoder->used, 0 };
+    ZSTD_outBuffer output = { out, size, *done };
+    size_t ret = ZSTD_decompressStream(decoder->zstd, &output, &in);
+    decoder->used += in.pos;
+    *done = output.pos;
+    if (ZSTD_isError(ret)) {
+        fprintf(stderr, "Cannot decompress zstd data: %s\n", ZSTD_getErrorName(ret));
+        return 1;
+    }
+    /// Zero once a frame is complete and all of it has been written
+    decoder->inside_frame = ret != 0;
+#endif
+    return 0;
+}
+
+/**
+ * Fill @p out of @p size bytes with decompressed data, less only at
+ * the end of the data. The number of bytes is written to @p len.
+ * Returns 0 on success.
+ */
+static int fill_slot(struct compressed_input *input, struct compressed_decoder *decoder, char *out, size_t size, size_t *len)
+{
+    size_t done = 0;
+    while (done < size) {
+        if (refill(input, decoder) != 0)
+            return 1;
+        size_t available = decoder->length - decoder->used;
+        if (available == 0 && !decoder->inside_frame)
+            break;
+        /// Without new input, the decompressor may still hold output
+        size_t before = done;
+        if (decompress(input, decoder, out, size, &done) != 0)
+            return 1;
+        if (available == 0 && done == before)
+            break;
+    }
+    *len = done;
+    if (done < size && decoder->inside_frame) {
+        fprintf(stderr, "Unexpected end of %s compressed file\n", compression_name(input->compression));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Decompressing thread: fill one free slot of the ring after
+ * another until all data is decompressed or reading stops
+ */
+static void *decompress_thread(void *arg)
+{
+    struct compressed_input *input = (struct compressed_input *)arg;
+
+    /// Signals are for the reading thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    for (;;) {
+        pthread_mutex_lock(&input->mutex);
+        while (input->filled - input->released == COMPRESSED_INPUT_SLOTS && !input->stop)
+            pthread_cond_wait(&input->changed, &input->mutex);
+        int stop = input->stop;
+        pthread_mutex_unlock(&input->mutex);
+        if (stop)
+            return NULL;
+
+        /// The reading thread does not touch free slots
+        size_t slot = input->filled % COMPRESSED_INPUT_SLOTS, len;
+        int ret = fill_slot(input, input->decoder, input->slots + slot * COMPRESSED_INPUT_SLOT_SIZE, COMPRESSED_INPUT_SLOT_SIZE, &len);
+
+        pthread_mutex_lock(&input->mutex);
+        if (ret != 0)
+            input->error = 1;
+        else {
+            if (len > 0) {
+                input->lengths[slot] = len;
+                ++input->filled;
+            }
+            if (len < COMPRESSED_INPUT_SLOT_SIZE)
+                input->finished = 1;
+        }
+        pthread_cond_broadcast(&input->changed);
+        pthread_mutex_unlock(&input->mutex);
+        if (ret != 0 || len < COMPRESSED_INPUT_SLOT_SIZE)
+            return NULL;
+    }
+}
+
+/**
+ * Release the decompressor's state
+ */
+static void free_decoder(struct compressed_input *input)
+{
+    if (input->decoder == NULL)
+        return;
+    if (input->compression == COMPRESSION_GZIP)
+        inflateEnd(&input->decoder->gzip);
+#ifdef HAVE_ZSTD
+    else
+        ZSTD_freeDCtx(input->decoder->zstd);
+#endif
+    free(input->decoder->buffer);
+    free(input->decoder);
+    input->decoder = NULL;
+}
+
+/**
+ * Start decompressing @p file, compressed as @p compression, on a
+ * separate thread. Returns 0 on success.
+ */
+int compressed_input_open(struct compressed_input *input, FILE *file, int compression)
+{
+    memset(input, 0, sizeof(*input));
+    input->file = file;
+    input->compression = compression;
+
+#ifndef HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+        fprintf(stderr, "Cannot read zstd compressed files, built without zstd support\n");
+        return 1;
+    }
+#endif
+
+    input->decoder = (struct compressed_decoder *)calloc(1, sizeof(struct compressed_decoder));
+    if (input->decoder == NULL)
+        return 1;
+    input->decoder->buffer = (unsigned char *)malloc(COMPRESSED_READ_SIZE);
+    input->slots = (char *)malloc((size_t)COMPRESSED_INPUT_SLOTS * COMPRESSED_INPUT_SLOT_SIZE);
+    int ret = input->decoder->buffer == NULL || input->slots == NULL;
+    if (ret == 0 && compression == COMPRESSION_GZIP)
+        /// Window size 15 plus 32 for gzip and zlib headers
+        ret = inflateInit2(&input->decoder->gzip, 15 + 32) != Z_OK;
+#ifdef HAVE_ZSTD
+    else if (ret == 0)
+        ret = (input->decoder->zstd = ZSTD_createDCtx()) == NULL;
+#endif
+    if (ret != 0) {
+        fprintf(stderr, "Cannot allocate memory for %s decompression\n", compression_name(compression));
+        free_decoder(input);
+        free(input->slots);
+        input->slots = NULL;
+        return 1;
+    }
+
+    pthread_mutex_init(&input->mutex, NULL);
+    pthread_cond_init(&input->changed, NULL);
+    if (pthread_create(&input->thread, NULL, decompress_thread, input) != 0) {
+        fprintf(stderr, "Cannot start thread for %s decompression\n", compression_name(compression));
+        pthread_cond_destroy(&input->changed);
+        pthread_mutex_destroy(&input->mutex);
+        free_decoder(input);
+        free(input->slots);
+        input->slots = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Return the next chunk of decompressed data, its length is
+ * written to @p len and is 0 at the end of the data. The chunk
+ * remains valid until the next call. Returns NULL on error.
+ */
+const char *compressed_input_next(struct compressed_input *input, size_t *len)
+{
+    pthread_mutex_lock(&input->mutex);
+    if (input->holding) {
+        /// Previous chunk is done with, its slot may be filled again
+        ++input->released;
+        input->holding = 0;
+        pthread_cond_broadcast(&input->changed);
+    }
+    while (input->filled == input->released && !input->finished && !input->error)
+        pthread_cond_wait(&input->changed, &input->mutex);
+
+    const char *chunk = NULL;
+    *len = 0;
+    if (input->filled > input->released) {
+        size_t slot = input->released % COMPRESSED_INPUT_SLOTS;
+        chunk = input->slots + slot * COMPRESSED_INPUT_SLOT_SIZE;
+        *len = input->lengths[slot];
+        input->holding = 1;
+    } else if (!input->error)
+        chunk = input->slots; ///< end of data
+    pthread_mutex_unlock(&input->mutex);
+    return chunk;
+}
+
+/**
+ * Decompress everything left into a single buffer allocated
+ * with malloc, its length is written to @p len.
+ * Returns NULL on error.
+ */
+char *compressed_input_read_all(struct compressed_input *input, size_t *len)
+{
+    size_t size = COMPRESSED_INPUT_SLOT_SIZE;
+    char *data = (char *)malloc(size);
+    *len = 0;
+    if (data == NULL) {
+        fprintf(stderr, "Cannot allocate memory for decompressed data\n");
+        return NULL;
+    }
+    for (;;) {
+        size_t chunk_len;
+        const char *chunk = compressed_input_next(input, &chunk_len);
+        if (chunk == NULL) {
+            free(data);
+            return NULL;
+        }
+        if (chunk_len == 0)
+            return data;
+        if (*len + chunk_len > size) {
+            size *= 2;
+            char *new_data = (char *)realloc(data, size);
+            if (new_data == NULL)
+                free(data);
+            data = new_data;
+            if (data == NULL) {
+                fprintf(stderr, "Cannot allocate memory for decompressed data\n");
+                return NULL;
+            }
+        }
+        memcpy(data + *len, chunk, chunk_len);
+        *len += chunk_len;
+    }
+}
+
+/**
+ * Stop the decompressing thread and release the ring buffer,
+ * but do not close the file.
+ */
+void compressed_input_close(struct compressed_input *input)
+{
+    if (input->slots == NULL)
+        return;
+    pthread_mutex_lock(&input->mutex);
+    input->stop = 1;
+    pthread_cond_broadcast(&input->changed);
+    pthread_mutex_unlock(&input->mutex);
+    pthread_join(input->thread, NULL);
+
+    pthread_cond_destroy(&input->changed);
+    pthread_mutex_destroy(&input->mutex);
+    free_decoder(input);
+    free(input->slots);
+    input->slots = NULL;
+}
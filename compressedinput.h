@@ -0,0 +1,102 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_COMPRESSEDINPUT_H
+#define SCRIPTINTERPRETER_COMPRESSEDINPUT_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+/// Size of one slot of the ring buffer of decompressed data
+#define COMPRESSED_INPUT_SLOT_SIZE (1 << 18)
+/// Number of slots, the decompressing thread may run this far ahead
+#define COMPRESSED_INPUT_SLOTS 8
+
+/// Compression formats recognized by their magic numbers
+enum compression {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+};
+
+/**
+ * Reader for a gzip or zstd compressed file. A separate thread
+ * decompresses the file into a ring of fixed-size slots, the
+ * reading thread is handed out one filled slot at a time, so
+ * decompressing and parsing run on different cores and nothing
+ * decompressed is ever written to disk.
+ */
+struct compressed_input {
+    FILE *file;
+    int compression;
+    char *slots; ///< COMPRESSED_INPUT_SLOTS slots of COMPRESSED_INPUT_SLOT_SIZE bytes
+    size_t lengths[COMPRESSED_INPUT_SLOTS]; ///< bytes used in each slot
+    size_t filled; ///< number of slots filled so far by the decompressing thread
+    size_t released; ///< number of slots given back by the reading thread
+    int holding; ///< non-zero while the reading thread uses slot @c released
+    int finished; ///< all data has been decompressed
+    int error; ///< non-zero once decompressing failed
+    int stop; ///< reading thread is no longer interested
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_t thread;
+    struct compressed_decoder *decoder; ///< state of the decompressing thread
+};
+
+/**
+ * Name of a compression format, like "gzip".
+ */
+const char *compression_name(int compression);
+
+/**
+ * Recognize the compression of @p file by the magic number at its
+ * current position, which is left unchanged. Only files that can be
+ * positioned are recognized, anything else is taken as uncompressed.
+ */
+int compression_detect(FILE *file);
+
+/**
+ * Start decompressing @p file, compressed as @p compression, on a
+ * separate thread. Returns 0 on success.
+ */
+int compressed_input_open(struct compressed_input *input, FILE *file, int compression);
+
+/**
+ * Return the next chunk of decompressed data, its length is
+ * written to @p len and is 0 at the end of the data. The chunk
+ * remains valid until the next call. Returns NULL on error.
+ */
+const char *compressed_input_next(struct compressed_input *input, size_t *len);
+
+/**
+ * Decompress everything left into a single buffer allocated
+ * with malloc, its length is written to @p len.
+ * Returns NULL on error.
+ */
+char *compressed_input_read_all(struct compressed_input *input, size_t *len);
+
+/**
+ * Stop the decompressing thread and release the ring buffer,
+ * but do not close the file.
+ */
+void compressed_input_close(struct compressed_input *input);
+
+#endif // SCRIPTINTERPRETER_COMPRESSEDINPUT_H
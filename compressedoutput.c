@@ -0,0 +1,353 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compressedoutput.h"
+
+/// Magic number of the skippable frame holding a zstd seek table
+#define SEEKABLE_SKIPPABLE_MAGIC 0x184D2A5E
+/// Magic number at the very end of a zstd seek table
+#define SEEKABLE_MAGIC 0x8F92EAB1
+
+/**
+ * Compressor state of one worker thread
+ */
+struct compress_worker {
+    z_stream gzip;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+};
+
+/**
+ * Write all @p len bytes of @p data to @p fd, retrying after
+ * partial writes and interruptions. Returns 0 on success.
+ */
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Cannot write compressed output: %s\n", strerror(errno));
+            return 1;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Store @p value as four bytes in little-endian order
+ */
+static void put_le32(unsigned char *p, uint32_t value)
+{
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+/**
+ * Compress @p block into a gzip member or zstd frame of its own.
+ * Returns 0 on success.
+ */
+static int compress_block(struct compressed_output *output, struct compress_worker *worker, struct compressed_block *block)
+{
+    /// Reset first, the bound depends on the header still to be written
+    if (output->compression == COMPRESSION_GZIP)
+        deflateReset(&worker->gzip);
+    size_t bound = output->compression == COMPRESSION_GZIP ? deflateBound(&worker->gzip, (uLong)block->length) : 0;
+#ifdef HAVE_ZSTD
+    if (output->compression == COMPRESSION_ZSTD)
+        bound = ZSTD_compressBound(block->length);
+#endif
+    if (bound > block->compressed_size) {
+        char *compressed = (char *)realloc(block->compressed, bound);
+        if (compressed == NULL) {
+            fprintf(stderr, "Cannot allocate memory for compressed output\n");
+            return 1;
+        }
+        block->compressed = compressed;
+        block->compressed_size = bound;
+    }
+
+    if (output->compression == COMPRESSION_GZIP) {
+        worker->gzip.next_in = (Bytef *)block->data;
+        worker->gzip.avail_in = (uInt)block->length;
+        worker->gzip.next_out = (Bytef *)block->compressed;
+        worker->gzip.avail_out = (uInt)bound;
+        if (deflate(&worker->gzip, Z_FINISH) != Z_STREAM_END) {
+            fprintf(stderr, "Cannot compress output with gzip: %s\n", worker->gzip.msg != NULL ? worker->gzip.msg : "unknown error");
+            return 1;
+        }
+        block->compressed_length = bound - worker->gzip.avail_out;
+        return 0;
+    }
+
+#ifdef HAVE_ZSTD
+    size_t ret = ZSTD_compressCCtx(worker->zstd, block->compressed, bound, block->data, block->length, output->level);
+    if (ZSTD_isError(ret)) {
+        fprintf(stderr, "Cannot compress output with zstd: %s\n", ZSTD_getErrorName(ret));
+        return 1;
+    }
+    block->compressed_length = ret;
+#endif
+    return 0;
+}
+
+/**
+ * Worker thread: take the blocks one after another as they are
+ * handed in, compress them and write them in order
+ */
+static void *compress_thread(void *arg)
+{
+    struct compressed_output *output = (struct compressed_output *)arg;
+
+    /// Signals are for the main thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    struct compress_worker worker;
+    memset(&worker, 0, sizeof(worker));
+    int ready = 1;
+    if (output->compression == COMPRESSION_GZIP)
+        /// Window size 15 plus 16 for a gzip header and trailer
+        ready = deflateInit2(&worker.gzip, output->level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+#ifdef HAVE_ZSTD
+    else
+        ready = (worker.zstd = ZSTD_createCCtx()) != NULL;
+#endif
+    if (!ready)
+        fprintf(stderr, "Cannot allocate memory for %s compression\n", compression_name(output->compression));
+
+    for (;;) {
+        pthread_mutex_lock(&output->mutex);
+        while (output->taken == output->submitted && !output->stop)
+            pthread_cond_wait(&output->changed, &output->mutex);
+        if (output->taken == output->submitted) {
+            pthread_mutex_unlock(&output->mutex);
+            break;
+        }
+        size_t number = output->taken++;
+        pthread_mutex_unlock(&output->mutex);
+
+        struct compressed_block *block = output->blocks + number % output->block_count;
+        int ret = ready ? compress_block(output, &worker, block) : 1;
+
+        /// Earlier blocks go first
+        pthread_mutex_lock(&output->mutex);
+        while (output->written != number)
+            pthread_cond_wait(&output->changed, &output->mutex);
+        int failed = output->error;
+        pthread_mutex_unlock(&output->mutex);
+        if (ret == 0 && !failed)
+            ret = write_all(output->fd, block->compressed, block->compressed_length);
+
+        pthread_mutex_lock(&output->mutex);
+        if (ret == 0 && !failed && output->seekable) {
+            if (output->frame_size_count == output->frame_size_capacity) {
+                size_t capacity = output->frame_size_capacity > 0 ? output->frame_size_capacity * 2 : 256;
+                uint32_t *frame_sizes = (uint32_t *)realloc(output->frame_sizes, capacity * sizeof(uint32_t));
+                if (frame_sizes == NULL)
+                    ret = 1;
+                else {
+                    output->frame_sizes = frame_sizes;
+                    output->frame_size_capacity = capacity;
+                }
+            }
+            if (ret == 0) {
+                output->frame_sizes[output->frame_size_count++] = (uint32_t)block->compressed_length;
+                output->frame_sizes[output->frame_size_count++] = (uint32_t)block->length;
+            }
+        }
+        if (ret != 0)
+            output->error = 1;
+        ++output->written;
+        pthread_cond_broadcast(&output->changed);
+        pthread_mutex_unlock(&output->mutex);
+    }
+
+    if (output->compression == COMPRESSION_GZIP)
+        deflateEnd(&worker.gzip);
+#ifdef HAVE_ZSTD
+    else
+        ZSTD_freeCCtx(worker.zstd);
+#endif
+    return NULL;
+}
+
+/**
+ * Prepare writing data compressed as @p compression at @p level
+ * to file descriptor @p fd, using @p thread_count worker threads.
+ * If @p seekable is non-zero, a zstd seek table will be written
+ * at the end. Returns 0 on success.
+ */
+int compressed_output_open(struct compressed_output *output, int fd, int compression, int level, int thread_count, int seekable)
+{
+    memset(output, 0, sizeof(*output));
+    output->fd = fd;
+    output->compression = compression;
+    output->level = level;
+    output->seekable = seekable && compression == COMPRESSION_ZSTD;
+
+#ifndef HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+        fprintf(stderr, "Cannot write zstd compressed files, built without zstd support\n");
+        return 1;
+    }
+#endif
+
+    output->block_count = (size_t)thread_count * COMPRESSED_OUTPUT_BLOCKS_PER_THREAD;
+    output->blocks = (struct compressed_block *)calloc(output->block_count, sizeof(struct compressed_block));
+    output->threads = (pthread_t *)calloc((size_t)thread_count, sizeof(pthread_t));
+    if (output->blocks == NULL || output->threads == NULL) {
+        fprintf(stderr, "Cannot allocate memory for compressed output\n");
+        free(output->blocks);
+        free(output->threads);
+        output->blocks = NULL;
+        output->threads = NULL;
+        return 1;
+    }
+
+    pthread_mutex_init(&output->mutex, NULL);
+    pthread_cond_init(&output->changed, NULL);
+    for (; output->thread_count < thread_count; ++output->thread_count)
+        if (pthread_create(output->threads + output->thread_count, NULL, compress_thread, output) != 0) {
+            fprintf(stderr, "Cannot start thread for %s compression\n", compression_name(compression));
+            output->error = 1;
+            compressed_output_close(output);
+            return 1;
+        }
+    return 0;
+}
+
+/**
+ * Hand in @p len bytes to be compressed as a block of their own.
+ * Blocks are compressed in parallel and written in order, this
+ * only waits if all blocks are in use.
+ * Returns 0 on success. Meant as writer of struct xmloutput,
+ * with the struct compressed_output passed as @p context.
+ */
+int compressed_output_write(void *context, const char *data, size_t len)
+{
+    struct compressed_output *output = (struct compressed_output *)context;
+
+    /// A block can be used again once its previous data is written
+    pthread_mutex_lock(&output->mutex);
+    while (output->submitted - output->written == output->block_count)
+        pthread_cond_wait(&output->changed, &output->mutex);
+    int failed = output->error;
+    pthread_mutex_unlock(&output->mutex);
+    if (failed)
+        return 1;
+
+    struct compressed_block *block = output->blocks + output->submitted % output->block_count;
+    if (len > block->size) {
+        char *new_data = (char *)realloc(block->data, len);
+        if (new_data == NULL) {
+            fprintf(stderr, "Cannot allocate memory for compressed output\n");
+            pthread_mutex_lock(&output->mutex);
+            output->error = 1;
+            pthread_mutex_unlock(&output->mutex);
+            return 1;
+        }
+        block->data = new_data;
+        block->size = len;
+    }
+    memcpy(block->data, data, len);
+    block->length = len;
+
+    pthread_mutex_lock(&output->mutex);
+    ++output->submitted;
+    pthread_cond_broadcast(&output->changed);
+    pthread_mutex_unlock(&output->mutex);
+    return 0;
+}
+
+/**
+ * Wait for all blocks to be written, add the seek table if
+ * requested and stop the worker threads, but do not close the
+ * file descriptor. Returns 0 if everything has been written.
+ */
+int compressed_output_close(struct compressed_output *output)
+{
+    if (output->blocks == NULL)
+        return 1;
+
+    pthread_mutex_lock(&output->mutex);
+    output->stop = 1;
+    pthread_cond_broadcast(&output->changed);
+    pthread_mutex_unlock(&output->mutex);
+    for (int i = 0; i < output->thread_count; ++i)
+        pthread_join(output->threads[i], NULL);
+    /// Blocks left without any worker to take them
+    int ret = output->error || output->written != output->submitted;
+
+    if (ret == 0 && output->seekable) {
+        /// Skippable frame with one entry per frame and a footer
+        size_t frames = output->frame_size_count / 2;
+        size_t table_len = 8 + frames * 8 + 9;
+        unsigned char *table = (unsigned char *)malloc(table_len);
+        if (table == NULL)
+            ret = 1;
+        else {
+            put_le32(table, SEEKABLE_SKIPPABLE_MAGIC);
+            put_le32(table + 4, (uint32_t)(table_len - 8));
+            for (size_t i = 0; i < frames * 2; ++i)
+                put_le32(table + 8 + i * 4, output->frame_sizes[i]);
+            put_le32(table + table_len - 9, (uint32_t)frames);
+            table[table_len - 5] = 0; ///< no checksums
+            put_le32(table + table_len - 4, SEEKABLE_MAGIC);
+            ret = write_all(output->fd, (const char *)table, table_len);
+            free(table);
+        }
+    }
+
+    pthread_cond_destroy(&output->changed);
+    pthread_mutex_destroy(&output->mutex);
+    for (size_t i = 0; i < output->block_count; ++i) {
+        free(output->blocks[i].data);
+        free(output->blocks[i].compressed);
+    }
+    free(output->blocks);
+    free(output->threads);
+    free(output->frame_sizes);
+    output->blocks = NULL;
+    output->threads = NULL;
+    output->frame_sizes = NULL;
+    return ret;
+}
@@ -0,0 +1,101 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_COMPRESSEDOUTPUT_H
+#define SCRIPTINTERPRETER_COMPRESSEDOUTPUT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compressedinput.h"
+
+/// Blocks queued per worker thread, waiting or being compressed
+#define COMPRESSED_OUTPUT_BLOCKS_PER_THREAD 2
+
+/**
+ * A block of data to be compressed into one gzip member or
+ * zstd frame of its own
+ */
+struct compressed_block {
+    char *data;
+    size_t length; ///< bytes used in @c data
+    size_t size; ///< capacity of @c data
+    char *compressed;
+    size_t compressed_length;
+    size_t compressed_size; ///< capacity of @c compressed
+};
+
+/**
+ * Writer compressing independent blocks on a pool of worker
+ * threads. Each block becomes a gzip member or zstd frame of its
+ * own, concatenated in the order the blocks were written, which
+ * gives a valid gzip or zstd file. Workers write their block
+ * themselves as soon as all earlier blocks are written.
+ * A zstd file may end with a seek table in the format of zstd's
+ * contrib/seekable_format, listing the size of every frame.
+ */
+struct compressed_output {
+    int fd;
+    int compression;
+    int level;
+    int seekable; ///< add a zstd seek table at the end
+    int thread_count;
+    pthread_t *threads;
+    struct compressed_block *blocks; ///< ring of @c block_count blocks
+    size_t block_count;
+    size_t submitted; ///< blocks handed in for compression so far
+    size_t taken; ///< blocks taken by a worker so far
+    size_t written; ///< blocks written to @c fd so far
+    uint32_t *frame_sizes; ///< compressed and uncompressed size of each frame, for the seek table
+    size_t frame_size_count; ///< number of entries in @c frame_sizes
+    size_t frame_size_capacity;
+    int error; ///< non-zero once compressing or writing failed
+    int stop; ///< workers are to finish
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+};
+
+/**
+ * Prepare writing data compressed as @p compression at @p level
+ * to file descriptor @p fd, using @p thread_count worker threads.
+ * If @p seekable is non-zero, a zstd seek table will be written
+ * at the end. Returns 0 on success.
+ */
+int compressed_output_open(struct compressed_output *output, int fd, int compression, int level, int thread_count, int seekable);
+
+/**
+ * Hand in @p len bytes to be compressed as a block of their own.
+ * Blocks are compressed in parallel and written in order, this
+ * only waits if all blocks are in use.
+ * Returns 0 on success. Meant as writer of struct xmloutput,
+ * with the struct compressed_output passed as @p context.
+ */
+int compressed_output_write(void *context, const char *data, size_t len);
+
+/**
+ * Wait for all blocks to be written, add the seek table if
+ * requested and stop the worker threads, but do not close the
+ * file descriptor. Returns 0 if everything has been written.
+ */
+int compressed_output_close(struct compressed_output *output);
+
+#endif // SCRIPTINTERPRETER_COMPRESSEDOUTPUT_H
@@ -0,0 +1,197 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "eventfile.h"
+
+/**
+ * Check that a table of @p count entries of @p entry_size bytes
+ * starting at @p offset lies within a file of @p size bytes and is
+ * aligned for 8-byte fields.
+ */
+static int table_valid(uint64_t offset, uint64_t count, size_t entry_size, size_t size)
+{
+    if (offset % 8 != 0 || offset > size)
+        return 0;
+    return count <= (size - offset) / entry_size;
+}
+
+/**
+ * Map the binary event file @p filename and check its header.
+ * Returns 0 on success.
+ */
+int eventfile_open(struct eventfile *file, const char *filename)
+{
+    file->map = NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open event file \"%s\"\n", filename);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct eventfile_header)) {
+        close(fd);
+        fprintf(stderr, "Event file \"%s\" is too short\n", filename);
+        return 1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Cannot map event file \"%s\"\n", filename);
+        return 1;
+    }
+    file->map = (const char *)map;
+    file->size = (size_t)st.st_size;
+    file->header = (const struct eventfile_header *)map;
+
+    const struct eventfile_header *header = file->header;
+    if (memcmp(header->magic, EVENTFILE_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "\"%s\" is not an event file or is incomplete\n", filename);
+    } else if (header->byte_order != EVENTFILE_BYTE_ORDER) {
+        fprintf(stderr, "Event file \"%s\" was written on a machine with different byte order\n", filename);
+    } else if (header->version != EVENTFILE_VERSION) {
+        fprintf(stderr, "Event file \"%s\" has unsupported version %u\n", filename, (unsigned)header->version);
+    } else if (!table_valid(header->event_offset, header->event_count, sizeof(struct eventfile_record), file->size)
+               || !table_valid(header->timestep_offset, header->timestep_count, sizeof(struct eventfile_timestep), file->size)
+               || header->pool_offset > file->size || header->pool_size > file->size - header->pool_offset) {
+        fprintf(stderr, "Event file \"%s\" is corrupt\n", filename);
+    } else {
+        file->events = (const struct eventfile_record *)(file->map + header->event_offset);
+        file->timesteps = (const struct eventfile_timestep *)(file->map + header->timestep_offset);
+        file->pool = file->map + header->pool_offset;
+        return 0;
+    }
+
+    eventfile_close(file);
+    return 1;
+}
+
+/**
+ * Unmap the file.
+ */
+void eventfile_close(struct eventfile *file)
+{
+    if (file->map != NULL)
+        munmap((void *)file->map, file->size);
+    file->map = NULL;
+}
+
+/**
+ * Turn event record @p index into @p event. Texts point into
+ * the mapped pool. Returns 0 on success, 1 if the record
+ * is invalid.
+ */
+int eventfile_event(const struct eventfile *file, size_t index, struct event *event)
+{
+    if (index >= file->header->event_count)
+        return 1;
+    const struct eventfile_record *record = file->events + index;
+
+    memset(event, 0, sizeof(struct event));
+    event->type = (enum event_type)record->type;
+    event->kind = record->kind;
+    event->value = record->value;
+    event->intensity = record->intensity;
+
+    switch (record->type) {
+    case EVENT_TEXT:
+        event->kind = 0;
+        /// Previous record had more of this text
+        event->continued = index > 0 && file->events[index - 1].type == EVENT_TEXT && (file->events[index - 1].kind & EVENTFILE_TEXT_CONTINUES);
+        /* fall through */
+    case EVENT_OSC:
+        if (record->position > file->header->pool_size || record->length > file->header->pool_size - record->position)
+            return 1;
+        event->text = file->pool + record->position;
+        event->length = record->length;
+        return 0;
+    case EVENT_CURSOR:
+        event->row = (int)(int32_t)record->length;
+        event->column = (int)(int64_t)record->position;
+        return 0;
+    case EVENT_EDIT:
+        event->value = (int)record->length;
+        return 0;
+    case EVENT_SCROLL_REGION:
+        event->row = (int)record->length;
+        event->value = (int)record->position;
+        return 0;
+    case EVENT_NEWLINE:
+    case EVENT_ERASE:
+    case EVENT_COLOR:
+    case EVENT_SCREEN:
+    case EVENT_SPECIAL:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * Pass @p count timesteps starting with timestep @p first with all
+ * their events on to @p sink, in the same order and form as the
+ * parser produced them. Returns 0 on success, 1 if the file
+ * contains invalid records.
+ */
+int eventfile_replay(const struct eventfile *file, size_t first, size_t count, const struct event_sink *sink)
+{
+    const struct eventfile_header *header = file->header;
+    if (first > header->timestep_count || count > header->timestep_count - first)
+        return 1;
+
+    struct event event;
+    for (size_t t = first; t < first + count; ++t) {
+        const struct eventfile_timestep *timestep = file->timesteps + t;
+        if (timestep->first_event > header->event_count || timestep->event_count > header->event_count - timestep->first_event)
+            return 1;
+
+        memset(&event, 0, sizeof(event));
+        event.type = EVENT_TIMESTEP;
+        event.delay = timestep->delay;
+        event_emit(sink, &event);
+
+        for (size_t i = timestep->first_event; i < timestep->first_event + timestep->event_count; ++i) {
+            if (eventfile_event(file, i, &event) != 0)
+                return 1;
+            event_emit(sink, &event);
+            if (event.type == EVENT_TEXT && !(file->events[i].kind & EVENTFILE_TEXT_CONTINUES)) {
+                /// End of text is implied in the file
+                event.type = EVENT_TEXT_END;
+                event.text = NULL;
+                event.length = 0;
+                event_emit(sink, &event);
+            }
+        }
+
+        memset(&event, 0, sizeof(event));
+        event.type = EVENT_TIMESTEP_END;
+        event_emit(sink, &event);
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_EVENTFILE_H
+#define SCRIPTINTERPRETER_EVENTFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "events.h"
+
+/**
+ * Binary event files consist of a header, a table of fixed-size
+ * event records, a table of timesteps and a pool of text bytes.
+ * All numbers are stored in the byte order of the machine that
+ * wrote the file, all offsets are relative to the header's start.
+ */
+#define EVENTFILE_MAGIC "SIEVENTS"
+#define EVENTFILE_VERSION 1
+/// Written as a number, tells readers the byte order of the file
+#define EVENTFILE_BYTE_ORDER 0x01020304u
+
+struct eventfile_header {
+    char magic[8]; ///< EVENTFILE_MAGIC without terminating null character
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t event_count, event_offset;
+    uint64_t timestep_count, timestep_offset;
+    uint64_t pool_size, pool_offset;
+};
+
+/**
+ * A single event except for timesteps, which are kept in their
+ * own table. @c type is an enum event_type, @c kind, @c value and
+ * @c intensity are the fields of struct event with the same name.
+ * For EVENT_TEXT and EVENT_OSC, @c length bytes starting at pool
+ * offset @c position are the text; for EVENT_CURSOR, @c length
+ * is the row and @c position the column (both signed); for
+ * EVENT_EDIT, @c length is the count; for EVENT_SCROLL_REGION,
+ * @c length is the top and @c position the bottom row.
+ * EVENT_TEXT records stand for a complete text up to the implied
+ * EVENT_TEXT_END, unless @c kind has EVENTFILE_TEXT_CONTINUES set.
+ */
+struct eventfile_record {
+    uint8_t type;
+    uint8_t kind;
+    uint8_t value;
+    uint8_t intensity;
+    uint32_t length;
+    uint64_t position;
+};
+
+/// Text continues in the next record, which is a text as well
+#define EVENTFILE_TEXT_CONTINUES 1
+
+struct eventfile_timestep {
+    int64_t delay; ///< in microseconds
+    uint64_t first_event; ///< index of first event record in this timestep
+    uint64_t event_count;
+};
+
+/**
+ * A memory-mapped binary event file
+ */
+struct eventfile {
+    const char *map;
+    size_t size;
+    const struct eventfile_header *header;
+    const struct eventfile_record *events;
+    const struct eventfile_timestep *timesteps;
+    const char *pool;
+};
+
+/**
+ * Map the binary event file @p filename and check its header.
+ * Returns 0 on success.
+ */
+int eventfile_open(struct eventfile *file, const char *filename);
+
+/**
+ * Unmap the file.
+ */
+void eventfile_close(struct eventfile *file);
+
+/**
+ * Turn event record @p index into @p event. Texts point into
+ * the mapped pool. Returns 0 on success, 1 if the record
+ * is invalid.
+ */
+int eventfile_event(const struct eventfile *file, size_t index, struct event *event);
+
+/**
+ * Pass @p count timesteps starting with timestep @p first with all
+ * their events on to @p sink, in the same order and form as the
+ * parser produced them. Returns 0 on success, 1 if the file
+ * contains invalid records.
+ */
+int eventfile_replay(const struct eventfile *file, size_t first, size_t count, const struct event_sink *sink);
+
+#endif // SCRIPTINTERPRETER_EVENTFILE_H
@@ -0,0 +1,41 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#include "events.h"
+
+/**
+ * Name of a color as used in the XML output, like "red"
+ * or "default", or "unknown" for invalid colors.
+ */
+const char *event_color_name(int color)
+{
+    static const char *names[] = {"black", "red", "green", "yellow", "blue", "magenta", "cyan", "white", "unknown", "default"};
+    return color >= 0 && color <= 9 ? names[color] : "unknown";
+}
+
+/**
+ * Name of a color intensity as used in the XML output,
+ * like "normal" or "intense".
+ */
+const char *event_intensity_name(int intensity)
+{
+    return intensity == COLOR_INTENSE ? "intense" : (intensity == COLOR_FAINT ? "faint" : "normal");
+}
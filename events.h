@@ -0,0 +1,171 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_EVENTS_H
+#define SCRIPTINTERPRETER_EVENTS_H
+
+#include <stddef.h>
+
+/// Kinds of events found in a recording
+enum event_type {
+    EVENT_TIMESTEP, ///< start of a timing step, @c delay is set
+    EVENT_TIMESTEP_END,
+    EVENT_TEXT, ///< printable characters in @c text
+    EVENT_TEXT_END, ///< no more characters for the current text
+    EVENT_NEWLINE, ///< see enum newline_kind
+    EVENT_CURSOR, ///< see enum cursor_kind
+    EVENT_ERASE, ///< see enum erase_kind, @c value is an enum erase_range
+    EVENT_COLOR, ///< see enum color_kind
+    EVENT_SCREEN, ///< switch to screen number @c value
+    EVENT_SPECIAL, ///< see enum special_kind
+    EVENT_OSC, ///< window title in @c text
+    EVENT_EDIT, ///< see enum edit_kind, @c value is the count
+    EVENT_SCROLL_REGION ///< only rows @c row to @c value (1-based, 0 for the last row) scroll, not part of the XML output
+};
+
+/// Line breaks are written as a single newline in the XML output
+enum newline_kind {
+    NEWLINE_CRLF, ///< CR followed by LF, start of the next line
+    NEWLINE_CR, ///< lone CR, start of the current line
+    NEWLINE_LF ///< lone LF, next line in the same column
+};
+
+/// Kinds from CURSOR_MOVE on are not part of the XML output
+enum cursor_kind {
+    CURSOR_POSITION, ///< move to @c row and @c column
+    CURSOR_KEY_CONTROL, ///< @c value is 1 for application, 0 for terminal
+    CURSOR_BLINKING, ///< @c value is 1 to start, 0 to stop blinking
+    CURSOR_SHOW, ///< @c value is 1 to show, 0 to hide
+    CURSOR_SAVE,
+    CURSOR_RESTORE,
+    CURSOR_MOVE, ///< move by @c row rows and @c column columns, like BS or CUU
+    CURSOR_ROW, ///< move to @c row in the same column
+    CURSOR_COLUMN, ///< move to @c column in the same row
+    CURSOR_TAB, ///< move to the next tab stop
+    CURSOR_BACKTAB, ///< move to the previous tab stop
+    CURSOR_TAB_SET, ///< set a tab stop in the cursor's column
+    CURSOR_TAB_CLEAR ///< @c value is 1 to clear all tab stops, 0 for the one in the cursor's column
+};
+
+enum erase_kind {
+    ERASE_IN_PAGE,
+    ERASE_IN_LINE
+};
+
+enum erase_range {
+    ERASE_CUR_TO_END,
+    ERASE_BEGIN_TO_CUR,
+    ERASE_ALL
+};
+
+enum color_kind {
+    COLOR_RESET,
+    COLOR_FOREGROUND, ///< @c value is the color, @c intensity an enum color_intensity
+    COLOR_BACKGROUND ///< @c value is the color, @c intensity an enum color_intensity
+};
+
+enum color_intensity {
+    COLOR_NORMAL,
+    COLOR_FAINT,
+    COLOR_INTENSE
+};
+
+/// Insertion and deletion at the cursor, not part of the XML output
+enum edit_kind {
+    EDIT_INSERT_LINES,
+    EDIT_DELETE_LINES,
+    EDIT_INSERT_CHARACTERS,
+    EDIT_DELETE_CHARACTERS,
+    EDIT_ERASE_CHARACTERS,
+    EDIT_SCROLL_UP, ///< scroll the scroll region up, adding blank rows at its bottom
+    EDIT_SCROLL_DOWN, ///< scroll the scroll region down, adding blank rows at its top
+    EDIT_SCROLL_LEFT, ///< move the rows of the scroll region left, adding blank columns at their end
+    EDIT_SCROLL_RIGHT ///< move the rows of the scroll region right, adding blank columns at their start
+};
+
+enum special_kind {
+    SPECIAL_8BIT ///< "meta" key sets eighth bit
+};
+
+/**
+ * A single event. Which fields are meaningful depends on @c type.
+ * Colors are numbered like the last digit of ECMA-48 color
+ * codes: 0 (black) to 7 (white) and 9 (default).
+ */
+struct event {
+    enum event_type type;
+    int kind; ///< variant of the event, see the enums above
+    int value;
+    int intensity;
+    int row, column;
+    const char *text; ///< not null-terminated, valid only during the callback
+    size_t length; ///< number of bytes in @c text
+    int continued; ///< EVENT_TEXT only: continues text of a previous event
+    long long delay; ///< EVENT_TIMESTEP only: delay in microseconds
+};
+
+/**
+ * Receiver of events, like the XML or the binary output.
+ */
+struct event_sink {
+    void (*event)(void *context, const struct event *event);
+    void *context; ///< passed to @c event, e.g. the output to write to
+};
+
+/**
+ * Pass @p event on to @p sink.
+ */
+static inline void event_emit(const struct event_sink *sink, const struct event *event)
+{
+    sink->event(sink->context, event);
+}
+
+/**
+ * Pass the start of a timestep with @p delay microseconds on to @p sink
+ */
+static inline void event_emit_timestep(const struct event_sink *sink, long long delay)
+{
+    struct event event = { .type = EVENT_TIMESTEP, .delay = delay };
+    event_emit(sink, &event);
+}
+
+/**
+ * Pass the end of a timestep on to @p sink
+ */
+static inline void event_emit_timestep_end(const struct event_sink *sink)
+{
+    struct event event = { .type = EVENT_TIMESTEP_END };
+    event_emit(sink, &event);
+}
+
+/**
+ * Name of a color as used in the XML output, like "red"
+ * or "default", or "unknown" for invalid colors.
+ */
+const char *event_color_name(int color);
+
+/**
+ * Name of a color intensity as used in the XML output,
+ * like "normal" or "intense".
+ */
+const char *event_intensity_name(int intensity);
+
+#endif // SCRIPTINTERPRETER_EVENTS_H
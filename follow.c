@@ -0,0 +1,205 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "follow.h"
+
+/**
+ * Start watching both files for modifications.
+ * Returns 0 on success, also if falling back to polling.
+ */
+int follow_open(struct follow *follow, const char *timefilename, const char *typescriptfilename, int poll_interval)
+{
+    follow->inotify_fd = -1;
+    follow->timing_wd = follow->typescript_wd = -1;
+    follow->poll_interval = poll_interval > 0 ? poll_interval : 1;
+    follow->writer_closed = 0;
+    follow->timefilename = timefilename;
+    follow->typescriptfilename = typescriptfilename;
+    follow->size = -1;
+    follow->unchanged_since = 0;
+
+#ifdef __linux__
+    follow->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (follow->inotify_fd >= 0) {
+        follow->timing_wd = inotify_add_watch(follow->inotify_fd, timefilename, IN_MODIFY | IN_CLOSE_WRITE);
+        follow->typescript_wd = inotify_add_watch(follow->inotify_fd, typescriptfilename, IN_MODIFY | IN_CLOSE_WRITE);
+        if (follow->timing_wd < 0 || follow->typescript_wd < 0) {
+            /// Cannot watch files (e.g. on some network file systems), poll instead
+            close(follow->inotify_fd);
+            follow->inotify_fd = -1;
+        }
+    }
+#else
+    (void)timefilename;
+    (void)typescriptfilename;
+#endif
+
+    return 0;
+}
+
+/**
+ * Block until one of the files was modified or closed,
+ * or until @p timeout milliseconds have passed.
+ * A negative timeout waits without limit.
+ */
+void follow_wait(struct follow *follow, int timeout)
+{
+    if (follow->inotify_fd < 0) {
+        /// Polling fallback: just sleep for a while
+        poll(NULL, 0, timeout < 0 || timeout > follow->poll_interval ? follow->poll_interval : timeout);
+        return;
+    }
+
+#ifdef __linux__
+    struct pollfd pfd = { follow->inotify_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout) <= 0)
+        return;
+
+    /// Drain all pending events, only closing the timing file is of interest
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(follow->inotify_fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->wd == follow->timing_wd && (event->mask & IN_CLOSE_WRITE))
+                follow->writer_closed = 1;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+#endif
+}
+
+/**
+ * Whether the open file described by @p fdinfo, a file in
+ * /proc/PID/fdinfo, may be written to
+ */
+static int opened_for_writing(const char *fdinfo)
+{
+    FILE *file = fopen(fdinfo, "r");
+    if (file == NULL)
+        return 0; ///< closed in the meantime
+    char line[128];
+    int writing = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+        if (strncmp(line, "flags:", 6) == 0) {
+            writing = (strtol(line + 6, NULL, 8) & O_ACCMODE) != O_RDONLY;
+            break;
+        }
+    fclose(file);
+    return writing;
+}
+
+/**
+ * Whether any process has the file @p ino on device @p dev open
+ * for writing. Returns 1 if that cannot be found out.
+ */
+static int has_writer(dev_t dev, ino_t ino)
+{
+#ifdef __linux__
+    DIR *processes = opendir("/proc");
+    if (processes == NULL)
+        return 1;
+    int found = 0;
+    struct dirent *process;
+    while (!found && (process = readdir(processes)) != NULL) {
+        if (process->d_name[0] < '0' || process->d_name[0] > '9')
+            continue;
+        char path[600];
+        snprintf(path, sizeof(path), "/proc/%s/fd", process->d_name);
+        /// Processes of other users cannot be looked into,
+        /// 'script' runs as the user reading its files
+        DIR *fds = opendir(path);
+        if (fds == NULL)
+            continue;
+        struct dirent *fd;
+        while (!found && (fd = readdir(fds)) != NULL) {
+            struct stat st;
+            snprintf(path, sizeof(path), "/proc/%s/fd/%s", process->d_name, fd->d_name);
+            if (fd->d_name[0] == '.' || stat(path, &st) != 0 || st.st_dev != dev || st.st_ino != ino)
+                continue;
+            snprintf(path, sizeof(path), "/proc/%s/fdinfo/%s", process->d_name, fd->d_name);
+            found = opened_for_writing(path);
+        }
+        closedir(fds);
+    }
+    closedir(processes);
+    return found;
+#else
+    (void)dev;
+    (void)ino;
+    return 1;
+#endif
+}
+
+/**
+ * Whether the writer seems to be gone without closing the timing
+ * file while it was watched, e.g. because the recording was already
+ * complete when following it started: neither file has grown for
+ * FOLLOW_IDLE_INTERVALS poll intervals and no process has the timing
+ * file open for writing. The latter is only known on Linux, elsewhere
+ * a writer is assumed.
+ */
+int follow_abandoned(struct follow *follow)
+{
+    struct stat timing, typescript;
+    if (stat(follow->timefilename, &timing) != 0 || stat(follow->typescriptfilename, &typescript) != 0)
+        return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    long now = (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    if (timing.st_size + typescript.st_size != follow->size) {
+        follow->size = timing.st_size + typescript.st_size;
+        follow->unchanged_since = now;
+        return 0;
+    }
+    if (now - follow->unchanged_since < (long)FOLLOW_IDLE_INTERVALS * follow->poll_interval)
+        return 0;
+    /// Going through all processes is not cheap, do it once per idle period
+    follow->unchanged_since = now;
+    return !has_writer(timing.st_dev, timing.st_ino);
+}
+
+/**
+ * Stop watching the files.
+ */
+void follow_close(struct follow *follow)
+{
+    if (follow->inotify_fd >= 0)
+        close(follow->inotify_fd);
+    follow->inotify_fd = -1;
+}
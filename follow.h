@@ -0,0 +1,73 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_FOLLOW_H
+#define SCRIPTINTERPRETER_FOLLOW_H
+
+#include <sys/types.h>
+
+/// Poll intervals without growth after which to look for a writer
+#define FOLLOW_IDLE_INTERVALS 20
+
+/**
+ * Waiting for a timing and a typescript file to grow while
+ * 'script' is still writing them. Uses inotify where available,
+ * otherwise falls back to polling in fixed intervals.
+ */
+struct follow {
+    int inotify_fd; ///< -1 if polling instead of using inotify
+    int timing_wd, typescript_wd; ///< inotify watch descriptors
+    int poll_interval; ///< milliseconds between polls without inotify
+    int writer_closed; ///< the writer has closed the timing file
+    const char *timefilename, *typescriptfilename;
+    off_t size; ///< size of both files together when last checked
+    long unchanged_since; ///< monotonic time in milliseconds since @c size is the same
+};
+
+/**
+ * Start watching both files for modifications.
+ * Returns 0 on success, also if falling back to polling.
+ */
+int follow_open(struct follow *follow, const char *timefilename, const char *typescriptfilename, int poll_interval);
+
+/**
+ * Block until one of the files was modified or closed,
+ * or until @p timeout milliseconds have passed.
+ * A negative timeout waits without limit.
+ */
+void follow_wait(struct follow *follow, int timeout);
+
+/**
+ * Whether the writer seems to be gone without closing the timing
+ * file while it was watched, e.g. because the recording was already
+ * complete when following it started: neither file has grown for
+ * FOLLOW_IDLE_INTERVALS poll intervals and no process has the timing
+ * file open for writing. The latter is only known on Linux, elsewhere
+ * a writer is assumed.
+ */
+int follow_abandoned(struct follow *follow);
+
+/**
+ * Stop watching the files.
+ */
+void follow_close(struct follow *follow);
+
+#endif // SCRIPTINTERPRETER_FOLLOW_H
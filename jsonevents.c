@@ -0,0 +1,303 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#include <string.h>
+
+#include "jsonevents.h"
+#include "timingfile.h"
+
+/**
+ * Start writing events to @p output, with recording times
+ * counted from @p time microseconds on.
+ */
+void jsonevents_open(struct jsonevents *json, struct xmloutput *output, long long time)
+{
+    json->output = output;
+    json->time = time;
+    json->time_length = timing_format_delay(json->time_string, time);
+}
+
+/**
+ * Write a constant string of known length, like a fragment
+ * of a line that never changes.
+ */
+#define WRITE_FRAGMENT(output, fragment) xmloutput_write((output), (fragment), sizeof(fragment) - 1)
+
+/**
+ * Start a line with the recording time and the event type,
+ * given as a fragment like ",\"type\":\"text\"".
+ */
+static void begin_line(struct jsonevents *json, const char *type, size_t type_length)
+{
+    WRITE_FRAGMENT(json->output, "{\"time\":");
+    xmloutput_write(json->output, json->time_string, json->time_length);
+    xmloutput_write(json->output, type, type_length);
+}
+
+/**
+ * Write @p value in decimal, also if it is negative.
+ */
+static void write_int(struct xmloutput *output, int value)
+{
+    char digits[12];
+    size_t n = sizeof(digits);
+    unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do {
+        digits[--n] = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    if (value < 0)
+        digits[--n] = '-';
+    xmloutput_write(output, digits + n, sizeof(digits) - n);
+}
+
+/**
+ * Write @p len bytes as the contents of a JSON string, escaping
+ * quotes, backslashes and control characters. Runs of bytes not
+ * needing escaping are copied in one go, bytes from 0x80 on are
+ * passed through.
+ */
+static void write_escaped(struct xmloutput *output, const char *data, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    while (len > 0) {
+        size_t clean = 0;
+        while (clean < len && (unsigned char)data[clean] >= 0x20 && data[clean] != '"' && data[clean] != '\\')
+            ++clean;
+        xmloutput_write(output, data, clean);
+        if (clean == len)
+            break;
+
+        unsigned char c = (unsigned char)data[clean];
+        switch (c) {
+        case '"':
+            WRITE_FRAGMENT(output, "\\\"");
+            break;
+        case '\\':
+            WRITE_FRAGMENT(output, "\\\\");
+            break;
+        case '\n':
+            WRITE_FRAGMENT(output, "\\n");
+            break;
+        case '\r':
+            WRITE_FRAGMENT(output, "\\r");
+            break;
+        case '\t':
+            WRITE_FRAGMENT(output, "\\t");
+            break;
+        default: {
+            char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+            xmloutput_write(output, escaped, sizeof(escaped));
+            break;
+        }
+        }
+        data += clean + 1;
+        len -= clean + 1;
+    }
+}
+
+/**
+ * Write the cursor event @p event, or nothing for an unknown kind.
+ */
+static void write_cursor(struct jsonevents *json, const struct event *event)
+{
+    struct xmloutput *output = json->output;
+    static const char type[] = ",\"type\":\"cursor\",\"action\":";
+    begin_line(json, type, sizeof(type) - 1);
+    switch (event->kind) {
+    case CURSOR_POSITION:
+        WRITE_FRAGMENT(output, "\"position\",\"row\":");
+        write_int(output, event->row);
+        WRITE_FRAGMENT(output, ",\"column\":");
+        write_int(output, event->column);
+        break;
+    case CURSOR_KEY_CONTROL:
+        if (event->value)
+            WRITE_FRAGMENT(output, "\"key-control\",\"value\":\"application\"");
+        else
+            WRITE_FRAGMENT(output, "\"key-control\",\"value\":\"terminal\"");
+        break;
+    case CURSOR_BLINKING:
+        if (event->value)
+            WRITE_FRAGMENT(output, "\"blinking\",\"value\":true");
+        else
+            WRITE_FRAGMENT(output, "\"blinking\",\"value\":false");
+        break;
+    case CURSOR_SHOW:
+        if (event->value)
+            WRITE_FRAGMENT(output, "\"show\",\"value\":true");
+        else
+            WRITE_FRAGMENT(output, "\"show\",\"value\":false");
+        break;
+    case CURSOR_SAVE:
+        WRITE_FRAGMENT(output, "\"save\"");
+        break;
+    case CURSOR_RESTORE:
+        WRITE_FRAGMENT(output, "\"restore\"");
+        break;
+    case CURSOR_MOVE:
+        WRITE_FRAGMENT(output, "\"move\",\"rows\":");
+        write_int(output, event->row);
+        WRITE_FRAGMENT(output, ",\"columns\":");
+        write_int(output, event->column);
+        break;
+    case CURSOR_ROW:
+        WRITE_FRAGMENT(output, "\"row\",\"row\":");
+        write_int(output, event->row);
+        break;
+    case CURSOR_COLUMN:
+        WRITE_FRAGMENT(output, "\"column\",\"column\":");
+        write_int(output, event->column);
+        break;
+    case CURSOR_BACKTAB:
+        WRITE_FRAGMENT(output, "\"backtab\"");
+        break;
+    case CURSOR_TAB_SET:
+        WRITE_FRAGMENT(output, "\"tab-set\"");
+        break;
+    case CURSOR_TAB_CLEAR:
+        if (event->value)
+            WRITE_FRAGMENT(output, "\"tab-clear\",\"all\":true");
+        else
+            WRITE_FRAGMENT(output, "\"tab-clear\",\"all\":false");
+        break;
+    default:
+        WRITE_FRAGMENT(output, "\"tab\"");
+        break;
+    }
+    WRITE_FRAGMENT(output, "}\n");
+}
+
+/**
+ * Event sink callback writing @p event as a line of JSON to the
+ * struct jsonevents passed as @p context.
+ */
+void jsonevents_write(void *context, const struct event *event)
+{
+    struct jsonevents *json = (struct jsonevents *)context;
+    struct xmloutput *output = json->output;
+
+    switch (event->type) {
+    case EVENT_TIMESTEP: {
+        json->time += event->delay;
+        json->time_length = timing_format_delay(json->time_string, json->time);
+        static const char type[] = ",\"type\":\"timestep\",\"delay\":";
+        char delay[24];
+        begin_line(json, type, sizeof(type) - 1);
+        xmloutput_write(output, delay, timing_format_delay(delay, event->delay));
+        WRITE_FRAGMENT(output, "}\n");
+        break;
+    }
+    case EVENT_TIMESTEP_END:
+        break; ///< every line carries its time, no need to close anything
+    case EVENT_TEXT:
+        if (!event->continued) {
+            static const char type[] = ",\"type\":\"text\",\"text\":\"";
+            begin_line(json, type, sizeof(type) - 1);
+        }
+        write_escaped(output, event->text, event->length);
+        break;
+    case EVENT_TEXT_END:
+        WRITE_FRAGMENT(output, "\"}\n");
+        break;
+    case EVENT_NEWLINE: {
+        static const char *const lines[3] = {
+            ",\"type\":\"newline\",\"kind\":\"crlf\"}\n", ",\"type\":\"newline\",\"kind\":\"cr\"}\n", ",\"type\":\"newline\",\"kind\":\"lf\"}\n"
+        };
+        const char *line = lines[event->kind == NEWLINE_CR ? 1 : (event->kind == NEWLINE_LF ? 2 : 0)];
+        begin_line(json, line, strlen(line));
+        break;
+    }
+    case EVENT_CURSOR:
+        write_cursor(json, event);
+        break;
+    case EVENT_ERASE: {
+        static const char *const lines[2][3] = {
+            { ",\"type\":\"erase\",\"scope\":\"in_line\",\"range\":\"cur_to_end\"}\n", ",\"type\":\"erase\",\"scope\":\"in_line\",\"range\":\"begin_to_cur\"}\n", ",\"type\":\"erase\",\"scope\":\"in_line\",\"range\":\"all\"}\n" },
+            { ",\"type\":\"erase\",\"scope\":\"in_page\",\"range\":\"cur_to_end\"}\n", ",\"type\":\"erase\",\"scope\":\"in_page\",\"range\":\"begin_to_cur\"}\n", ",\"type\":\"erase\",\"scope\":\"in_page\",\"range\":\"all\"}\n" }
+        };
+        const char *line = lines[event->kind == ERASE_IN_PAGE ? 1 : 0][event->value == ERASE_CUR_TO_END ? 0 : (event->value == ERASE_BEGIN_TO_CUR ? 1 : 2)];
+        begin_line(json, line, strlen(line));
+        break;
+    }
+    case EVENT_COLOR:
+        if (event->kind == COLOR_RESET) {
+            static const char line[] = ",\"type\":\"color\",\"operation\":\"reset\"}\n";
+            begin_line(json, line, sizeof(line) - 1);
+        } else {
+            static const char foreground[] = ",\"type\":\"color\",\"foreground\":\"";
+            static const char background[] = ",\"type\":\"color\",\"background\":\"";
+            if (event->kind == COLOR_FOREGROUND)
+                begin_line(json, foreground, sizeof(foreground) - 1);
+            else
+                begin_line(json, background, sizeof(background) - 1);
+            xmloutput_puts(output, event_intensity_name(event->intensity));
+            WRITE_FRAGMENT(output, "-");
+            xmloutput_puts(output, event_color_name(event->value));
+            WRITE_FRAGMENT(output, "\"}\n");
+        }
+        break;
+    case EVENT_SCREEN: {
+        static const char type[] = ",\"type\":\"screen\",\"switchto\":";
+        begin_line(json, type, sizeof(type) - 1);
+        write_int(output, event->value);
+        WRITE_FRAGMENT(output, "}\n");
+        break;
+    }
+    case EVENT_SPECIAL:
+        if (event->kind == SPECIAL_8BIT) {
+            static const char line[] = ",\"type\":\"special\",\"state\":\"8bit\"}\n";
+            begin_line(json, line, sizeof(line) - 1);
+        }
+        break;
+    case EVENT_OSC: {
+        static const char type[] = ",\"type\":\"osc\",\"windowtitle\":\"";
+        begin_line(json, type, sizeof(type) - 1);
+        write_escaped(output, event->text, event->length);
+        WRITE_FRAGMENT(output, "\"}\n");
+        break;
+    }
+    case EVENT_EDIT: {
+        static const char *const types[9] = {
+            ",\"type\":\"edit\",\"kind\":\"insert_lines\",\"count\":", ",\"type\":\"edit\",\"kind\":\"delete_lines\",\"count\":",
+            ",\"type\":\"edit\",\"kind\":\"insert_characters\",\"count\":", ",\"type\":\"edit\",\"kind\":\"delete_characters\",\"count\":",
+            ",\"type\":\"edit\",\"kind\":\"erase_characters\",\"count\":", ",\"type\":\"edit\",\"kind\":\"scroll_up\",\"count\":",
+            ",\"type\":\"edit\",\"kind\":\"scroll_down\",\"count\":", ",\"type\":\"edit\",\"kind\":\"scroll_left\",\"count\":",
+            ",\"type\":\"edit\",\"kind\":\"scroll_right\",\"count\":"
+        };
+        if (event->kind < 0 || event->kind > EDIT_SCROLL_RIGHT)
+            break;
+        begin_line(json, types[event->kind], strlen(types[event->kind]));
+        write_int(output, event->value);
+        WRITE_FRAGMENT(output, "}\n");
+        break;
+    }
+    case EVENT_SCROLL_REGION: {
+        static const char type[] = ",\"type\":\"scroll_region\",\"top\":";
+        begin_line(json, type, sizeof(type) - 1);
+        write_int(output, event->row);
+        WRITE_FRAGMENT(output, ",\"bottom\":");
+        write_int(output, event->value);
+        WRITE_FRAGMENT(output, "}\n");
+        break;
+    }
+    }
+}
@@ -0,0 +1,56 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_JSONEVENTS_H
+#define SCRIPTINTERPRETER_JSONEVENTS_H
+
+#include <stddef.h>
+
+#include "events.h"
+#include "xmloutput.h"
+
+/**
+ * Writer of line-delimited JSON (NDJSON): one self-contained JSON
+ * object per line and event, each with the recording time of its
+ * timestep, so that any range of whole lines can be processed on
+ * its own. Texts and titles are written like in the typescript,
+ * escaped as JSON strings.
+ */
+struct jsonevents {
+    struct xmloutput *output; ///< buffered output file
+    long long time; ///< recording time in microseconds of the current timestep
+    char time_string[24]; ///< @c time in seconds, as written on every line
+    size_t time_length;
+};
+
+/**
+ * Start writing events to @p output, with recording times
+ * counted from @p time microseconds on.
+ */
+void jsonevents_open(struct jsonevents *json, struct xmloutput *output, long long time);
+
+/**
+ * Event sink callback writing @p event as a line of JSON to the
+ * struct jsonevents passed as @p context.
+ */
+void jsonevents_write(void *context, const struct event *event);
+
+#endif // SCRIPTINTERPRETER_JSONEVENTS_H
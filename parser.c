@@ -0,0 +1,1162 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARSER_X86 1
+#include <immintrin.h>
+#endif
+
+#include "parser.h"
+#include "stats.h"
+
+/// Most parameters of a control sequence that are kept
+#define CSI_MAX_PARAMETERS 32
+/// Parameter values are not counted beyond this
+#define CSI_MAX_VALUE 100000
+/// Most tab stops a single CHT or CBT moves the cursor
+#define CSI_MAX_TABULATIONS 1000
+/// Most characters a single REP passes on
+#define CSI_MAX_REPETITIONS 10000
+
+/// Classes of bytes outside of escape sequences and strings
+enum byte_class {
+    BYTE_TEXT = 0, ///< printable ASCII or part of UTF-8
+    BYTE_LF,
+    BYTE_CR,
+    BYTE_ESC,
+    BYTE_BS,
+    BYTE_TAB,
+    BYTE_CONTROL ///< other control characters, ignored
+};
+
+/// Class of every byte, all from 0x20 on are text
+static const unsigned char byte_classes[256] = {
+    BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL,
+    BYTE_BS, BYTE_TAB, BYTE_LF, BYTE_CONTROL, BYTE_CONTROL, BYTE_CR, BYTE_CONTROL, BYTE_CONTROL,
+    BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL,
+    BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_ESC, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL, BYTE_CONTROL
+};
+
+/**
+ * Pass an event with at most a kind and a value on to the parser's sink
+ */
+static void emit(struct parser_state *state, enum event_type type, int kind, int value)
+{
+    struct event event = { .type = type, .kind = kind, .value = value };
+    event_emit(&state->sink, &event);
+}
+
+static void emit_cursor(struct parser_state *state, enum cursor_kind kind, int row, int column)
+{
+    struct event event = { .type = EVENT_CURSOR, .kind = kind, .row = row, .column = column };
+    event_emit(&state->sink, &event);
+}
+
+/**
+ * Pass on @p len bytes of text, continuing an open text, and
+ * remember its last character for REP.
+ */
+static void emit_text(struct parser_state *state, const char *text, size_t len)
+{
+    struct event event = { .type = EVENT_TEXT, .text = text, .length = len, .continued = state->insidetextsequence };
+    event_emit(&state->sink, &event);
+    state->insidetextsequence = 1;
+
+    /// Texts consist of whole UTF-8 characters, the last one starts
+    /// at most three continuation bytes before the end
+    size_t start = len - 1;
+    while (start > 0 && len - start < sizeof(state->last_character) && ((unsigned char)text[start] & 0xc0) == 0x80)
+        --start;
+    memcpy(state->last_character, text + start, len - start);
+    state->last_character_len = len - start;
+}
+
+/**
+ * Numeric parameters of a control sequence, parsed once before
+ * its control function is looked up
+ */
+struct csi_parameters {
+    int values[CSI_MAX_PARAMETERS]; ///< empty parameters are 0
+    int count; ///< number of parameters, 0 if there are none at all
+    char private_marker; ///< leading byte 0x3c .. 0x3f like '?' for DEC modes, or 0
+    int invalid; ///< parameter string is not a list of numbers
+};
+
+/**
+ * Split the null-terminated Parameter Bytes of a control sequence
+ * into numbers, in one pass and without copying them. Both
+ * semicolons and colons separate parameters, parameters beyond
+ * CSI_MAX_PARAMETERS are dropped.
+ */
+static void parse_parameters(const char *parameter_bytes, struct csi_parameters *parameters)
+{
+    const char *p = parameter_bytes;
+    parameters->count = 0;
+    parameters->invalid = 0;
+    parameters->private_marker = 0;
+    if (*p >= 0x3c /* 03/12 */ && *p <= 0x3f /* 03/15 */)
+        parameters->private_marker = *p++;
+    if (*p == 0)
+        return;
+
+    int value = 0;
+    for (;; ++p) {
+        if (*p >= '0' && *p <= '9') {
+            if (value < CSI_MAX_VALUE)
+                value = value * 10 + (*p - '0');
+        } else if (*p == ';' || *p == ':' || *p == 0) {
+            if (parameters->count < CSI_MAX_PARAMETERS)
+                parameters->values[parameters->count++] = value;
+            if (*p == 0)
+                break;
+            value = 0;
+        } else
+            parameters->invalid = 1;
+    }
+}
+
+/**
+ * First parameter of a control sequence like CUU, where both a
+ * missing parameter and 0 stand for 1. Returns 0 for private
+ * or invalid parameters, which are ignored.
+ */
+static int count_parameter(const struct csi_parameters *parameters)
+{
+    if (parameters->private_marker != 0 || parameters->invalid)
+        return 0;
+    return parameters->count == 0 || parameters->values[0] == 0 ? 1 : parameters->values[0];
+}
+
+/**
+ * Count the codes of an SGR control sequence for --stats, an
+ * empty parameter counting as 0 like terminals interpret it.
+ */
+static void count_sgr_parameters(struct stats *stats, const struct csi_parameters *parameters)
+{
+    if (parameters->count == 0)
+        ++stats->sgr_count[0];
+    for (int i = 0; i < parameters->count; ++i)
+        if (parameters->values[i] < 128)
+            ++stats->sgr_count[parameters->values[i]];
+}
+
+/**
+ * CUU, CUD, CUF, CUB -- Cursor Up, Down, Right, Left (see 8.3.22, 8.3.19,
+ * 8.3.20 and 8.3.18 in ECMA-48 1991), CNL, CPL -- Cursor Next Line,
+ * Preceding Line (see 8.3.12 and 8.3.13 in ECMA-48 1991), HPR, VPR --
+ * Character Position Forward, Line Position Forward (see 8.3.59 and
+ * 8.3.160 in ECMA-48 1991)
+ */
+static void csi_cursor_move(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    int count = count_parameter(parameters);
+    if (count == 0)
+        return;
+    if (state->debug) fprintf(stderr, "Control Sequence: Cursor movement '%c' (count=%d)\n", final_byte, count);
+    if (final_byte == 0x41 /* A */)
+        emit_cursor(state, CURSOR_MOVE, -count, 0);
+    else if (final_byte == 0x42 /* B */ || final_byte == 0x65 /* e */)
+        emit_cursor(state, CURSOR_MOVE, count, 0);
+    else if (final_byte == 0x43 /* C */ || final_byte == 0x61 /* a */)
+        emit_cursor(state, CURSOR_MOVE, 0, count);
+    else if (final_byte == 0x44 /* D */)
+        emit_cursor(state, CURSOR_MOVE, 0, -count);
+    else {
+        emit_cursor(state, CURSOR_MOVE, final_byte == 0x45 /* E */ ? count : -count, 0);
+        emit_cursor(state, CURSOR_COLUMN, 0, 1);
+    }
+}
+
+/**
+ * CHA -- Cursor Character Absolute, HPA -- Character Position Absolute,
+ * VPA -- Line Position Absolute (see 8.3.9, 8.3.57 and 8.3.158 in ECMA-48 1991)
+ */
+static void csi_cursor_absolute(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    int position = count_parameter(parameters);
+    if (position == 0)
+        return;
+    if (state->debug) fprintf(stderr, "Control Sequence: Cursor to %s %d\n", final_byte == 0x64 ? "row" : "column", position);
+    if (final_byte == 0x64 /* d */)
+        emit_cursor(state, CURSOR_ROW, position, 0);
+    else
+        emit_cursor(state, CURSOR_COLUMN, 0, position);
+}
+
+/**
+ * CUP -- Cursor Position, HVP -- Character and Line Position
+ * (see 8.3.21 and 8.3.63 in ECMA-48 1991)
+ */
+static void csi_cursor_position(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    (void)final_byte;
+    if (parameters->private_marker != 0 || parameters->invalid)
+        return;
+    int row = parameters->count > 0 && parameters->values[0] > 0 ? parameters->values[0] : 1;
+    int column = parameters->count > 1 && parameters->values[1] > 0 ? parameters->values[1] : 1;
+    if (state->debug) fprintf(stderr, "Moving cursor to position row=%d, column=%d\n", row, column);
+    emit_cursor(state, CURSOR_POSITION, row, column);
+}
+
+/**
+ * CHT -- Cursor Forward Tabulation, CBT -- Cursor Backward Tabulation
+ * (see 8.3.10 and 8.3.7 in ECMA-48 1991)
+ */
+static void csi_tabulation(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    int count = count_parameter(parameters);
+    if (state->debug) fprintf(stderr, "Control Sequence: Cursor %s Tabulation (count=%d)\n", final_byte == 0x5a ? "Backward" : "Forward", count);
+    for (int i = 0; i < count && i < CSI_MAX_TABULATIONS; ++i)
+        emit_cursor(state, final_byte == 0x5a /* Z */ ? CURSOR_BACKTAB : CURSOR_TAB, 0, 0);
+}
+
+/**
+ * TBC -- Tabulation Clear (see 8.3.155 in ECMA-48 1991), for the
+ * tab stop in the cursor's column or all of them
+ */
+static void csi_tabulation_clear(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    (void)final_byte;
+    if (parameters->private_marker != 0 || parameters->invalid)
+        return;
+    int param = parameters->count > 0 ? parameters->values[0] : 0;
+    if (state->debug) fprintf(stderr, "Control Sequence: Tabulation Clear (param=%d)\n", param);
+    if (param == 0 || param == 2 || param == 3 || param == 5)
+        emit(state, EVENT_CURSOR, CURSOR_TAB_CLEAR, param != 0);
+}
+
+/**
+ * REP -- Repeat (see 8.3.103 in ECMA-48 1991), the last graphic
+ * character is passed on again as text
+ */
+static void csi_repeat(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    (void)final_byte;
+    int count = count_parameter(parameters);
+    if (count == 0)
+        return;
+    if (state->debug) fprintf(stderr, "Control Sequence: Repeat (count=%d)\n", count);
+    size_t character_len = state->last_character_len;
+    if (character_len == 0) {
+        state->missed_repeat = 1;
+        return;
+    }
+    if (count > CSI_MAX_REPETITIONS)
+        count = CSI_MAX_REPETITIONS;
+
+    /// Pass on as many repetitions at once as fit into the buffer
+    char text[256];
+    int per_text = (int)(sizeof(text) / character_len);
+    for (int i = 0; i < per_text && i < count; ++i)
+        memcpy(text + (size_t)i * character_len, state->last_character, character_len);
+    for (; count > 0; count -= per_text)
+        emit_text(state, text, (size_t)(count < per_text ? count : per_text) * character_len);
+}
+
+/**
+ * ICH -- Insert Character, IL -- Insert Line, DL -- Delete Line,
+ * DCH -- Delete Character, ECH -- Erase Character, SU -- Scroll Up,
+ * SD -- Scroll Down (see 8.3.64, 8.3.67, 8.3.32, 8.3.26, 8.3.38,
+ * 8.3.147 and 8.3.113 in ECMA-48 1991)
+ */
+static void csi_edit(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    int count = count_parameter(parameters);
+    if (count == 0)
+        return;
+    if (state->debug) fprintf(stderr, "Control Sequence: Editing '%c' (count=%d)\n", final_byte, count);
+    int kind;
+    switch (final_byte) {
+    case 0x40: /* @ */
+        kind = EDIT_INSERT_CHARACTERS;
+        break;
+    case 0x4c: /* L */
+        kind = EDIT_INSERT_LINES;
+        break;
+    case 0x4d: /* M */
+        kind = EDIT_DELETE_LINES;
+        break;
+    case 0x50: /* P */
+        kind = EDIT_DELETE_CHARACTERS;
+        break;
+    case 0x53: /* S */
+        kind = EDIT_SCROLL_UP;
+        break;
+    case 0x54: /* T */
+        kind = EDIT_SCROLL_DOWN;
+        break;
+    default:
+        kind = EDIT_ERASE_CHARACTERS;
+        break;
+    }
+    emit(state, EVENT_EDIT, kind, count);
+}
+
+/**
+ * SL -- Scroll Left, SR -- Scroll Right (see 8.3.121 and 8.3.135
+ * in ECMA-48 1991)
+ */
+static void csi_scroll_horizontal(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    int count = count_parameter(parameters);
+    if (count == 0)
+        return;
+    if (state->debug) fprintf(stderr, "Control Sequence: Scroll %s (count=%d)\n", final_byte == 0x40 ? "Left" : "Right", count);
+    emit(state, EVENT_EDIT, final_byte == 0x40 /* @ */ ? EDIT_SCROLL_LEFT : EDIT_SCROLL_RIGHT, count);
+}
+
+/**
+ * ED -- Erase in Page, EL -- Erase in Line (see 8.3.39 and 8.3.41
+ * in ECMA-48 1991), also in their DEC selective variants
+ */
+static void csi_erase(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    if (parameters->invalid)
+        return;
+    int param = parameters->count > 0 ? parameters->values[0] : 0;
+    if (state->debug) fprintf(stderr, "Control Sequence: Erase in %s (param=%d)\n", final_byte == 0x4a ? "Page" : "Line", param);
+    emit(state, EVENT_ERASE, final_byte == 0x4a /* J */ ? ERASE_IN_PAGE : ERASE_IN_LINE, param == 0 ? ERASE_CUR_TO_END : (param == 1 ? ERASE_BEGIN_TO_CUR : ERASE_ALL));
+}
+
+/**
+ * SM -- Set Mode, RM -- Reset Mode (see 8.3.125 and 8.3.106 in
+ * ECMA-48 1991), including DEC private modes
+ */
+static void csi_mode(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    int set = final_byte == 0x68 /* h */;
+    if (state->debug) fprintf(stderr, "Control Sequence: %s Mode (dec_mode=%d, parameters=%d)\n", set ? "Set" : "Reset", parameters->private_marker == 0x3f, parameters->count);
+    if (parameters->invalid)
+        return;
+
+    for (int i = 0; i < parameters->count; ++i) {
+        int mode = parameters->values[i];
+        if (mode == 1) {
+            if (state->debug) fprintf(stderr, "%s takes over control of cursor keys\n", set ? "Application" : "Terminal");
+            emit(state, EVENT_CURSOR, CURSOR_KEY_CONTROL, set);
+        } else if (mode == 12) {
+            if (state->debug) fprintf(stderr, "%s blinking cursor\n", set ? "Start" : "Stop");
+            emit(state, EVENT_CURSOR, CURSOR_BLINKING, set);
+        } else if (mode == 25) {
+            if (state->debug) fprintf(stderr, "%s cursor\n", set ? "Hide" : "Show");
+            emit(state, EVENT_CURSOR, CURSOR_SHOW, !set);
+        } else if (mode == 47 || mode == 1047 || mode == 1049) {
+            if (state->debug) fprintf(stderr, "Switching %s alternate screen\n", set ? "to" : "back from");
+            if (mode == 1049 && set)
+                emit(state, EVENT_CURSOR, CURSOR_SAVE, 0);
+            else if (mode == 1049)
+                emit(state, EVENT_CURSOR, CURSOR_RESTORE, 0);
+            emit(state, EVENT_SCREEN, 0, set);
+        } else if (mode == 1034 && set) {
+            if (state->debug) fprintf(stderr, "Interpret \"meta\" key, sets eighth bit\n");
+            emit(state, EVENT_SPECIAL, SPECIAL_8BIT, 0);
+        } else if (mode == 1048) {
+            emit(state, EVENT_CURSOR, set ? CURSOR_SAVE : CURSOR_RESTORE, 0);
+        } else if (state->debug)
+            fprintf(stderr, "Unsupported mode %d\n", mode);
+    }
+}
+
+/**
+ * Closest of the 16 colors the output can show to a color given
+ * by its red, green and blue components from 0 to 255: a component
+ * is part of the color if it is more than half of the strongest.
+ */
+static int nearest_color(int red, int green, int blue, uint8_t *bright)
+{
+    int max = red > green ? (red > blue ? red : blue) : (green > blue ? green : blue);
+    *bright = max >= 192;
+    if (max < 64) {
+        *bright = 0;
+        return 0;
+    }
+    int color = (red * 2 > max) | (green * 2 > max) << 1 | (blue * 2 > max) << 2;
+    if (color == 7 && max < 128) {
+        /// Dark gray
+        *bright = 1;
+        return 0;
+    }
+    return color;
+}
+
+/**
+ * Color of an extended SGR color (38 or 48) starting at
+ * parameter @p i, which is advanced over its arguments:
+ * 5;INDEX for the 256-color palette or 2;R;G;B for direct
+ * colors, both shown as the nearest of the 16 colors.
+ */
+static int extended_color(const struct csi_parameters *parameters, int *i, uint8_t *bright)
+{
+    /// Component values of the 6x6x6 color cube of the palette
+    static const int cube_levels[6] = {0, 95, 135, 175, 215, 255};
+    *bright = 0;
+    if (*i + 2 < parameters->count && parameters->values[*i + 1] == 5) {
+        int index = parameters->values[*i + 2];
+        *i += 2;
+        if (index < 16) {
+            *bright = index >= 8;
+            return index % 8;
+        } else if (index < 232) {
+            index -= 16;
+            return nearest_color(cube_levels[index / 36], cube_levels[index / 6 % 6], cube_levels[index % 6], bright);
+        } else if (index < 256) {
+            int level = 8 + 10 * (index - 232);
+            return nearest_color(level, level, level, bright);
+        }
+    } else if (*i + 4 < parameters->count && parameters->values[*i + 1] == 2) {
+        const int *rgb = parameters->values + *i + 2;
+        *i += 4;
+        return nearest_color(rgb[0] < 255 ? rgb[0] : 255, rgb[1] < 255 ? rgb[1] : 255, rgb[2] < 255 ? rgb[2] : 255, bright);
+    } else
+        *i = parameters->count - 1; ///< incomplete, nothing else can be told apart
+    return 9;
+}
+
+/**
+ * Colors shown with @p rendition, as passed on in color events
+ */
+static void shown_colors(const struct parser_rendition *rendition, struct event *foreground, struct event *background)
+{
+    int foreground_bright = rendition->inverted ? rendition->background_bright : rendition->foreground_bright;
+    int background_bright = rendition->inverted ? rendition->foreground_bright : rendition->background_bright;
+    *foreground = (struct event) { .type = EVENT_COLOR, .kind = COLOR_FOREGROUND, .value = rendition->inverted ? rendition->background : rendition->foreground };
+    foreground->intensity = foreground_bright ? COLOR_INTENSE : rendition->intensity;
+    *background = (struct event) { .type = EVENT_COLOR, .kind = COLOR_BACKGROUND, .value = rendition->inverted ? rendition->foreground : rendition->background };
+    background->intensity = background_bright ? COLOR_INTENSE : COLOR_NORMAL;
+}
+
+/**
+ * SGR -- Select Graphic Rendition (see 8.3.117 in ECMA-48 1991)
+ * Bold, faint and inverse apply until changed by a later sequence.
+ * Only the net change of the shown colors is passed on, nothing
+ * if they stay the same, a reset if both become the default.
+ */
+static void csi_graphic_rendition(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    (void)final_byte;
+    if (state->debug) fprintf(stderr, "Control Sequence: Detected color change (parameters=%d)\n", parameters->count);
+    if (state->stats != NULL)
+        count_sgr_parameters(state->stats, parameters);
+    if (parameters->private_marker != 0 || parameters->invalid)
+        return;
+
+    struct parser_rendition *rendition = &state->rendition;
+    struct event foreground_before, background_before;
+    shown_colors(rendition, &foreground_before, &background_before);
+
+    /// No parameter at all is the same as 0
+    for (int i = 0; i < (parameters->count > 0 ? parameters->count : 1); ++i) {
+        int code = parameters->count > 0 ? parameters->values[i] : 0;
+        uint8_t bright = 0;
+
+        /// Normalize non-standard aixterm high-intensity colors
+        if ((code >= 90 && code <= 97) || (code >= 100 && code <= 107)) {
+            bright = 1;
+            code -= 60;
+        }
+
+        if (code == 0) {
+            if (state->debug) fprintf(stderr, "Resetting colors\n");
+            parser_rendition_init(rendition);
+        } else if (code == 1) {
+            if (state->debug) fprintf(stderr, "Using intense colors\n");
+            rendition->intensity = COLOR_INTENSE;
+        } else if (code == 2) {
+            if (state->debug) fprintf(stderr, "Using faint colors\n");
+            rendition->intensity = COLOR_FAINT;
+        } else if (code == 22) {
+            if (state->debug) fprintf(stderr, "Using normal colors\n");
+            rendition->intensity = COLOR_NORMAL;
+        } else if (code == 7) {
+            if (state->debug) fprintf(stderr, "Using negative/inverted colors\n");
+            rendition->inverted = 1;
+        } else if (code == 27) {
+            if (state->debug) fprintf(stderr, "Using positive/non-inverted colors\n");
+            rendition->inverted = 0;
+        } else if ((code >= 30 && code <= 37) || code == 39) {
+            if (state->debug) fprintf(stderr, "Foreground using color \"%s\" (%i)\n", event_color_name(code % 10), code);
+            rendition->foreground = (uint8_t)(code % 10);
+            rendition->foreground_bright = bright;
+        } else if ((code >= 40 && code <= 47) || code == 49) {
+            if (state->debug) fprintf(stderr, "Background using color \"%s\" (%i)\n", event_color_name(code % 10), code);
+            rendition->background = (uint8_t)(code % 10);
+            rendition->background_bright = bright;
+        } else if (code == 38 || code == 48) {
+            int color = extended_color(parameters, &i, &bright);
+            if (state->debug) fprintf(stderr, "Extended %s color shown as \"%s\"%s\n", code == 38 ? "foreground" : "background", event_color_name(color), bright ? " (bright)" : "");
+            if (code == 38) {
+                rendition->foreground = (uint8_t)color;
+                rendition->foreground_bright = bright;
+            } else {
+                rendition->background = (uint8_t)color;
+                rendition->background_bright = bright;
+            }
+        } else if (state->debug)
+            fprintf(stderr, "Graphic rendition %d not (yet) supported\n", code);
+    }
+
+    struct event foreground, background;
+    shown_colors(rendition, &foreground, &background);
+    int foreground_changed = foreground.value != foreground_before.value || foreground.intensity != foreground_before.intensity;
+    int background_changed = background.value != background_before.value || background.intensity != background_before.intensity;
+    if (!foreground_changed && !background_changed)
+        return;
+    if (foreground.value == 9 && foreground.intensity == COLOR_NORMAL && background.value == 9 && background.intensity == COLOR_NORMAL) {
+        emit(state, EVENT_COLOR, COLOR_RESET, 0);
+        return;
+    }
+    if (foreground_changed)
+        event_emit(&state->sink, &foreground);
+    if (background_changed)
+        event_emit(&state->sink, &background);
+}
+
+/**
+ * DECSTBM -- Set Top and Bottom Margins, the region scrolled by
+ * line feeds, IL, DL, SU and SD; moves the cursor home
+ */
+static void csi_scroll_region(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    (void)final_byte;
+    if (parameters->private_marker != 0 || parameters->invalid)
+        return;
+    struct event event = { .type = EVENT_SCROLL_REGION };
+    event.row = parameters->count > 0 && parameters->values[0] > 0 ? parameters->values[0] : 1;
+    event.value = parameters->count > 1 ? parameters->values[1] : 0;
+    if (state->debug) fprintf(stderr, "Control Sequence: Scroll region rows %d to %d\n", event.row, event.value);
+    event_emit(&state->sink, &event);
+    emit_cursor(state, CURSOR_POSITION, 1, 1);
+}
+
+/**
+ * SCOSC, SCORC -- Save and Restore Cursor Position as in the
+ * SCO console and xterm, without parameters only
+ */
+static void csi_save_cursor(struct parser_state *state, unsigned char final_byte, const struct csi_parameters *parameters)
+{
+    if (parameters->count > 0 || parameters->private_marker != 0)
+        return;
+    if (state->debug) fprintf(stderr, "Control Sequence: %s cursor\n", final_byte == 0x73 ? "Save" : "Restore");
+    emit(state, EVENT_CURSOR, final_byte == 0x73 /* s */ ? CURSOR_SAVE : CURSOR_RESTORE, 0);
+}
+
+/**
+ * Entry of csi_functions for the control function with at most one
+ * Intermediate Byte @p intermediate (0 for none) and Final Byte @p final
+ */
+#define CSI_FUNCTION(intermediate, final) [(intermediate) == 0 ? 0 : (intermediate) - 0x1f][(final) - 0x40]
+
+/**
+ * Control functions by their Intermediate Byte, if any, and their
+ * Final Byte, NULL for those without any visible effect like
+ * DSR -- Device Status Report or DA -- Device Attributes
+ */
+static void (*const csi_functions[17][64])(struct parser_state *, unsigned char, const struct csi_parameters *) = {
+    CSI_FUNCTION(0, 0x40) = csi_edit, /* @ ICH */
+    CSI_FUNCTION(0, 0x41) = csi_cursor_move, /* A CUU */
+    CSI_FUNCTION(0, 0x42) = csi_cursor_move, /* B CUD */
+    CSI_FUNCTION(0, 0x43) = csi_cursor_move, /* C CUF */
+    CSI_FUNCTION(0, 0x44) = csi_cursor_move, /* D CUB */
+    CSI_FUNCTION(0, 0x45) = csi_cursor_move, /* E CNL */
+    CSI_FUNCTION(0, 0x46) = csi_cursor_move, /* F CPL */
+    CSI_FUNCTION(0, 0x47) = csi_cursor_absolute, /* G CHA */
+    CSI_FUNCTION(0, 0x48) = csi_cursor_position, /* H CUP */
+    CSI_FUNCTION(0, 0x49) = csi_tabulation, /* I CHT */
+    CSI_FUNCTION(0, 0x4a) = csi_erase, /* J ED */
+    CSI_FUNCTION(0, 0x4b) = csi_erase, /* K EL */
+    CSI_FUNCTION(0, 0x4c) = csi_edit, /* L IL */
+    CSI_FUNCTION(0, 0x4d) = csi_edit, /* M DL */
+    CSI_FUNCTION(0, 0x50) = csi_edit, /* P DCH */
+    CSI_FUNCTION(0, 0x53) = csi_edit, /* S SU */
+    CSI_FUNCTION(0, 0x54) = csi_edit, /* T SD */
+    CSI_FUNCTION(0, 0x58) = csi_edit, /* X ECH */
+    CSI_FUNCTION(0, 0x5a) = csi_tabulation, /* Z CBT */
+    CSI_FUNCTION(0, 0x60) = csi_cursor_absolute, /* ` HPA */
+    CSI_FUNCTION(0, 0x61) = csi_cursor_move, /* a HPR */
+    CSI_FUNCTION(0, 0x62) = csi_repeat, /* b REP */
+    CSI_FUNCTION(0, 0x64) = csi_cursor_absolute, /* d VPA */
+    CSI_FUNCTION(0, 0x65) = csi_cursor_move, /* e VPR */
+    CSI_FUNCTION(0, 0x66) = csi_cursor_position, /* f HVP */
+    CSI_FUNCTION(0, 0x67) = csi_tabulation_clear, /* g TBC */
+    CSI_FUNCTION(0, 0x68) = csi_mode, /* h SM */
+    CSI_FUNCTION(0, 0x6c) = csi_mode, /* l RM */
+    CSI_FUNCTION(0, 0x6d) = csi_graphic_rendition, /* m SGR */
+    CSI_FUNCTION(0, 0x72) = csi_scroll_region, /* r DECSTBM */
+    CSI_FUNCTION(0, 0x73) = csi_save_cursor, /* s SCOSC */
+    CSI_FUNCTION(0, 0x75) = csi_save_cursor, /* u SCORC */
+    CSI_FUNCTION(0x20, 0x40) = csi_scroll_horizontal, /* SP @ SL */
+    CSI_FUNCTION(0x20, 0x41) = csi_scroll_horizontal /* SP A SR */
+};
+
+/**
+ * Interpret a complete control sequence given by its Final Byte
+ * and its null-terminated Intermediate and Parameter Bytes and
+ * pass the resulting events on to the parser's sink. Sequences
+ * not understood are ignored. Returns 0.
+ */
+int process_controlsequence(struct parser_state *state, char final_byte, char *intermediate_bytes, char *parameter_bytes)
+{
+    unsigned char final = (unsigned char)final_byte, intermediate = (unsigned char)intermediate_bytes[0];
+    void (*function)(struct parser_state *, unsigned char, const struct csi_parameters *) = NULL;
+    /// Control functions have at most one Intermediate Byte
+    if (final >= 0x40 && final <= 0x7f && (intermediate == 0 || (intermediate >= 0x20 && intermediate <= 0x2f && intermediate_bytes[1] == 0)))
+        function = csi_functions[intermediate == 0 ? 0 : intermediate - 0x1f][final - 0x40];
+    if (function == NULL) {
+        if (state->debug) fprintf(stderr, "Don't know Final Byte 0x%02x for Control Sequence (parameter length=%zu, intermediate length=%zu)\n", final, strlen(parameter_bytes), strlen(intermediate_bytes));
+        return 0;
+    }
+
+    struct csi_parameters parameters;
+    parse_parameters(parameter_bytes, &parameters);
+    function(state, final, &parameters);
+    return 0;
+}
+
+/**
+ * If open, close current <text> environment
+ */
+void close_textsequence(struct parser_state *state)
+{
+    if (state->insidetextsequence == 1) {
+        emit(state, EVENT_TEXT_END, 0, 0);
+        state->insidetextsequence = 0;
+    }
+}
+
+/**
+ * Number of bytes at the start of @p data that are printable
+ * ASCII characters (0x20 to 0x7f).
+ */
+static size_t ascii_run(const char *data, size_t len)
+{
+    size_t i = 0;
+#ifdef PARSER_X86
+    /// Bytes from 0x80 on are negative as signed chars, so one signed
+    /// comparison finds both control characters and non-ASCII bytes
+    const __m128i space = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(chunk, space)) ^ 0xffff;
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+    while (i < len && (unsigned char)data[i] >= 0x20 && (unsigned char)data[i] < 0x80)
+        ++i;
+    return i;
+}
+
+/**
+ * Check the UTF-8 sequence starting at @p data with a byte from
+ * 0x80 on (see RFC 3629, section 4). Returns 1 if it is valid,
+ * with its length in @p consumed, -1 if it is valid so far but
+ * cut off at the end of @p data, and 0 if it is invalid, with the
+ * length of its invalid start in @p consumed (at least 1), which
+ * is replaced as a whole.
+ */
+static int utf8_check(const unsigned char *data, size_t len, size_t *consumed)
+{
+    unsigned char c = data[0];
+    size_t needed;
+    unsigned char low = 0x80, high = 0xbf; ///< range of the second byte
+    if (c >= 0xc2 && c <= 0xdf)
+        needed = 2;
+    else if (c >= 0xe0 && c <= 0xef) {
+        needed = 3;
+        if (c == 0xe0)
+            low = 0xa0; ///< no overlong forms
+        else if (c == 0xed)
+            high = 0x9f; ///< no surrogates
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        needed = 4;
+        if (c == 0xf0)
+            low = 0x90; ///< no overlong forms
+        else if (c == 0xf4)
+            high = 0x8f; ///< nothing beyond U+10FFFF
+    } else {
+        *consumed = 1;
+        return 0;
+    }
+
+    for (size_t i = 1; i < needed; ++i) {
+        if (i == len) {
+            *consumed = len;
+            return -1;
+        }
+        if (data[i] < (i == 1 ? low : 0x80) || data[i] > (i == 1 ? high : 0xbf)) {
+            *consumed = i;
+            return 0;
+        }
+    }
+    *consumed = needed;
+    return 1;
+}
+
+/**
+ * Write what @p len bytes not forming valid UTF-8 become according
+ * to the parser's policy to @p result, which must hold 2 * @p len
+ * and at least 3 bytes. Returns the number of bytes written.
+ */
+static size_t replace_invalid_utf8(struct parser_state *state, const char *data, size_t len, char *result)
+{
+    if (state->stats != NULL)
+        state->stats->invalid_utf8_bytes += len;
+    if (state->debug) fprintf(stderr, "Invalid UTF-8: %zu bytes starting with 0x%02x\n", len, (unsigned char)data[0]);
+    if (state->invalid_utf8 == PARSER_UTF8_REPLACE) {
+        memcpy(result, "\xef\xbf\xbd", 3);
+        return 3;
+    } else if (state->invalid_utf8 == PARSER_UTF8_LATIN1) {
+        for (size_t i = 0; i < len; ++i) {
+            unsigned char c = (unsigned char)data[i];
+            result[2 * i] = (char)(0xc0 | c >> 6);
+            result[2 * i + 1] = (char)(0x80 | (c & 0x3f));
+        }
+        return 2 * len;
+    }
+    return 0;
+}
+
+/**
+ * Pass on what @p len bytes not forming valid UTF-8 become,
+ * at most 4 as found by utf8_check.
+ */
+static void emit_invalid_utf8(struct parser_state *state, const char *data, size_t len)
+{
+    char result[8];
+    size_t result_len = replace_invalid_utf8(state, data, len, result);
+    if (result_len > 0)
+        emit_text(state, result, result_len);
+}
+
+/**
+ * Pass on the text starting at @p buffer, a run of printable
+ * ASCII characters and valid UTF-8 sequences, followed by at
+ * most one invalid sequence. A sequence cut off at the end of
+ * the buffer is kept in @p state. Returns the number of bytes
+ * used, at least 1.
+ */
+static size_t parse_text(struct parser_state *state, const char *buffer, size_t len)
+{
+    size_t run_end = 0, consumed = 0;
+    int valid = 1;
+    for (;;) {
+        run_end += ascii_run(buffer + run_end, len - run_end);
+        if (run_end == len || (unsigned char)buffer[run_end] < 0x80)
+            break;
+        valid = utf8_check((const unsigned char *)buffer + run_end, len - run_end, &consumed);
+        if (valid != 1)
+            break;
+        run_end += consumed;
+    }
+
+    if (run_end > 0) {
+        if (state->stats != NULL)
+            state->stats->text_bytes += run_end;
+        if (state->debug)
+            for (size_t j = 0; j < run_end; ++j)
+                fprintf(stderr, "char: %c\n", buffer[j]);
+        /// Pass on the whole run at once, continuing an open text
+        emit_text(state, buffer, run_end);
+    }
+    if (run_end == len || (unsigned char)buffer[run_end] < 0x80)
+        return run_end;
+    if (valid < 0) {
+        /// Rest of the character comes with the next buffer
+        memcpy(state->utf8_pending, buffer + run_end, consumed);
+        state->utf8_pending_len = consumed;
+    } else
+        emit_invalid_utf8(state, buffer + run_end, consumed);
+    return run_end + consumed;
+}
+
+/**
+ * Handle the text and single control characters of @p buffer
+ * from position @p i on, up to the next ESC. Returns the position
+ * of that ESC, or @p len if there is none.
+ */
+static size_t parse_ground(struct parser_state *state, const char *buffer, size_t i, size_t len)
+{
+    if (state->pending_cr && i < len) {
+        /// Previous buffer ended in CR, decide on newline now that the next byte is known
+        state->pending_cr = 0;
+        if (buffer[i] != 0x0a) ///< lonely CR without following LF
+            emit(state, EVENT_NEWLINE, NEWLINE_CR, 0);
+        else {
+            if (state->stats != NULL) ++state->stats->control_bytes;
+            if (state->debug) fprintf(stderr, "char: Line Feed  (%zu of %zu)\n", i, len - 1);
+            emit(state, EVENT_NEWLINE, NEWLINE_CRLF, 0);
+            ++i;
+        }
+    }
+
+    while (i < len) {
+        unsigned char c = (unsigned char)buffer[i];
+        enum byte_class class = (enum byte_class)byte_classes[c];
+        if (class == BYTE_TEXT) {
+            /// Printable characters, ASCII or UTF-8, up to the next control character
+            i += parse_text(state, buffer + i, len - i);
+            continue;
+        } else if (class == BYTE_ESC)
+            return i;
+
+        if (state->stats != NULL) ++state->stats->control_bytes;
+        close_textsequence(state);
+        switch (class) {
+        case BYTE_LF:
+            if (state->debug) fprintf(stderr, "char: Line Feed  (%zu of %zu)\n", i, len - 1);
+            emit(state, EVENT_NEWLINE, NEWLINE_LF, 0);
+            break;
+        case BYTE_CR:
+            if (state->debug) fprintf(stderr, "char: Carriage Return  (%zu of %zu)\n", i, len - 1);
+            if (i + 1 == len) {
+                /// Whether a LF follows is known with the next buffer
+                state->pending_cr = 1;
+            } else if (buffer[i + 1] == 0x0a) {
+                if (state->stats != NULL) ++state->stats->control_bytes;
+                if (state->debug) fprintf(stderr, "char: Line Feed  (%zu of %zu)\n", i + 1, len - 1);
+                emit(state, EVENT_NEWLINE, NEWLINE_CRLF, 0);
+                ++i;
+            } else
+                emit(state, EVENT_NEWLINE, NEWLINE_CR, 0);
+            break;
+        case BYTE_BS:
+            if (state->debug) fprintf(stderr, "char: 0x%02x  (%zu of %zu)\n", c, i, len - 1);
+            emit_cursor(state, CURSOR_MOVE, 0, -1);
+            break;
+        case BYTE_TAB:
+            if (state->debug) fprintf(stderr, "char: 0x%02x  (%zu of %zu)\n", c, i, len - 1);
+            emit_cursor(state, CURSOR_TAB, 0, 0);
+            break;
+        default:
+            if (state->debug) fprintf(stderr, "char: 0x%02x  (%zu of %zu)\n", c, i, len - 1);
+            break;
+        }
+        ++i;
+    }
+    return len;
+}
+
+/**
+ * Complete the UTF-8 sequence cut off at the end of the last
+ * buffer with the first bytes of @p buffer. Returns the number
+ * of bytes of @p buffer used.
+ */
+static size_t complete_utf8(struct parser_state *state, const char *buffer, size_t len)
+{
+    size_t used = 0, consumed;
+    int valid;
+    for (;;) {
+        valid = utf8_check((const unsigned char *)state->utf8_pending, state->utf8_pending_len, &consumed);
+        if (valid >= 0 || used == len)
+            break;
+        state->utf8_pending[state->utf8_pending_len++] = buffer[used++];
+    }
+    if (valid < 0)
+        return used; ///< still incomplete, tiny buffer
+
+    if (valid == 1) {
+        if (state->stats != NULL)
+            state->stats->text_bytes += consumed;
+        emit_text(state, state->utf8_pending, consumed);
+    } else
+        emit_invalid_utf8(state, state->utf8_pending, consumed);
+    /// Bytes taken beyond an invalid start are parsed again
+    used -= state->utf8_pending_len - consumed;
+    state->utf8_pending_len = 0;
+    return used;
+}
+
+/**
+ * Handle the end of an OSC or DCS command string, no matter
+ * if it was terminated properly or interrupted by a byte
+ * not allowed in command strings.
+ */
+static void finish_commandstring(struct parser_state *state)
+{
+    char *command_string = state->command_string;
+    size_t command_string_len = state->command_string_len;
+    command_string[command_string_len] = '\0';
+    state->mode = MODE_GROUND;
+
+    if (state->stats != NULL) {
+        if (state->string_introducer == 0x50 /* DCS */) {
+            ++state->stats->dcs_count;
+            state->stats->dcs_bytes += command_string_len;
+        } else {
+            ++state->stats->osc_count;
+            state->stats->osc_bytes += command_string_len;
+        }
+        if (command_string_len > state->stats->largest_command_string)
+            state->stats->largest_command_string = command_string_len;
+    }
+
+    if (state->string_introducer == 0x50 /* DCS */) {
+        if (state->debug) {
+            fprintf(stderr, "unknown device control string=");
+            for (size_t j = 0; j < command_string_len; ++j) {
+                if (command_string[j] >= 0x20 /* 02/00 */ && command_string[j] <= 0x7e /* 07/14 */)
+                    fprintf(stderr, "%c", command_string[j]);
+                else
+                    fprintf(stderr, "[%02x]", command_string[j]);
+            }
+            fprintf(stderr, "\n");
+        }
+    } else if (command_string_len > 3 && command_string[0] == '0' && command_string[1] == ';') {
+        /// OSC starting with '0;' sets the window title, the remaining
+        /// printable characters and UTF-8 sequences are the title
+        close_textsequence(state);
+        if (state->debug) fprintf(stderr, "Window title=");
+        char title[3 * PARSER_BUFFER_SIZE];
+        size_t title_len = 0;
+        for (size_t j = 2; j < command_string_len; ++j)
+            if (command_string[j] >= 0x20 /* 02/00 */ && command_string[j] <= 0x7e /* 07/14 */) {
+                /// Write out runs of printable characters only
+                size_t run_end = j + 1;
+                while (run_end < command_string_len && command_string[run_end] >= 0x20 && command_string[run_end] <= 0x7e)
+                    ++run_end;
+                if (state->debug) fprintf(stderr, "%.*s", (int)(run_end - j), command_string + j);
+                memcpy(title + title_len, command_string + j, run_end - j);
+                title_len += run_end - j;
+                j = run_end - 1;
+            } else if ((unsigned char)command_string[j] >= 0x80) {
+                size_t consumed;
+                if (utf8_check((const unsigned char *)command_string + j, command_string_len - j, &consumed) == 1) {
+                    memcpy(title + title_len, command_string + j, consumed);
+                    title_len += consumed;
+                } else ///< also a sequence cut off at the end of the string
+                    title_len += replace_invalid_utf8(state, command_string + j, consumed, title + title_len);
+                j += consumed - 1;
+            }
+        if (state->debug) fprintf(stderr, "\n");
+        struct event event = { .type = EVENT_OSC, .text = title, .length = title_len };
+        event_emit(&state->sink, &event);
+    } else if (state->debug) {
+        fprintf(stderr, "unknown command string=");
+        for (size_t j = 0; j < command_string_len; ++j) {
+            if (command_string[j] >= 0x20 /* 02/00 */ && command_string[j] <= 0x7e /* 07/14 */)
+                fprintf(stderr, "%c", command_string[j]);
+            else
+                fprintf(stderr, "[%02x]", command_string[j]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+/**
+ * Set @p rendition to that of a freshly started terminal.
+ */
+void parser_rendition_init(struct parser_rendition *rendition)
+{
+    rendition->foreground = rendition->background = 9;
+    rendition->foreground_bright = rendition->background_bright = 0;
+    rendition->intensity = COLOR_NORMAL;
+    rendition->inverted = 0;
+}
+
+/**
+ * Prepare a parser in its initial state, passing its
+ * events on to @p sink.
+ */
+void parser_init(struct parser_state *state, const struct event_sink *sink)
+{
+    state->mode = MODE_GROUND;
+    state->pending_cr = 0;
+    state->insidetextsequence = 0;
+    parser_rendition_init(&state->rendition);
+    state->utf8_pending_len = 0;
+    state->invalid_utf8 = PARSER_UTF8_REPLACE;
+    state->last_character_len = 0;
+    state->missed_repeat = 0;
+    state->string_introducer = 0;
+    state->parameter_len = state->intermediate_len = state->command_string_len = 0;
+    state->sink = *sink;
+    state->debug = 0;
+    state->stats = NULL;
+}
+
+/**
+ * Feed @p len bytes of typescript into the parser.
+ * The bytes do not need to be aligned with timing steps or
+ * escape sequences: anything incomplete at the end of the
+ * buffer is kept in @p state and continued on the next call.
+ */
+int parse_typescript(struct parser_state *state, const char *buffer, size_t len)
+{
+    int ret = 0;
+    size_t i = 0;
+    if (state->utf8_pending_len > 0)
+        i = complete_utf8(state, buffer, len);
+
+    /// Go through every byte in the buffer ...
+    for (; ret == 0 && i < len; ++i) {
+        unsigned char c = (unsigned char)buffer[i];
+
+        switch (state->mode) {
+        case MODE_GROUND:
+            /// Everything up to the next ESC in one go
+            i = parse_ground(state, buffer, i, len);
+            if (i < len) {
+                close_textsequence(state);
+                state->mode = MODE_ESCAPE;
+            }
+            break;
+
+        case MODE_ESCAPE:
+            /// Escape sequence
+            if (c == 0x5b /* 05/11 from 7-bit C1 set */) {
+                /// CSI -- Command Sequence Introducer (see 5.4 in ECMA-48 1991)
+                if (state->debug) fprintf(stderr, "CSI at position %zu of %zu\n", i, len - 1);
+                state->parameter_len = state->intermediate_len = 0;
+                state->mode = MODE_CSI_PARAMETER;
+            } else if (c == 0x50 /* 05/00 from 7-bit C1 set */ || c == 0x5d /* 05/13 from 7-bit C1 set */) {
+                /// DCS -- Device Control String (see 8.3.27 in ECMA-48 1991)
+                /// OSC -- Operating System Command (see 8.3.89 in ECMA-48 1991)
+                if (state->debug) fprintf(stderr, "%s at position %zu of %zu\n", c == 0x50 ? "DCS" : "OSC", i, len - 1);
+                state->string_introducer = c;
+                state->command_string_len = 0;
+                state->mode = MODE_COMMAND_STRING;
+            } else if (c == 0x48 /* 04/08 from 7-bit C1 set */) {
+                /// HTS -- Character Tabulation Set (see 8.3.62 in ECMA-48 1991)
+                if (state->debug) fprintf(stderr, "Character Tabulation Set at position %zu of %zu\n", i, len - 1);
+                if (state->stats != NULL) ++state->stats->escape_count;
+                emit(state, EVENT_CURSOR, CURSOR_TAB_SET, 0);
+                state->mode = MODE_GROUND;
+            } else if (c >= 0x20 /* 02/00 */ && c <= 0x2f /* 02/15 */) {
+                /// Intermediate Byte of an escape sequence of three or more
+                /// bytes, like the designation of a character set
+                state->intermediate_bytes[0] = c;
+                state->intermediate_len = 1;
+                state->mode = MODE_ESC_INTERMEDIATE;
+            } else if (c >= 0x3c /* 03/12 */ && c <= 0x3f /* 03/15 */) {
+                /// Assuming 2-byte sequence
+                if (state->debug) fprintf(stderr, "Private parameter string: %c\n", c);
+                if (state->stats != NULL) ++state->stats->escape_count;
+                state->mode = MODE_GROUND;
+            } else {
+                /// Assuming 2-byte sequence
+                if (state->debug) fprintf(stderr, "Unknown escape sequence: 0x%02x='%c' at position %zu of %zu\n", c, c, i, len - 1);
+                if (state->stats != NULL) ++state->stats->escape_count;
+                state->mode = MODE_GROUND;
+            }
+            break;
+
+        case MODE_ESC_INTERMEDIATE:
+            if (c >= 0x20 && c <= 0x2f) {
+                /// More Intermediate Bytes
+                if (state->intermediate_len < PARSER_BUFFER_SIZE - 1)
+                    state->intermediate_bytes[state->intermediate_len++] = c;
+                break;
+            }
+            state->mode = MODE_GROUND;
+            if (c >= 0x30 && c <= 0x7e) {
+                /// Found Final Byte, character sets are not switched, the whole sequence is dropped
+                if (state->debug) fprintf(stderr, "Escape sequence with Intermediate Byte 0x%02x and Final Byte 0x%02x ignored at position %zu of %zu\n", (unsigned char)state->intermediate_bytes[0], c, i, len - 1);
+                if (state->stats != NULL) ++state->stats->escape_count;
+            } else {
+                if (state->debug) fprintf(stderr, "Final Byte expected at position %zu of %zu, but byte 0x%02x found instead\n", i, len - 1, c);
+                --i; /// Process this byte again, outside of the escape sequence
+            }
+            break;
+
+        case MODE_CSI_PARAMETER:
+            if (c >= 0x30 && c <= 0x3f) {
+                /// Reading optional Parameter Bytes that have to be in value range 0x30 .. 0x3f
+                if (state->parameter_len < PARSER_BUFFER_SIZE - 1) {
+                    state->parameter_bytes[state->parameter_len++] = c;
+                    break;
+                }
+            } else if (c >= 0x20 && c <= 0x2f) {
+                /// Reading optional Intermediate Bytes that have to be in value range 0x20 .. 0x2f
+                state->intermediate_bytes[state->intermediate_len++] = c;
+                state->mode = MODE_CSI_INTERMEDIATE;
+                break;
+            }
+        /* fall through */
+        case MODE_CSI_INTERMEDIATE:
+            if (state->mode == MODE_CSI_INTERMEDIATE && c >= 0x20 && c <= 0x2f && state->intermediate_len < PARSER_BUFFER_SIZE - 1) {
+                state->intermediate_bytes[state->intermediate_len++] = c;
+                break;
+            }
+            state->parameter_bytes[state->parameter_len] = 0; ///< null-terminated
+            state->intermediate_bytes[state->intermediate_len] = 0;
+            state->mode = MODE_GROUND;
+            /// Reading Final Byte that has to be in value range 0x40 .. 0x7f
+            if (c >= 0x40 && c <= 0x7f) {
+                /// Found Final Byte
+                if (state->stats != NULL) {
+                    size_t sequence_len = 3 + state->parameter_len + state->intermediate_len;
+                    ++state->stats->csi_count[c];
+                    state->stats->csi_bytes[c] += sequence_len;
+                    if (sequence_len > state->stats->largest_sequence)
+                        state->stats->largest_sequence = sequence_len;
+                }
+                int stage = stats_enter(state->stats, STATS_DISPATCH);
+                ret = process_controlsequence(state, c, state->intermediate_bytes, state->parameter_bytes);
+                stats_leave(state->stats, stage);
+            } else if (state->debug)
+                fprintf(stderr, "Final Byte expected at position %zu of %zu, but byte 0x%02x found instead\n", i, len - 1, c);
+            break;
+
+        case MODE_COMMAND_STRING:
+            /// Read command string
+            /// Bytes from 0x80 on are taken as UTF-8, not as 8-bit String Terminator
+            if ((c >= 0x08 /* 00/08 */ && c <= 0x0d /* 00/13 */) || (c >= 0x20 /* 02/00 */ && c != 0x7f /* 07/15 */)) {
+                if (state->command_string_len < PARSER_BUFFER_SIZE - 1)
+                    state->command_string[state->command_string_len++] = c;
+                else {
+                    /// Command string too long, drop byte and end string
+                    if (state->debug) fprintf(stderr, "Command string too long at position %zu of %zu\n", i, len - 1);
+                    int stage = stats_enter(state->stats, STATS_DISPATCH);
+                    finish_commandstring(state);
+                    stats_leave(state->stats, stage);
+                }
+            } else if (c == 0x1b) {
+                /// Possibly 7-bit double-byte String Terminator (see 8.3.143 in ECMA-48 1991)
+                state->mode = MODE_STRING_ESCAPE;
+            } else {
+                /// BEL which is sometimes acceptable as an alternative to a String Terminator
+                if (c != 0x07 && state->debug)
+                    fprintf(stderr, "String Terminator expected at position %zu of %zu, but byte 0x%02x found instead\n", i, len - 1, c);
+                int stage = stats_enter(state->stats, STATS_DISPATCH);
+                finish_commandstring(state);
+                stats_leave(state->stats, stage);
+            }
+            break;
+
+        case MODE_STRING_ESCAPE: {
+            int stage = stats_enter(state->stats, STATS_DISPATCH);
+            finish_commandstring(state);
+            stats_leave(state->stats, stage);
+            if (c != 0x5c) {
+                /// Bytes left to read but no valid String Terminator, drop ESC
+                if (state->debug) fprintf(stderr, "String Terminator expected at position %zu of %zu, but byte 0x%02x found instead\n", i, len - 1, c);
+                --i; /// Process this byte again, outside of the command string
+            }
+            break;
+        }
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,126 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_PARSER_H
+#define SCRIPTINTERPRETER_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "events.h"
+
+struct stats;
+
+/// Longest control sequence or command string kept by the parser
+#define PARSER_BUFFER_SIZE 1024
+
+/// States of the byte-level ECMA-48 parser
+enum parser_mode {
+    MODE_GROUND, ///< plain text and single control characters
+    MODE_ESCAPE, ///< after ESC, expecting the sequence's second byte
+    MODE_ESC_INTERMEDIATE, ///< inside escape sequence, reading Intermediate Bytes up to its Final Byte
+    MODE_CSI_PARAMETER, ///< inside control sequence, reading Parameter Bytes
+    MODE_CSI_INTERMEDIATE, ///< inside control sequence, reading Intermediate Bytes
+    MODE_COMMAND_STRING, ///< inside OSC or DCS, reading command string
+    MODE_STRING_ESCAPE ///< ESC inside command string, expecting String Terminator
+};
+
+/// What happens to bytes that are not part of valid UTF-8 text
+enum parser_invalid_utf8 {
+    PARSER_UTF8_REPLACE, ///< each invalid sequence becomes U+FFFD REPLACEMENT CHARACTER
+    PARSER_UTF8_DROP, ///< invalid bytes are left out
+    PARSER_UTF8_LATIN1 ///< invalid bytes are taken as ISO 8859-1 characters
+};
+
+/**
+ * Graphic rendition set by SGR control sequences, kept for the
+ * whole recording so that only net changes of the colors are
+ * passed on. Colors are numbered like in struct event.
+ */
+struct parser_rendition {
+    uint8_t foreground, background; ///< 9 for the default color
+    uint8_t foreground_bright, background_bright; ///< aixterm or 256-color bright variant
+    uint8_t intensity; ///< COLOR_NORMAL, COLOR_INTENSE or COLOR_FAINT
+    uint8_t inverted; ///< foreground and background swapped
+};
+
+/**
+ * Everything the parser needs to remember between two calls
+ * of parse_typescript, so that escape sequences may be split
+ * across timing steps or arbitrary read chunks.
+ */
+struct parser_state {
+    enum parser_mode mode;
+    int pending_cr; ///< last byte was CR, newline depends on next byte
+    int insidetextsequence; ///< a text is open, more printable characters continue it
+    struct parser_rendition rendition;
+    char utf8_pending[4]; ///< start of a UTF-8 sequence cut off at the end of the last buffer
+    size_t utf8_pending_len; ///< bytes in @c utf8_pending, 0 if none
+    enum parser_invalid_utf8 invalid_utf8;
+    char last_character[4]; ///< last graphic character passed on, repeated by REP
+    size_t last_character_len; ///< bytes in @c last_character, 0 before the first one
+    int missed_repeat; ///< a REP came before any graphic character and was dropped
+    unsigned char string_introducer; ///< 0x5d for OSC or 0x50 for DCS
+    char parameter_bytes[PARSER_BUFFER_SIZE];
+    size_t parameter_len;
+    char intermediate_bytes[PARSER_BUFFER_SIZE];
+    size_t intermediate_len;
+    char command_string[PARSER_BUFFER_SIZE];
+    size_t command_string_len;
+    struct event_sink sink; ///< receiver of the parsed events
+    int debug; ///< describe every byte and sequence on stderr
+    struct stats *stats; ///< counters for --stats, NULL if none are collected
+};
+
+/**
+ * Interpret a complete control sequence given by its Final Byte
+ * and its null-terminated Intermediate and Parameter Bytes and
+ * pass the resulting events on to the parser's sink. Sequences
+ * not understood are ignored. Returns 0.
+ */
+int process_controlsequence(struct parser_state *state, char final_byte, char *intermediate_bytes, char *parameter_bytes);
+
+/**
+ * If open, close current <text> environment
+ */
+void close_textsequence(struct parser_state *state);
+
+/**
+ * Set @p rendition to that of a freshly started terminal.
+ */
+void parser_rendition_init(struct parser_rendition *rendition);
+
+/**
+ * Prepare a parser in its initial state, passing its
+ * events on to @p sink.
+ */
+void parser_init(struct parser_state *state, const struct event_sink *sink);
+
+/**
+ * Feed @p len bytes of typescript into the parser.
+ * The bytes do not need to be aligned with timing steps,
+ * escape sequences or UTF-8 characters: anything incomplete
+ * at the end of the buffer is kept in @p state and continued
+ * on the next call.
+ */
+int parse_typescript(struct parser_state *state, const char *buffer, size_t len);
+
+#endif // SCRIPTINTERPRETER_PARSER_H
@@ -0,0 +1,141 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pipelinedoutput.h"
+
+/**
+ * Output in one slot of the ring
+ */
+struct output_slot {
+    size_t length; ///< bytes used in @c data
+    char data[PIPELINED_OUTPUT_SLOT_SIZE];
+};
+
+/**
+ * Write all @p len bytes of @p data to @p fd, retrying after
+ * partial writes and interruptions. Returns 0 on success.
+ */
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Cannot write output: %s\n", strerror(errno));
+            return 1;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Write slots in order until the ring is closed,
+ * or stop at the first error.
+ */
+static void *write_thread(void *arg)
+{
+    struct pipelined_output *output = (struct pipelined_output *)arg;
+
+    /// Signals are for the converting thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    for (;;) {
+        const struct output_slot *slot = (const struct output_slot *)ring_peek(&output->ring);
+        if (slot == NULL)
+            return NULL;
+        if (write_all(output->fd, slot->data, slot->length) != 0) {
+            __atomic_store_n(&output->error, 1, __ATOMIC_SEQ_CST);
+            /// Nothing more will be written, let the producer know
+            ring_cancel(&output->ring);
+            return NULL;
+        }
+        ring_release(&output->ring);
+    }
+}
+
+/**
+ * Start a thread writing to file descriptor @p fd.
+ * Returns 0 on success.
+ */
+int pipelined_output_open(struct pipelined_output *output, int fd)
+{
+    output->fd = fd;
+    output->error = 0;
+    if (ring_init(&output->ring, PIPELINED_OUTPUT_SLOTS, sizeof(struct output_slot)) != 0) {
+        fprintf(stderr, "Cannot allocate memory for pipelined output\n");
+        return 1;
+    }
+    if (pthread_create(&output->thread, NULL, write_thread, output) != 0) {
+        fprintf(stderr, "Cannot start thread for writing output\n");
+        ring_free(&output->ring);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Hand in @p len bytes to be written after everything handed in
+ * before. Only waits if all slots are in use.
+ * Returns 0 on success. Meant as writer of struct xmloutput,
+ * with the struct pipelined_output passed as @p context.
+ */
+int pipelined_output_write(void *context, const char *data, size_t len)
+{
+    struct pipelined_output *output = (struct pipelined_output *)context;
+    while (len > 0) {
+        struct output_slot *slot = (struct output_slot *)ring_acquire(&output->ring);
+        if (slot == NULL)
+            return 1; ///< writing thread has failed
+        slot->length = len < PIPELINED_OUTPUT_SLOT_SIZE ? len : PIPELINED_OUTPUT_SLOT_SIZE;
+        memcpy(slot->data, data, slot->length);
+        ring_publish(&output->ring);
+        data += slot->length;
+        len -= slot->length;
+    }
+    return 0;
+}
+
+/**
+ * Wait for everything to be written and stop the thread, but do
+ * not close the file descriptor. Returns 0 if all has been written.
+ */
+int pipelined_output_close(struct pipelined_output *output)
+{
+    if (output->ring.slots == NULL)
+        return 1;
+    ring_close(&output->ring);
+    pthread_join(output->thread, NULL);
+    ring_free(&output->ring);
+    return output->error;
+}
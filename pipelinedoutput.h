@@ -0,0 +1,68 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_PIPELINEDOUTPUT_H
+#define SCRIPTINTERPRETER_PIPELINEDOUTPUT_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "ring.h"
+
+/// Size of one slot of output waiting to be written
+#define PIPELINED_OUTPUT_SLOT_SIZE (1 << 18)
+/// Number of slots, output may be this far ahead of the file
+#define PIPELINED_OUTPUT_SLOTS 8
+
+/**
+ * Writer handing output over to a separate thread, which writes
+ * it to the file while the next output is generated. The data is
+ * copied into a ring of fixed-size slots; if the file cannot keep
+ * up, writing waits until a slot is written.
+ */
+struct pipelined_output {
+    int fd;
+    struct ring ring; ///< output not yet written
+    int error; ///< non-zero once writing failed
+    pthread_t thread;
+};
+
+/**
+ * Start a thread writing to file descriptor @p fd.
+ * Returns 0 on success.
+ */
+int pipelined_output_open(struct pipelined_output *output, int fd);
+
+/**
+ * Hand in @p len bytes to be written after everything handed in
+ * before. Only waits if all slots are in use.
+ * Returns 0 on success. Meant as writer of struct xmloutput,
+ * with the struct pipelined_output passed as @p context.
+ */
+int pipelined_output_write(void *context, const char *data, size_t len);
+
+/**
+ * Wait for everything to be written and stop the thread, but do
+ * not close the file descriptor. Returns 0 if all has been written.
+ */
+int pipelined_output_close(struct pipelined_output *output);
+
+#endif // SCRIPTINTERPRETER_PIPELINEDOUTPUT_H
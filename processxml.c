@@ -22,88 +22,275 @@ If not, see <http://www.gnu.org/licenses/>.
 #define _POSIX_SOURCE
 
 #include <stdio.h>
-#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include <libxml/parser.h>
-#include <libxml/tree.h>
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
 #define BUFFER_SIZE 16384
 
 int debug_output;
 double accumulated_delay;
 
-xmlNode *parse_timestep_node(xmlNode *timestepnode) {
-    if (timestepnode->type != XML_ELEMENT_NODE) {
-        fprintf(stderr, "Current node \"%s\" is not an element\n", timestepnode->name);
-        return timestepnode->next;
-    } else if (xmlStrEqual(timestepnode->name, (xmlChar *)"script")) {
-        fprintf(stderr, "Current node's name is not \"timestep\" but \"%s\"\n", timestepnode->name);
-        return timestepnode->next;
-    }
+/**
+ * Start tag of a timestep, held back until it is known
+ * whether the timestep is empty and can be dropped
+ */
+struct timestep_start {
+    int attribute_count, attribute_size;
+    xmlChar **names, **values;
+    int delay_index; ///< position of the "delay" attribute or -1
+};
+
+/**
+ * Whether the reader's current node is character data
+ * (a text node in the DOM)
+ */
+static int is_text_node(int type) {
+    return type == XML_READER_TYPE_TEXT || type == XML_READER_TYPE_WHITESPACE || type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE;
+}
 
-    if (timestepnode->children != NULL &&  timestepnode->children->type == XML_TEXT_NODE &&  timestepnode->children->next == NULL && timestepnode->children->content[0] <= 32 && timestepnode->children->content[1] <= 32) {
-        /// Just a single text element with white space
-        xmlAttr *curAttr = timestepnode->properties;
-        while (curAttr != NULL) {
-            if (xmlStrEqual(curAttr->name, (xmlChar *)"delay")) {
-                double this_delay = atof((const char *)curAttr->children->content);
-                accumulated_delay += this_delay;
-                xmlNode *next = timestepnode->next;
-                xmlUnlinkNode(timestepnode);
-                xmlFreeNode(timestepnode);
-
-                /// Remove following empty-line text node
-                if (next->type == XML_TEXT_NODE && next->content[0] <= 32) {
-                    xmlNode *next2 = next->next;
-                    xmlUnlinkNode(next);
-                    xmlFreeNode(next);
-                    next = next2;
-                }
-
-                return next;
-            }
-            curAttr = curAttr->next;
+/**
+ * Write character data, escaped the same way as xmlDocDump does
+ * (xmlTextWriterWriteString would escape quotes as well).
+ */
+static int write_text(xmlTextWriterPtr writer, const xmlChar *text) {
+    char buffer[BUFFER_SIZE];
+    size_t len = 0;
+    for (; *text != 0; ++text) {
+        if (len > BUFFER_SIZE - 8) {
+            if (xmlTextWriterWriteRawLen(writer, (xmlChar *)buffer, (int)len) < 0)
+                return 1;
+            len = 0;
+        }
+        switch (*text) {
+        case '<':
+            memcpy(buffer + len, "&lt;", 4);
+            len += 4;
+            break;
+        case '>':
+            memcpy(buffer + len, "&gt;", 4);
+            len += 4;
+            break;
+        case '&':
+            memcpy(buffer + len, "&amp;", 5);
+            len += 5;
+            break;
+        case '\r':
+            memcpy(buffer + len, "&#13;", 5);
+            len += 5;
+            break;
+        default:
+            buffer[len++] = (char)*text;
         }
     }
+    return len > 0 && xmlTextWriterWriteRawLen(writer, (xmlChar *)buffer, (int)len) < 0 ? 1 : 0;
+}
 
-    if (accumulated_delay > 0.0) {
-        xmlAttr *curAttr = timestepnode->properties;
-        while (curAttr != NULL) {
-            if (xmlStrEqual(curAttr->name, (xmlChar *)"delay")) {
-                double this_delay = atof((const char *)curAttr->children->content);
-                xmlFreeNode(curAttr->children);
-                char printed_delay[BUFFER_SIZE];
-                snprintf(printed_delay, BUFFER_SIZE, "%.3lf", accumulated_delay + this_delay);
-                accumulated_delay = 0.0;
-                curAttr->children = xmlNewText((unsigned char *)printed_delay);
-                break;
-            }
-            curAttr = curAttr->next;
+/**
+ * Copy the attributes of the reader's current element
+ * into @p start.
+ */
+static int read_timestep_start(xmlTextReaderPtr reader, struct timestep_start *start) {
+    start->attribute_count = 0;
+    start->delay_index = -1;
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (start->attribute_count == start->attribute_size) {
+            int new_size = start->attribute_size > 0 ? 2 * start->attribute_size : 4;
+            xmlChar **new_names = (xmlChar **)realloc(start->names, new_size * sizeof(xmlChar *));
+            if (new_names == NULL)
+                return 1;
+            start->names = new_names;
+            xmlChar **new_values = (xmlChar **)realloc(start->values, new_size * sizeof(xmlChar *));
+            if (new_values == NULL)
+                return 1;
+            start->values = new_values;
+            start->attribute_size = new_size;
         }
+        start->names[start->attribute_count] = xmlStrdup(xmlTextReaderConstName(reader));
+        start->values[start->attribute_count] = xmlStrdup(xmlTextReaderConstValue(reader));
+        if (start->delay_index < 0 && xmlStrEqual(start->names[start->attribute_count], (xmlChar *)"delay"))
+            start->delay_index = start->attribute_count;
+        ++start->attribute_count;
     }
+    xmlTextReaderMoveToElement(reader);
+    return 0;
+}
 
-    // TODO
+/**
+ * Release the attributes copied into @p start.
+ */
+static void clear_timestep_start(struct timestep_start *start) {
+    for (int i = 0; i < start->attribute_count; ++i) {
+        xmlFree(start->names[i]);
+        xmlFree(start->values[i]);
+    }
+    start->attribute_count = 0;
+}
+
+/**
+ * Write the start tag of a timestep that is kept, adding the
+ * delays of dropped empty timesteps before it to its own delay.
+ */
+static int write_timestep_start(xmlTextWriterPtr writer, struct timestep_start *start) {
+    if (accumulated_delay > 0.0 && start->delay_index >= 0) {
+        double this_delay = atof((const char *)start->values[start->delay_index]);
+        char printed_delay[BUFFER_SIZE];
+        snprintf(printed_delay, BUFFER_SIZE, "%.3lf", accumulated_delay + this_delay);
+        accumulated_delay = 0.0;
+        xmlFree(start->values[start->delay_index]);
+        start->values[start->delay_index] = xmlStrdup((xmlChar *)printed_delay);
+    }
 
-    return timestepnode->next;
+    if (xmlTextWriterStartElement(writer, (xmlChar *)"timestep") < 0)
+        return 1;
+    for (int i = 0; i < start->attribute_count; ++i)
+        if (xmlTextWriterWriteAttribute(writer, start->names[i], start->values[i]) < 0)
+            return 1;
+    return 0;
 }
 
-int parse_script_node(xmlNode *scriptnode) {
-    if (scriptnode->type != XML_ELEMENT_NODE) {
-        fprintf(stderr, "Current node \"%s\" is not an element\n", scriptnode->name);
-        return 4;
-    } else if (xmlStrEqual(scriptnode->name, (xmlChar *)"script") == 0) {
-        fprintf(stderr, "Current node's name is not \"script\" but \"%s\"\n", scriptnode->name);
-        return 4;
+/**
+ * Copy the reader's current node to the writer unchanged.
+ */
+static int write_node(xmlTextReaderPtr reader, xmlTextWriterPtr writer) {
+    int rc = 0;
+    switch (xmlTextReaderNodeType(reader)) {
+    case XML_READER_TYPE_ELEMENT: {
+        int empty = xmlTextReaderIsEmptyElement(reader);
+        rc = xmlTextWriterStartElement(writer, xmlTextReaderConstName(reader));
+        while (rc >= 0 && xmlTextReaderMoveToNextAttribute(reader) == 1)
+            rc = xmlTextWriterWriteAttribute(writer, xmlTextReaderConstName(reader), xmlTextReaderConstValue(reader));
+        xmlTextReaderMoveToElement(reader);
+        if (rc >= 0 && empty)
+            rc = xmlTextWriterEndElement(writer);
+        break;
     }
+    case XML_READER_TYPE_END_ELEMENT:
+        rc = xmlTextWriterEndElement(writer);
+        break;
+    case XML_READER_TYPE_TEXT:
+    case XML_READER_TYPE_WHITESPACE:
+    case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+        return write_text(writer, xmlTextReaderConstValue(reader));
+    case XML_READER_TYPE_CDATA:
+        rc = xmlTextWriterWriteCDATA(writer, xmlTextReaderConstValue(reader));
+        break;
+    case XML_READER_TYPE_COMMENT:
+        rc = xmlTextWriterWriteComment(writer, xmlTextReaderConstValue(reader));
+        break;
+    case XML_READER_TYPE_PROCESSING_INSTRUCTION:
+        rc = xmlTextWriterWritePI(writer, xmlTextReaderConstName(reader), xmlTextReaderConstValue(reader));
+        break;
+    default:
+        break;
+    }
+    return rc < 0 ? 1 : 0;
+}
 
-    for (xmlNode *cur = scriptnode->children; cur; /** cur is stepped forward below */) {
-        if (cur->type == XML_ELEMENT_NODE && xmlStrEqual(cur->name, (xmlChar *)"timestep"))
-            cur = parse_timestep_node(cur);
-        else
-            cur = cur->next;
+/**
+ * Copy the document from @p reader to @p writer in a single pass.
+ * Timesteps directly inside <script> that contain nothing but
+ * white space are dropped together with the line break after
+ * them; their delays are added to the next timestep kept.
+ * Only one timestep's start tag and first text are held in
+ * memory at a time.
+ */
+int process_script(xmlTextReaderPtr reader, xmlTextWriterPtr writer) {
+    struct timestep_start start = { 0, 0, NULL, NULL, -1 };
+    int document_started = 0;
+    int drop_blank = 0; ///< a timestep was dropped, drop blank text after it
+    int result = 0;
+
+    int ret = xmlTextReaderRead(reader);
+    while (ret == 1 && result == 0) {
+        int type = xmlTextReaderNodeType(reader);
+        int depth = xmlTextReaderDepth(reader);
+
+        if (!document_started) {
+            if (depth == 0 && type == XML_READER_TYPE_ELEMENT && !xmlStrEqual(xmlTextReaderConstName(reader), (xmlChar *)"script")) {
+                fprintf(stderr, "Current node's name is not \"script\" but \"%s\"\n", xmlTextReaderConstName(reader));
+                result = 4;
+                break;
+            }
+            if (xmlTextWriterStartDocument(writer, (const char *)xmlTextReaderConstXmlVersion(reader), (const char *)xmlTextReaderConstEncoding(reader), NULL) < 0) {
+                result = 1;
+                break;
+            }
+            document_started = 1;
+        }
+
+        if (drop_blank) {
+            drop_blank = 0;
+            if (depth == 1 && is_text_node(type) && xmlTextReaderConstValue(reader)[0] <= 32) {
+                ret = xmlTextReaderRead(reader);
+                continue;
+            }
+        }
+
+        if (depth != 1 || type != XML_READER_TYPE_ELEMENT || !xmlStrEqual(xmlTextReaderConstName(reader), (xmlChar *)"timestep")) {
+            /// Anything but a timestep is copied as it is,
+            /// nodes outside the root element are put on lines of their own
+            result = write_node(reader, writer);
+            if (result == 0 && depth == 0 && (type != XML_READER_TYPE_ELEMENT || xmlTextReaderIsEmptyElement(reader)))
+                result = xmlTextWriterWriteRaw(writer, (xmlChar *)"\n") < 0;
+            ret = xmlTextReaderRead(reader);
+            continue;
+        }
+
+        if (read_timestep_start(reader, &start) != 0) {
+            fprintf(stderr, "Cannot allocate memory for attributes\n");
+            result = 1;
+            break;
+        }
+        if (xmlTextReaderIsEmptyElement(reader)) {
+            result = write_timestep_start(writer, &start) || xmlTextWriterEndElement(writer) < 0;
+            clear_timestep_start(&start);
+            ret = xmlTextReaderRead(reader);
+            continue;
+        }
+
+        /// Look ahead: a timestep consisting of a single blank text is dropped
+        ret = xmlTextReaderRead(reader);
+        xmlChar *text = NULL;
+        if (ret == 1 && is_text_node(xmlTextReaderNodeType(reader))) {
+            text = xmlStrdup(xmlTextReaderConstValue(reader));
+            ret = xmlTextReaderRead(reader);
+        }
+        if (ret != 1) {
+            xmlFree(text);
+            break;
+        }
+        int ended = xmlTextReaderNodeType(reader) == XML_READER_TYPE_END_ELEMENT;
+
+        if (ended && text != NULL && text[0] <= 32 && text[1] <= 32 && start.delay_index >= 0) {
+            accumulated_delay += atof((const char *)start.values[start.delay_index]);
+            drop_blank = 1;
+        } else {
+            result = write_timestep_start(writer, &start);
+            if (result == 0 && text != NULL)
+                result = write_text(writer, text);
+            if (result == 0 && ended)
+                result = xmlTextWriterEndElement(writer) < 0;
+        }
+        xmlFree(text);
+        clear_timestep_start(&start);
+
+        /// End of timestep has been handled, any other node is copied next
+        if (ended)
+            ret = xmlTextReaderRead(reader);
     }
 
-    return 0;
+    free(start.names);
+    free(start.values);
+
+    if (result == 0 && ret != 0) {
+        fprintf(stderr, "Failed to parse XML input\n");
+        result = 1;
+    }
+    if (result == 0 && xmlTextWriterFlush(writer) < 0)
+        result = 1;
+    return result;
 }
 
 int main(int argc, char *argv[])
@@ -155,8 +342,15 @@ int main(int argc, char *argv[])
         }
     }
 
-    xmlDocPtr doc = xmlReadFd(fileno(inputfile), inputfilename == NULL || inputfilename[0] == '\0' ? "noname.xml" : inputfilename, NULL, 0);
-    if (doc == NULL) {
+    /// Read and write the document piece by piece instead of building a tree
+    xmlTextReaderPtr reader = xmlReaderForFd(fileno(inputfile), inputfilename == NULL || inputfilename[0] == '\0' ? "noname.xml" : inputfilename, NULL, 0);
+    xmlOutputBufferPtr outputbuffer = reader != NULL ? xmlOutputBufferCreateFile(outputfile, NULL) : NULL;
+    xmlTextWriterPtr writer = outputbuffer != NULL ? xmlNewTextWriter(outputbuffer) : NULL;
+    if (writer == NULL) {
+        if (outputbuffer != NULL)
+            xmlOutputBufferClose(outputbuffer);
+        if (reader != NULL)
+            xmlFreeTextReader(reader);
         if (inputfilename != NULL)
             fprintf(stderr, "Failed to parse \"%s\"\n", inputfilename);
         if (outputfile != stdout)
@@ -165,19 +359,19 @@ int main(int argc, char *argv[])
             fclose(inputfile);
         return 1;
     }
-    xmlNode *root_element = xmlDocGetRootElement(doc);
 
     accumulated_delay = 0.0;
-    int result = parse_script_node(root_element);
-
-    if (result == 0)
-        result = xmlDocDump(outputfile, doc) > 0 ? 0 : 1;
+    int result = process_script(reader, writer);
 
-    /// Free the XML document
-    xmlFreeDoc(doc);
+    /// Flushes and frees the output buffer as well
+    xmlFreeTextWriter(writer);
+    xmlFreeTextReader(reader);
 
-    if (outputfile != stdout)
-        fclose(outputfile);
+    if (outputfile != stdout) {
+        if (fclose(outputfile) != 0 && result == 0)
+            result = 1;
+    } else if (fflush(outputfile) != 0 && result == 0)
+        result = 1;
     if (inputfile != stdin)
         fclose(inputfile);
 
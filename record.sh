@@ -1,19 +1,32 @@
 #!/usr/bin/env bash
 
-if [[ $# -eq 1 && -n "$1" ]] ; then
+if [[ $# -ge 1 && -n "$1" ]] ; then
 	IDENTIFIER="$1"
 else
 	IDENTIFIER=$(date '+%Y%m%d-%H%M%S')
 fi
 TIMING_FILE="/tmp/script-timing-${IDENTIFIER}.txt"
 TYPESCRIPT_FILE="/tmp/script-typescript-${IDENTIFIER}.txt"
+# Optional second parameter: convert to this XML file while recording
+XML_FILE="$2"
 
 echo "identifier=${IDENTIFIER}"
 echo "timing file=${TIMING_FILE}"
 echo "typescript file=${TYPESCRIPT_FILE}"
+[[ -n "${XML_FILE}" ]] && echo "xml file=${XML_FILE}"
+
+if [[ -n "${XML_FILE}" ]] ; then
+	# Files have to exist before they can be followed
+	: >"${TIMING_FILE}"
+	: >"${TYPESCRIPT_FILE}"
+	"$(dirname "$0")/scriptinterpreter" --follow "${TIMING_FILE}" "${TYPESCRIPT_FILE}" "${XML_FILE}" &
+	CONVERTER_PID=$!
+fi
 
 echo "---------------------------------------------------"
 script "--timing=${TIMING_FILE}" "${TYPESCRIPT_FILE}"
 echo "---------------------------------------------------"
 
-ls -l "${TIMING_FILE}" "${TYPESCRIPT_FILE}"
+[[ -n "${CONVERTER_PID}" ]] && wait "${CONVERTER_PID}"
+
+ls -l "${TIMING_FILE}" "${TYPESCRIPT_FILE}" ${XML_FILE:+"${XML_FILE}"}
@@ -0,0 +1,159 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "recording.h"
+
+/**
+ * Open the files of a recording. The typescript is memory-mapped
+ * if @p allow_mmap is non-zero and it is a regular, uncompressed
+ * file. Returns 0 on success.
+ */
+int recording_open(struct recording *recording, const char *timefilename, const char *typescriptfilename, int allow_mmap)
+{
+    memset(recording, 0, sizeof(*recording));
+
+    recording->timefile = fopen(timefilename, "r");
+    if (!recording->timefile) {
+        fprintf(stderr, "Cannot open timefilename \"%s\"\n", timefilename);
+        return 1;
+    }
+
+    recording->typescriptfile = fopen(typescriptfilename, "r");
+    if (!recording->typescriptfile) {
+        fclose(recording->timefile);
+        fprintf(stderr, "Cannot open typescriptfilename \"%s\"\n", typescriptfilename);
+        return 1;
+    }
+
+    /// Memory-map the typescript if possible, fall back to fread (e.g. for pipes);
+    /// compressed files are decompressed on separate threads while parsing
+    recording->timing_compression = compression_detect(recording->timefile);
+    recording->typescript_compression = compression_detect(recording->typescriptfile);
+    if ((recording->timing_compression != COMPRESSION_NONE && compressed_input_open(&recording->timingcompressed, recording->timefile, recording->timing_compression) != 0)
+            || (recording->typescript_compression != COMPRESSION_NONE && compressed_input_open(&recording->typescriptcompressed, recording->typescriptfile, recording->typescript_compression) != 0)
+            || typescript_input_open(&recording->typescript, recording->typescriptfile, allow_mmap, recording->typescript_compression != COMPRESSION_NONE ? &recording->typescriptcompressed : NULL) != 0) {
+        compressed_input_close(&recording->timingcompressed);
+        compressed_input_close(&recording->typescriptcompressed);
+        fclose(recording->timefile);
+        fclose(recording->typescriptfile);
+        fprintf(stderr, "Cannot read from typescriptfilename \"%s\"\n", typescriptfilename);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Read the rest of the timing file into @p table, see
+ * timing_table_read. The first step's bytes start at the
+ * current typescript position, its line number is @p first_line.
+ * Returns 0 on success, also if a malformed line was found.
+ */
+int recording_read_timing(struct recording *recording, struct timing_table *table, size_t first_line)
+{
+    if (recording->timing_compression == COMPRESSION_NONE)
+        return timing_table_read(table, recording->timefile, recording->typescript.position, first_line);
+
+    size_t len;
+    char *data = compressed_input_read_all(&recording->timingcompressed, &len);
+    int ret = data == NULL ? 1 : timing_table_parse(table, data, len, 0, recording->typescript.position, first_line);
+    free(data);
+    return ret;
+}
+
+/**
+ * Read the @p length bytes of the next timing step from the
+ * typescript and pass them through the parser. A text still open
+ * at the end is closed, the parser's state is otherwise kept for
+ * the next step. Returns 0 on success.
+ */
+int recording_parse_step(struct recording *recording, struct parser_state *state, size_t length)
+{
+    int ret = 0;
+    for (size_t left = length; ret == 0 && left > 0;) {
+        size_t rlen;
+        const char *data = typescript_input_next(&recording->typescript, left, &rlen);
+        if (data == NULL)
+            return 1;
+        if (rlen == 0) {
+            fprintf(stderr, "Expected to read %zu bytes from typescript file, got only %zu\n", length, length - left);
+            return 1;
+        }
+        left -= rlen;
+        ret = parse_typescript(state, data, rlen);
+    }
+
+    /// Text must not span timesteps in the XML structure
+    close_textsequence(state);
+    return ret;
+}
+
+/**
+ * Close all files of the recording.
+ */
+void recording_close(struct recording *recording)
+{
+    typescript_input_close(&recording->typescript);
+    compressed_input_close(&recording->timingcompressed);
+    compressed_input_close(&recording->typescriptcompressed);
+    fclose(recording->timefile);
+    fclose(recording->typescriptfile);
+}
+
+/**
+ * Parse a whole recording, passing all its events in order on to
+ * @p sink. This needs no state besides what is on the stack, so
+ * recordings may be parsed on several threads at the same time.
+ * Returns 0 on success, 2 if the timing file has a malformed line
+ * (all steps before it are parsed) and 1 on other errors.
+ */
+int recording_parse(const char *timefilename, const char *typescriptfilename, const struct event_sink *sink)
+{
+    struct recording recording;
+    if (recording_open(&recording, timefilename, typescriptfilename, 1) != 0)
+        return 1;
+
+    struct parser_state state;
+    parser_init(&state, sink);
+
+    /// Ignore the first typescript line, contains just a comment
+    typescript_input_skipline(&recording.typescript);
+
+    struct timing_table table = { NULL, 0, 0, 0 };
+    int ret = recording_read_timing(&recording, &table, 1);
+    for (size_t j = 0; ret == 0 && j < table.count; ++j) {
+        event_emit_timestep(sink, table.steps[j].delay);
+        ret = recording_parse_step(&recording, &state, table.steps[j].length);
+        if (ret == 0)
+            event_emit_timestep_end(sink);
+    }
+
+    /// Steps before a malformed line have been parsed anyway
+    if (ret == 0 && table.error_line > 0) {
+        fprintf(stderr, "Error while reading timimg file: unexpected format in line %zu\n", table.error_line);
+        ret = 2;
+    }
+    timing_table_free(&table);
+    recording_close(&recording);
+    return ret;
+}
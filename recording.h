@@ -0,0 +1,82 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_RECORDING_H
+#define SCRIPTINTERPRETER_RECORDING_H
+
+#include <stdio.h>
+
+#include "compressedinput.h"
+#include "events.h"
+#include "parser.h"
+#include "timingfile.h"
+#include "typescriptinput.h"
+
+/**
+ * The timing and typescript file of a recording made by 'script',
+ * opened for reading. Compressed files are decompressed on separate
+ * threads while they are read.
+ */
+struct recording {
+    FILE *timefile, *typescriptfile;
+    int timing_compression, typescript_compression; ///< compression of the files, see enum compression
+    struct compressed_input timingcompressed, typescriptcompressed;
+    struct typescript_input typescript;
+};
+
+/**
+ * Open the files of a recording. The typescript is memory-mapped
+ * if @p allow_mmap is non-zero and it is a regular, uncompressed
+ * file. Returns 0 on success.
+ */
+int recording_open(struct recording *recording, const char *timefilename, const char *typescriptfilename, int allow_mmap);
+
+/**
+ * Read the rest of the timing file into @p table, see
+ * timing_table_read. The first step's bytes start at the
+ * current typescript position, its line number is @p first_line.
+ * Returns 0 on success, also if a malformed line was found.
+ */
+int recording_read_timing(struct recording *recording, struct timing_table *table, size_t first_line);
+
+/**
+ * Read the @p length bytes of the next timing step from the
+ * typescript and pass them through the parser. A text still open
+ * at the end is closed, the parser's state is otherwise kept for
+ * the next step. Returns 0 on success.
+ */
+int recording_parse_step(struct recording *recording, struct parser_state *state, size_t length);
+
+/**
+ * Close all files of the recording.
+ */
+void recording_close(struct recording *recording);
+
+/**
+ * Parse a whole recording, passing all its events in order on to
+ * @p sink. This needs no state besides what is on the stack, so
+ * recordings may be parsed on several threads at the same time.
+ * Returns 0 on success, 2 if the timing file has a malformed line
+ * (all steps before it are parsed) and 1 on other errors.
+ */
+int recording_parse(const char *timefilename, const char *typescriptfilename, const struct event_sink *sink);
+
+#endif // SCRIPTINTERPRETER_RECORDING_H
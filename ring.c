@@ -0,0 +1,164 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "ring.h"
+
+/// Slots start at multiples of this, so they may hold any structure
+#define RING_SLOT_ALIGNMENT 64
+
+/**
+ * Sleep until @p counter differs from @p seen or the ring has been
+ * closed or cancelled. The sleeper is counted before the condition
+ * is checked again, so the other side either sees it and wakes it
+ * up, or has changed the counter before the check.
+ */
+static void wait_for_change(struct ring *ring, const size_t *counter, size_t seen)
+{
+    pthread_mutex_lock(&ring->mutex);
+    __atomic_add_fetch(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == seen && !__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST) && !__atomic_load_n(&ring->cancelled, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&ring->changed, &ring->mutex);
+    __atomic_sub_fetch(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+/**
+ * Wake up the other side after changing a counter or flag,
+ * but only take the lock if it actually sleeps.
+ */
+static void wake_up(struct ring *ring)
+{
+    if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+}
+
+/**
+ * Prepare an empty ring of @p slot_count slots of @p slot_size
+ * bytes each. Returns 0 on success.
+ */
+int ring_init(struct ring *ring, size_t slot_count, size_t slot_size)
+{
+    ring->slot_count = slot_count;
+    ring->slot_size = (slot_size + RING_SLOT_ALIGNMENT - 1) / RING_SLOT_ALIGNMENT * RING_SLOT_ALIGNMENT;
+    ring->published = ring->released = 0;
+    ring->closed = ring->cancelled = ring->sleeping = 0;
+    if (posix_memalign((void **)&ring->slots, RING_SLOT_ALIGNMENT, ring->slot_count * ring->slot_size) != 0) {
+        ring->slots = NULL;
+        return 1;
+    }
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->changed, NULL);
+    return 0;
+}
+
+/**
+ * Producer: return the next free slot to fill, waiting while all
+ * slots are full. Returns NULL once the consumer has cancelled.
+ */
+void *ring_acquire(struct ring *ring)
+{
+    size_t published = __atomic_load_n(&ring->published, __ATOMIC_RELAXED);
+    for (;;) {
+        if (__atomic_load_n(&ring->cancelled, __ATOMIC_ACQUIRE))
+            return NULL;
+        size_t released = __atomic_load_n(&ring->released, __ATOMIC_ACQUIRE);
+        if (published - released < ring->slot_count)
+            return ring->slots + published % ring->slot_count * ring->slot_size;
+        wait_for_change(ring, &ring->released, released);
+    }
+}
+
+/**
+ * Producer: hand the slot returned by ring_acquire over to the consumer.
+ */
+void ring_publish(struct ring *ring)
+{
+    __atomic_store_n(&ring->published, __atomic_load_n(&ring->published, __ATOMIC_RELAXED) + 1, __ATOMIC_SEQ_CST);
+    wake_up(ring);
+}
+
+/**
+ * Producer: tell the consumer no more slots will follow.
+ */
+void ring_close(struct ring *ring)
+{
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+    wake_up(ring);
+}
+
+/**
+ * Consumer: return the oldest filled slot, waiting while there is
+ * none. Returns NULL once the ring is closed and all slots are
+ * consumed. The slot remains valid until ring_release.
+ */
+void *ring_peek(struct ring *ring)
+{
+    size_t released = __atomic_load_n(&ring->released, __ATOMIC_RELAXED);
+    for (;;) {
+        /// Closing comes after the last slot, so check it first
+        int closed = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+        size_t published = __atomic_load_n(&ring->published, __ATOMIC_ACQUIRE);
+        if (published != released)
+            return ring->slots + released % ring->slot_count * ring->slot_size;
+        if (closed)
+            return NULL;
+        wait_for_change(ring, &ring->published, published);
+    }
+}
+
+/**
+ * Consumer: give the slot returned by ring_peek back to the producer.
+ */
+void ring_release(struct ring *ring)
+{
+    __atomic_store_n(&ring->released, __atomic_load_n(&ring->released, __ATOMIC_RELAXED) + 1, __ATOMIC_SEQ_CST);
+    wake_up(ring);
+}
+
+/**
+ * Consumer: stop the producer, which gets NULL from ring_acquire
+ * from now on.
+ */
+void ring_cancel(struct ring *ring)
+{
+    __atomic_store_n(&ring->cancelled, 1, __ATOMIC_SEQ_CST);
+    wake_up(ring);
+}
+
+/**
+ * Release the slots. Both threads must be done with the ring.
+ */
+void ring_free(struct ring *ring)
+{
+    if (ring->slots == NULL)
+        return;
+    free(ring->slots);
+    ring->slots = NULL;
+    pthread_cond_destroy(&ring->changed);
+    pthread_mutex_destroy(&ring->mutex);
+}
@@ -0,0 +1,95 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_RING_H
+#define SCRIPTINTERPRETER_RING_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * Bounded queue of fixed-size slots between exactly one producing
+ * and one consuming thread. Handing a slot over takes no lock: each
+ * side only writes its own counter, with release and acquire order.
+ * Only a side that has to wait, because all slots are full or none
+ * is filled, sleeps on a condition variable, which the other side
+ * signals only if someone sleeps. A full ring makes the producer
+ * wait, so memory use is bounded by the number of slots.
+ */
+struct ring {
+    char *slots; ///< @c slot_count slots of @c slot_size bytes
+    size_t slot_count;
+    size_t slot_size;
+    size_t published; ///< slots filled by the producer so far, only written by the producer
+    size_t released; ///< slots given back by the consumer so far, only written by the consumer
+    int closed; ///< producer has published its last slot
+    int cancelled; ///< consumer is no longer interested
+    int sleeping; ///< number of threads waiting on @c changed
+    pthread_mutex_t mutex; ///< only held for sleeping and waking up
+    pthread_cond_t changed;
+};
+
+/**
+ * Prepare an empty ring of @p slot_count slots of @p slot_size
+ * bytes each. Returns 0 on success.
+ */
+int ring_init(struct ring *ring, size_t slot_count, size_t slot_size);
+
+/**
+ * Producer: return the next free slot to fill, waiting while all
+ * slots are full. Returns NULL once the consumer has cancelled.
+ */
+void *ring_acquire(struct ring *ring);
+
+/**
+ * Producer: hand the slot returned by ring_acquire over to the consumer.
+ */
+void ring_publish(struct ring *ring);
+
+/**
+ * Producer: tell the consumer no more slots will follow.
+ */
+void ring_close(struct ring *ring);
+
+/**
+ * Consumer: return the oldest filled slot, waiting while there is
+ * none. Returns NULL once the ring is closed and all slots are
+ * consumed. The slot remains valid until ring_release.
+ */
+void *ring_peek(struct ring *ring);
+
+/**
+ * Consumer: give the slot returned by ring_peek back to the producer.
+ */
+void ring_release(struct ring *ring);
+
+/**
+ * Consumer: stop the producer, which gets NULL from ring_acquire
+ * from now on.
+ */
+void ring_cancel(struct ring *ring);
+
+/**
+ * Release the slots. Both threads must be done with the ring.
+ */
+void ring_free(struct ring *ring);
+
+#endif // SCRIPTINTERPRETER_RING_H
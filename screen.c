@@ -0,0 +1,566 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "screen.h"
+#include "timingfile.h"
+
+/// Glyph of a blank cell
+static const char blank_glyph[SCREEN_GLYPH_SIZE] = { ' ' };
+
+/**
+ * Index of the first cell of @p row of the active screen
+ * in its buffers
+ */
+static size_t row_start(const struct screen *screen, int row)
+{
+    int index = screen->buffers[screen->active].top + row;
+    if (index >= screen->rows)
+        index -= screen->rows;
+    return (size_t)index * (size_t)screen->columns;
+}
+
+/**
+ * Number of bytes of the UTF-8 character starting with @p byte
+ */
+static size_t character_length(unsigned char byte)
+{
+    if (byte >= 0xf0)
+        return 4;
+    else if (byte >= 0xe0)
+        return 3;
+    else if (byte >= 0xc0)
+        return 2;
+    return 1;
+}
+
+/**
+ * Copy the glyphs of @p count cells of the active screen, starting
+ * at cell @p first of its buffers, to @p text without their padding.
+ * Returns the number of bytes copied.
+ */
+static size_t glyph_text(const struct screen *screen, size_t first, int count, char *text)
+{
+    const char *glyph = screen->buffers[screen->active].glyphs + first * SCREEN_GLYPH_SIZE;
+    size_t len = 0;
+    for (int i = 0; i < count; ++i, glyph += SCREEN_GLYPH_SIZE) {
+        size_t glyph_len = 1;
+        while (glyph_len < SCREEN_GLYPH_SIZE && glyph[glyph_len] != '\0')
+            ++glyph_len;
+        memcpy(text + len, glyph, glyph_len);
+        len += glyph_len;
+    }
+    return len;
+}
+
+/**
+ * Set @p count glyphs starting at @p glyphs to blanks
+ */
+static void blank_glyphs(char *glyphs, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        memcpy(glyphs + i * SCREEN_GLYPH_SIZE, blank_glyph, SCREEN_GLYPH_SIZE);
+}
+
+/**
+ * Set up an empty screen of @p rows by @p columns cells.
+ * Returns 0 on success.
+ */
+int screen_init(struct screen *screen, int rows, int columns)
+{
+    memset(screen, 0, sizeof(struct screen));
+    if (rows < 1 || columns < 1)
+        return 1;
+    screen->rows = rows;
+    screen->columns = columns;
+
+    size_t cells = (size_t)rows * (size_t)columns;
+    for (int i = 0; i < 2; ++i) {
+        screen->buffers[i].glyphs = (char *)malloc(cells * SCREEN_GLYPH_SIZE);
+        screen->buffers[i].attributes = (uint16_t *)malloc(cells * sizeof(uint16_t));
+        if (screen->buffers[i].glyphs == NULL || screen->buffers[i].attributes == NULL) {
+            fprintf(stderr, "Cannot allocate memory for screen\n");
+            screen_free(screen);
+            return 1;
+        }
+        blank_glyphs(screen->buffers[i].glyphs, cells);
+        for (size_t j = 0; j < cells; ++j)
+            screen->buffers[i].attributes[j] = SCREEN_DEFAULT_ATTRIBUTE;
+    }
+    screen->tab_stops = (char *)malloc((size_t)columns);
+    screen->line = (char *)malloc((size_t)columns * SCREEN_GLYPH_SIZE);
+    if (screen->tab_stops == NULL || screen->line == NULL) {
+        fprintf(stderr, "Cannot allocate memory for screen\n");
+        screen_free(screen);
+        return 1;
+    }
+    for (int i = 0; i < columns; ++i)
+        screen->tab_stops[i] = i > 0 && i % SCREEN_TAB_WIDTH == 0;
+    screen->attribute = screen->saved_attribute = SCREEN_DEFAULT_ATTRIBUTE;
+    screen->scroll_bottom = rows - 1;
+    return 0;
+}
+
+/**
+ * Release the memory held by the screen.
+ */
+void screen_free(struct screen *screen)
+{
+    for (int i = 0; i < 2; ++i) {
+        free(screen->buffers[i].glyphs);
+        free(screen->buffers[i].attributes);
+        screen->buffers[i].glyphs = NULL;
+        screen->buffers[i].attributes = NULL;
+    }
+    free(screen->tab_stops);
+    screen->tab_stops = NULL;
+    free(screen->line);
+    screen->line = NULL;
+}
+
+/**
+ * Blank @p count cells of @p row of the active screen starting
+ * at @p column, keeping the current background color.
+ */
+static void clear_cells(struct screen *screen, int row, int column, int count)
+{
+    struct screen_buffer *buffer = screen->buffers + screen->active;
+    size_t first = row_start(screen, row) + (size_t)column;
+    uint16_t attribute = (uint16_t)((screen->attribute & 0x0fc0) | SCREEN_ATTRIBUTE(9, COLOR_NORMAL, 0, 0));
+    blank_glyphs(buffer->glyphs + first * SCREEN_GLYPH_SIZE, (size_t)count);
+    for (int i = 0; i < count; ++i)
+        buffer->attributes[first + (size_t)i] = attribute;
+}
+
+/**
+ * Blank @p count complete rows starting at @p row.
+ */
+static void clear_rows(struct screen *screen, int row, int count)
+{
+    for (int i = 0; i < count; ++i)
+        clear_cells(screen, row + i, 0, screen->columns);
+}
+
+/**
+ * Move @p count cells within @p row of the active screen
+ * from column @p from to column @p to.
+ */
+static void move_cells(struct screen *screen, int row, int to, int from, int count)
+{
+    struct screen_buffer *buffer = screen->buffers + screen->active;
+    size_t start = row_start(screen, row);
+    memmove(buffer->glyphs + (start + to) * SCREEN_GLYPH_SIZE, buffer->glyphs + (start + from) * SCREEN_GLYPH_SIZE, (size_t)count * SCREEN_GLYPH_SIZE);
+    memmove(buffer->attributes + start + to, buffer->attributes + start + from, (size_t)count * sizeof(uint16_t));
+}
+
+/**
+ * Copy row @p from of the active screen over row @p to.
+ */
+static void copy_row(struct screen *screen, int to, int from)
+{
+    struct screen_buffer *buffer = screen->buffers + screen->active;
+    size_t to_start = row_start(screen, to), from_start = row_start(screen, from);
+    memcpy(buffer->glyphs + to_start * SCREEN_GLYPH_SIZE, buffer->glyphs + from_start * SCREEN_GLYPH_SIZE, (size_t)screen->columns * SCREEN_GLYPH_SIZE);
+    memcpy(buffer->attributes + to_start, buffer->attributes + from_start, (size_t)screen->columns * sizeof(uint16_t));
+}
+
+/**
+ * Remove @p count rows starting at @p row, moving the rows
+ * below up and adding blank rows at the bottom of the
+ * scroll region.
+ */
+static void delete_rows(struct screen *screen, int row, int count)
+{
+    int end = screen->scroll_bottom + 1;
+    if (count > end - row)
+        count = end - row;
+    if (row == 0 && end == screen->rows) {
+        /// Scrolling the whole screen, only the ring's start moves
+        struct screen_buffer *buffer = screen->buffers + screen->active;
+        buffer->top = (buffer->top + count) % screen->rows;
+    } else
+        for (int i = row; i < end - count; ++i)
+            copy_row(screen, i, i + count);
+    clear_rows(screen, end - count, count);
+}
+
+/**
+ * Insert @p count blank rows at @p row, moving the rows
+ * below down and dropping those at the bottom of the
+ * scroll region.
+ */
+static void insert_rows(struct screen *screen, int row, int count)
+{
+    int end = screen->scroll_bottom + 1;
+    if (count > end - row)
+        count = end - row;
+    for (int i = end - 1; i >= row + count; --i)
+        copy_row(screen, i, i - count);
+    clear_rows(screen, row, count);
+}
+
+/**
+ * Move the cursor down one row, scrolling the scroll region
+ * up at its bottom.
+ */
+static void line_feed(struct screen *screen)
+{
+    if (screen->row == screen->scroll_bottom)
+        delete_rows(screen, screen->scroll_top, 1);
+    else if (screen->row < screen->rows - 1)
+        ++screen->row;
+}
+
+/**
+ * Move the cursor, keeping it on the screen.
+ */
+static void move_cursor(struct screen *screen, int row, int column)
+{
+    screen->row = row < 0 ? 0 : (row >= screen->rows ? screen->rows - 1 : row);
+    screen->column = column < 0 ? 0 : (column >= screen->columns ? screen->columns - 1 : column);
+    screen->wrap_pending = 0;
+}
+
+/**
+ * Move the cursor to the next tab stop, or the last column if
+ * there is none, or back to the previous one, or the first column.
+ */
+static void tabulate(struct screen *screen, int forward)
+{
+    int column = screen->column;
+    if (forward)
+        do
+            ++column;
+        while (column < screen->columns - 1 && !screen->tab_stops[column]);
+    else
+        do
+            --column;
+        while (column > 0 && !screen->tab_stops[column]);
+    move_cursor(screen, screen->row, column);
+}
+
+/**
+ * Write @p len bytes of printable UTF-8 text at the cursor, one
+ * character per cell, wrapping at the end of the row.
+ */
+static void write_text(struct screen *screen, const char *text, size_t len)
+{
+    struct screen_buffer *buffer = screen->buffers + screen->active;
+    while (len > 0) {
+        if (screen->wrap_pending) {
+            screen->wrap_pending = 0;
+            screen->column = 0;
+            line_feed(screen);
+        }
+
+        size_t cell = row_start(screen, screen->row) + (size_t)screen->column;
+        char *glyph = buffer->glyphs + cell * SCREEN_GLYPH_SIZE;
+        size_t count = character_length((unsigned char)*text);
+        if (count > len)
+            count = len;
+        memcpy(glyph, text, count);
+        memset(glyph + count, 0, SCREEN_GLYPH_SIZE - count);
+        buffer->attributes[cell] = screen->attribute;
+        text += count;
+        len -= count;
+
+        if (++screen->column == screen->columns) {
+            screen->column = screen->columns - 1;
+            screen->wrap_pending = 1;
+        }
+    }
+}
+
+/**
+ * Apply an ED or EL control sequence
+ */
+static void erase(struct screen *screen, int kind, int range)
+{
+    if (range == ERASE_CUR_TO_END)
+        clear_cells(screen, screen->row, screen->column, screen->columns - screen->column);
+    else if (range == ERASE_BEGIN_TO_CUR)
+        clear_cells(screen, screen->row, 0, screen->column + 1);
+    else
+        clear_cells(screen, screen->row, 0, screen->columns);
+
+    if (kind == ERASE_IN_PAGE) {
+        if (range != ERASE_CUR_TO_END)
+            clear_rows(screen, 0, screen->row);
+        if (range != ERASE_BEGIN_TO_CUR)
+            clear_rows(screen, screen->row + 1, screen->rows - screen->row - 1);
+    }
+}
+
+/**
+ * Insert, delete or erase cells or rows at the cursor
+ */
+static void edit(struct screen *screen, int kind, int count)
+{
+    int room = screen->columns - screen->column;
+    if (kind == EDIT_SCROLL_UP || kind == EDIT_SCROLL_DOWN) {
+        if (kind == EDIT_SCROLL_UP)
+            delete_rows(screen, screen->scroll_top, count);
+        else
+            insert_rows(screen, screen->scroll_top, count);
+        return;
+    }
+    if (kind == EDIT_INSERT_LINES || kind == EDIT_DELETE_LINES) {
+        /// Rows outside of the scroll region stay as they are
+        if (screen->row < screen->scroll_top || screen->row > screen->scroll_bottom)
+            return;
+        if (kind == EDIT_INSERT_LINES)
+            insert_rows(screen, screen->row, count);
+        else
+            delete_rows(screen, screen->row, count);
+        move_cursor(screen, screen->row, 0);
+        return;
+    }
+    if (kind == EDIT_SCROLL_LEFT || kind == EDIT_SCROLL_RIGHT) {
+        /// Whole rows of the scroll region, no matter where the cursor is
+        if (count > screen->columns)
+            count = screen->columns;
+        for (int row = screen->scroll_top; row <= screen->scroll_bottom; ++row)
+            if (kind == EDIT_SCROLL_LEFT) {
+                move_cells(screen, row, 0, count, screen->columns - count);
+                clear_cells(screen, row, screen->columns - count, count);
+            } else {
+                move_cells(screen, row, count, 0, screen->columns - count);
+                clear_cells(screen, row, 0, count);
+            }
+        return;
+    }
+
+    if (count > room)
+        count = room;
+    int column = screen->column;
+    if (kind == EDIT_INSERT_CHARACTERS) {
+        move_cells(screen, screen->row, column + count, column, room - count);
+        clear_cells(screen, screen->row, column, count);
+    } else if (kind == EDIT_DELETE_CHARACTERS) {
+        move_cells(screen, screen->row, column, column + count, room - count);
+        clear_cells(screen, screen->row, screen->columns - count, count);
+    } else
+        clear_cells(screen, screen->row, column, count);
+    screen->wrap_pending = 0;
+}
+
+/**
+ * Event sink callback applying @p event to the struct screen
+ * passed as @p context.
+ */
+void screen_event(void *context, const struct event *event)
+{
+    struct screen *screen = (struct screen *)context;
+
+    switch (event->type) {
+    case EVENT_TEXT:
+        write_text(screen, event->text, event->length);
+        break;
+    case EVENT_NEWLINE:
+        if (event->kind != NEWLINE_LF)
+            screen->column = 0;
+        if (event->kind != NEWLINE_CR)
+            line_feed(screen);
+        screen->wrap_pending = 0;
+        break;
+    case EVENT_CURSOR:
+        switch (event->kind) {
+        case CURSOR_POSITION:
+            move_cursor(screen, event->row - 1, event->column - 1);
+            break;
+        case CURSOR_MOVE:
+            move_cursor(screen, screen->row + event->row, screen->column + event->column);
+            break;
+        case CURSOR_ROW:
+            move_cursor(screen, event->row - 1, screen->column);
+            break;
+        case CURSOR_COLUMN:
+            move_cursor(screen, screen->row, event->column - 1);
+            break;
+        case CURSOR_TAB:
+        case CURSOR_BACKTAB:
+            tabulate(screen, event->kind == CURSOR_TAB);
+            break;
+        case CURSOR_TAB_SET:
+            screen->tab_stops[screen->column] = 1;
+            break;
+        case CURSOR_TAB_CLEAR:
+            if (event->value)
+                memset(screen->tab_stops, 0, (size_t)screen->columns);
+            else
+                screen->tab_stops[screen->column] = 0;
+            break;
+        case CURSOR_SAVE:
+            screen->saved_row = screen->row;
+            screen->saved_column = screen->column;
+            screen->saved_attribute = screen->attribute;
+            break;
+        case CURSOR_RESTORE:
+            move_cursor(screen, screen->saved_row, screen->saved_column);
+            screen->attribute = screen->saved_attribute;
+            break;
+        case CURSOR_SHOW:
+            screen->cursor_hidden = !event->value;
+            break;
+        default:
+            break;
+        }
+        break;
+    case EVENT_ERASE:
+        erase(screen, event->kind, event->value);
+        break;
+    case EVENT_EDIT:
+        edit(screen, event->kind, event->value);
+        break;
+    case EVENT_SCROLL_REGION: {
+        /// DECSTBM, an invalid region resets it to the whole screen
+        int top = event->row > 0 ? event->row - 1 : 0;
+        int bottom = event->value > 0 && event->value <= screen->rows ? event->value - 1 : screen->rows - 1;
+        screen->scroll_top = top < bottom ? top : 0;
+        screen->scroll_bottom = top < bottom ? bottom : screen->rows - 1;
+        break;
+    }
+    case EVENT_COLOR:
+        if (event->kind == COLOR_RESET)
+            screen->attribute = SCREEN_DEFAULT_ATTRIBUTE;
+        else if (event->kind == COLOR_FOREGROUND)
+            screen->attribute = (uint16_t)((screen->attribute & ~0x003f) | SCREEN_ATTRIBUTE(event->value, event->intensity, 0, 0));
+        else
+            screen->attribute = (uint16_t)((screen->attribute & ~0x0fc0) | SCREEN_ATTRIBUTE(0, 0, event->value, event->intensity));
+        break;
+    case EVENT_SCREEN:
+        if (event->value != 0 && screen->active == 0) {
+            /// Alternate screen starts out empty
+            screen->active = 1;
+            clear_rows(screen, 0, screen->rows);
+        } else if (event->value == 0)
+            screen->active = 0;
+        break;
+    case EVENT_OSC: {
+        size_t len = event->length < SCREEN_TITLE_SIZE - 1 ? event->length : SCREEN_TITLE_SIZE - 1;
+        /// A longer title is cut before the character that does not fit
+        if (len < event->length)
+            while (len > 0 && ((unsigned char)event->text[len] & 0xc0) == 0x80)
+                --len;
+        memcpy(screen->title, event->text, len);
+        screen->title[len] = '\0';
+    }
+    break;
+    default:
+        break;
+    }
+
+    if (screen->next.event != NULL)
+        event_emit(&screen->next, event);
+}
+
+/**
+ * Write the foreground and background of @p attribute as
+ * XML attributes, like in <color> elements.
+ */
+static void write_colors(struct xmloutput *output, uint16_t attribute)
+{
+    xmloutput_printf(output, " foreground=\"%s-%s\" background=\"%s-%s\"", event_intensity_name((attribute >> 4) & 3), event_color_name(attribute & 15),
+                     event_intensity_name((attribute >> 10) & 3), event_color_name((attribute >> 6) & 15));
+}
+
+/**
+ * Write the complete state of the terminal as a <keyframe> element
+ * for recording time @p time (in microseconds) to @p output: cursor,
+ * current colors, active screen, window title and the non-blank rows
+ * of the screen with their colors.
+ */
+void screen_write_keyframe(const struct screen *screen, struct xmloutput *output, long long time)
+{
+    char seconds[24];
+    timing_format_delay(seconds, time);
+    xmloutput_printf(output, "<keyframe time=\"%s\" screen=\"%d\" absoluterow=\"%d\" absolutecolumn=\"%d\" show=\"%s\"",
+                     seconds, screen->active, screen->row + 1, screen->column + 1, screen->cursor_hidden ? "false" : "true");
+    write_colors(output, screen->attribute);
+    xmloutput_puts(output, ">\n");
+    if (screen->title[0] != '\0') {
+        xmloutput_puts(output, "<osc type=\"windowtitle\">");
+        xmloutput_escaped(output, screen->title, strlen(screen->title));
+        xmloutput_puts(output, "</osc>\n");
+    }
+
+    const struct screen_buffer *buffer = screen->buffers + screen->active;
+    for (int row = 0; row < screen->rows; ++row) {
+        size_t start = row_start(screen, row);
+        const char *glyphs = buffer->glyphs + start * SCREEN_GLYPH_SIZE;
+        const uint16_t *attributes = buffer->attributes + start;
+        /// Blanks in default colors at the end of the row are left out
+        int len = screen->columns;
+        while (len > 0 && memcmp(glyphs + (size_t)(len - 1) * SCREEN_GLYPH_SIZE, blank_glyph, SCREEN_GLYPH_SIZE) == 0 &&
+               attributes[len - 1] == SCREEN_DEFAULT_ATTRIBUTE)
+            --len;
+        if (len == 0)
+            continue;
+
+        xmloutput_printf(output, "<row number=\"%d\">", row + 1);
+        for (int run = 0; run < len;) {
+            /// Runs of cells with the same colors
+            int run_end = run + 1;
+            while (run_end < len && attributes[run_end] == attributes[run])
+                ++run_end;
+            size_t text_len = glyph_text(screen, start + (size_t)run, run_end - run, screen->line);
+            if (attributes[run] == SCREEN_DEFAULT_ATTRIBUTE)
+                xmloutput_escaped(output, screen->line, text_len);
+            else {
+                xmloutput_puts(output, "<span");
+                write_colors(output, attributes[run]);
+                xmloutput_puts(output, ">");
+                xmloutput_escaped(output, screen->line, text_len);
+                xmloutput_puts(output, "</span>");
+            }
+            run = run_end;
+        }
+        xmloutput_puts(output, "</row>\n");
+    }
+    xmloutput_puts(output, "</keyframe>\n");
+}
+
+/**
+ * Write the text currently shown to @p file, preceded by a line
+ * naming @p time (in microseconds), the screen, the cursor position
+ * and the window title. Trailing blanks of each row are dropped.
+ * Returns 0 on success.
+ */
+int screen_write(const struct screen *screen, FILE *file, long long time)
+{
+    char seconds[24];
+    timing_format_delay(seconds, time);
+    fprintf(file, "--- %s s: %s screen, cursor at %d;%d%s, title \"%s\" ---\n", seconds, screen->active ? "alternate" : "primary",
+            screen->row + 1, screen->column + 1, screen->cursor_hidden ? " (hidden)" : "", screen->title);
+
+    for (int row = 0; row < screen->rows; ++row) {
+        size_t start = row_start(screen, row);
+        const char *glyphs = screen->buffers[screen->active].glyphs + start * SCREEN_GLYPH_SIZE;
+        int len = screen->columns;
+        while (len > 0 && memcmp(glyphs + (size_t)(len - 1) * SCREEN_GLYPH_SIZE, blank_glyph, SCREEN_GLYPH_SIZE) == 0)
+            --len;
+        fwrite(screen->line, 1, glyph_text(screen, start, len, screen->line), file);
+        fputc('\n', file);
+    }
+    return ferror(file) ? 1 : 0;
+}
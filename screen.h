@@ -0,0 +1,119 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_SCREEN_H
+#define SCRIPTINTERPRETER_SCREEN_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "events.h"
+#include "xmloutput.h"
+
+#define SCREEN_DEFAULT_ROWS 24
+#define SCREEN_DEFAULT_COLUMNS 80
+#define SCREEN_TITLE_SIZE 256
+/// Bytes of a cell's glyph, the longest UTF-8 character
+#define SCREEN_GLYPH_SIZE 4
+/// Distance between the tab stops of a fresh screen
+#define SCREEN_TAB_WIDTH 8
+
+/**
+ * Display attributes of a cell packed into 16 bits: foreground
+ * color in bits 0-3, its intensity in bits 4-5, background color
+ * in bits 6-9 and its intensity in bits 10-11. Colors are numbered
+ * like in struct event.
+ */
+#define SCREEN_ATTRIBUTE(foreground, foreground_intensity, background, background_intensity) \
+    ((uint16_t)((foreground) | (foreground_intensity) << 4 | (background) << 6 | (background_intensity) << 10))
+#define SCREEN_DEFAULT_ATTRIBUTE SCREEN_ATTRIBUTE(9, COLOR_NORMAL, 9, COLOR_NORMAL)
+
+/**
+ * Contents of one screen. Glyphs and attributes are kept in two
+ * arrays of @c rows * @c columns cells, row after row, so that
+ * writing, erasing and rendering a row work on contiguous memory.
+ * Each glyph is one UTF-8 character in SCREEN_GLYPH_SIZE bytes,
+ * padded with null bytes.
+ * The rows form a ring starting at @c top, scrolling up just
+ * moves @c top instead of the cells.
+ */
+struct screen_buffer {
+    char *glyphs;
+    uint16_t *attributes;
+    int top; ///< row in the arrays shown as the first row
+};
+
+/**
+ * Terminal emulation driven by the parser's events, keeping what
+ * is currently on the primary and on the alternate screen.
+ * Events are passed on to @c next, if set.
+ */
+struct screen {
+    int rows, columns;
+    struct screen_buffer buffers[2]; ///< primary and alternate screen
+    int active; ///< index of the screen shown in @c buffers
+    int row, column; ///< cursor position, starting at 0
+    int wrap_pending; ///< last column was written, next character goes to the next line
+    int scroll_top, scroll_bottom; ///< first and last row of the scroll region, starting at 0
+    int saved_row, saved_column;
+    uint16_t attribute; ///< attributes for characters written next
+    uint16_t saved_attribute;
+    int cursor_hidden;
+    char *tab_stops; ///< 1 for every column with a tab stop, shared by both screens
+    char title[SCREEN_TITLE_SIZE]; ///< window title set by OSC, null-terminated
+    char *line; ///< room for the text of one row when writing it out
+    struct event_sink next; ///< events are not passed on if @c next.event is NULL
+};
+
+/**
+ * Set up an empty screen of @p rows by @p columns cells.
+ * Returns 0 on success.
+ */
+int screen_init(struct screen *screen, int rows, int columns);
+
+/**
+ * Release the memory held by the screen.
+ */
+void screen_free(struct screen *screen);
+
+/**
+ * Event sink callback applying @p event to the struct screen
+ * passed as @p context.
+ */
+void screen_event(void *context, const struct event *event);
+
+/**
+ * Write the text currently shown to @p file, preceded by a line
+ * naming @p time (in microseconds), the screen, the cursor position
+ * and the window title. Trailing blanks of each row are dropped.
+ * Returns 0 on success.
+ */
+int screen_write(const struct screen *screen, FILE *file, long long time);
+
+/**
+ * Write the complete state of the terminal as a <keyframe> element
+ * for recording time @p time (in microseconds) to @p output: cursor,
+ * current colors, active screen, window title and the non-blank rows
+ * of the screen with their colors.
+ */
+void screen_write_keyframe(const struct screen *screen, struct xmloutput *output, long long time);
+
+#endif // SCRIPTINTERPRETER_SCREEN_H
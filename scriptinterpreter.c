@@ -19,691 +19,1554 @@ along with ScriptInterpreter.
 If not, see <http://www.gnu.org/licenses/>.
 ********************************************************************/
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binaryoutput.h"
+#include "compressedinput.h"
+#include "compressedoutput.h"
+#include "events.h"
+#include "follow.h"
+#include "jsonevents.h"
+#include "parser.h"
+#include "pipelinedoutput.h"
+#include "recording.h"
+#include "screen.h"
+#include "seekindex.h"
+#include "textindex.h"
+#include "stats.h"
+#include "timingfile.h"
+#include "typescriptinput.h"
 #include "utils.h"
+#include "xmlevents.h"
+#include "xmloutput.h"
 
 #define BUFFER_SIZE 1024
-#define ARRAY_LENGTH 256
+/// Amount of typescript to be parsed by one thread at a time in parallel mode
+#define PARALLEL_SEGMENT_SIZE (1 << 20)
+
+/// When to pass buffered XML output on to the output file
+enum flush_mode {
+    FLUSH_FULL, ///< only if the buffer is full
+    FLUSH_LATENCY, ///< at the latest after @c latency milliseconds
+    FLUSH_STEP ///< after every timestep
+};
+
+/// What to write to the output file
+enum output_format {
+    FORMAT_XML,
+    FORMAT_BINARY, ///< binary event file, see eventfile.h
+    FORMAT_JSON ///< one JSON object per line and event, see jsonevents.h
+};
 
-size_t typescriptbuffer_size;
-char *typescriptbuffer;
-int debug_output;
+/**
+ * Everything about the conversion of one recording: the options
+ * it is converted with, its files and the state of the conversion.
+ * Jobs share nothing, so several of them may run at the same time.
+ */
+struct job {
+    int debug_output;
+    enum parser_invalid_utf8 invalid_utf8; ///< policy for bytes that are not valid UTF-8
+
+    struct recording recording; ///< timing and typescript file
+    struct timing_table table; ///< steps of the timing file, its memory is kept for the next job
+    int use_mmap;
+
+    struct xmloutput xmloutput; ///< buffered output file, no matter the format, its buffer is kept for the next job
+    enum output_format output_format;
+    struct binaryoutput binaryoutput;
+    struct jsonevents jsonevents;
+    struct event_sink output_sink; ///< writes events in @c output_format to @c xmloutput
+    struct stats *stats; ///< counters for --stats, NULL if none are collected
+    struct stats_counter stats_counter; ///< @c output_sink as it is before counting events for --stats
+    int output_compression; ///< compression of the XML output, see enum compression
+    int compress_level, compress_threads, compress_seekable;
+    struct compressed_output compressedoutput;
+
+    enum flush_mode flush_mode;
+    int latency; ///< upper bound in milliseconds for holding back output
+    long unflushed_since; ///< time when unflushed output was written first, or -1
+
+    int follow_mode; ///< convert the recording while it is still being written
+    struct follow follow;
+
+    int threads; ///< number of threads parsing the typescript
+    int pipeline; ///< read, parse and write on separate threads
+    struct pipelined_output pipelinedoutput;
+
+    const char *index_filename; ///< seek index to write, or to read when seeking
+    struct seekindex_writer indexwriter;
+    struct seekindex seekindex; ///< index read for seeking, @c map is NULL if none
+    long long seek_time; ///< recording time in microseconds to start output at, or -1
+    long long recording_time; ///< sum of the delays of all steps so far in microseconds
+    long long from_time; ///< recording time in microseconds to start output at without parsing what is before, or -1
+    long long to_time; ///< recording time in microseconds after which conversion stops, or -1
+    int clip_start; ///< output is about to start in the middle of the recording, with a fresh parser
+    struct seekindex_tracker tracker; ///< display attributes for the index or for seeking
+
+    const char *text_index_filename; ///< text index to append the recording's text to, or NULL
+    struct textindex_builder textindex; ///< text collected for the text index, its memory is kept for the next job
+
+    int use_screen; ///< run events through @c screen, for snapshots or keyframes
+    const char *screen_filename; ///< where to write screen snapshots, "-" for stdout
+    int screen_rows, screen_columns;
+    FILE *screenfile; ///< @c screen_filename opened, NULL if no snapshots are wanted
+    struct screen screen; ///< terminal emulation for snapshots and keyframes
+    long long *screen_times; ///< recording times in microseconds for snapshots, ascending
+    size_t screen_time_count, next_screen_time;
+
+    long long keyframe_interval; ///< recording time in microseconds between keyframes, 0 if not by time
+    size_t keyframe_bytes; ///< typescript bytes between keyframes, 0 if not by size
+    long long last_keyframe_time;
+    size_t last_keyframe_position; ///< typescript offset of the step after the last keyframe
+};
 
-FILE *timefile, *typescriptfile, *xmloutputfile;
+/**
+ * Milliseconds from a monotonic clock
+ */
+static long monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 /**
- * Parses a string containing a semicolon-separated list
- * of numbers (example: '51;66;38') into an array of
- * integers like [51, 66, 38].
- * @param arraystring string containing a a semicolon-separated list of numbers
- * @param len maximum length of @p arraystring
- * @param array array of integers to write the result to; length limited by @p arraylen
- * @param arraylen maximum number of elements in @p array
+ * Apply the flush policy after a complete timestep has been written.
  */
-int parameterstring_to_intarray(char *arraystring, int len, int *array, int arraylen)
+static void timestep_written(struct job *job)
 {
-    int arraypos = 0;
-    /// While there are characters left to read from the array string
-    /// and there are empty positions left in the result array ...
-    while (len > 0 && arraypos < arraylen) {
-        int declen = len; ///< maximum length of next number to be read from string
-        /// Read number from string, updates declen to number of characters actually read
-        int dec = ascii_to_dec(arraystring, &declen);
-        /// Negative value for dec is error condition (return that), else it is read number
-        if (dec < 0) return dec;
-        /// Step forward in array string for length of read number
-        arraystring += declen;
-        /// Decrease number of chars left by string length of read number
-        len -= declen;
-        /// Store read number in next available position of integer result array
-        array[arraypos++] = dec;
-        /// If next character in array string is not a semicolon,
-        /// then there are no more numbers to read
-        if (*arraystring != ';') break;
-        /// Step forward over semicolon
-        ++arraystring;
-        /// Decrease number of chars left by one (for the semicolon)
-        --len;
-    }
-
-    /// If there is an empty spot left in the integer result array ...
-    if (arraypos < arraylen)
-        /// ... write -1 to denote a "terminator"
-        array[arraypos] = -1;
-
-    /// Return number of read numbers
-    return arraypos;
+    if (job->stats != NULL && job->xmloutput.length > job->stats->output_buffer_bytes)
+        job->stats->output_buffer_bytes = job->xmloutput.length;
+    if (job->flush_mode == FLUSH_STEP)
+        xmloutput_flush(&job->xmloutput);
+    else if (job->flush_mode == FLUSH_LATENCY) {
+        long now = monotonic_ms();
+        if (job->unflushed_since < 0)
+            job->unflushed_since = now;
+        else if (now - job->unflushed_since >= job->latency) {
+            xmloutput_flush(&job->xmloutput);
+            job->unflushed_since = -1;
+        }
+    }
 }
 
 /**
- * The name (as a string) of a color corresponding to its
- * numeric value will be written into the result string.
- * Example strings written to the result string include
- * 'red' or 'blue'. For valid color codes, the function
- * will return 0. For invalid color codes, the return
- * value is 1 and the text 'unknown' will be written
- * into the result string.
+ * In follow mode, decide if 'script' has finished the recording:
+ * either it has closed the timing file, it has appended its
+ * closing "Script done" line after the last step's bytes, or
+ * it is gone without doing either (see follow_abandoned).
  */
-int colortostring(int color, char *result, int resultlen)
+static int recording_ended(struct job *job)
 {
-    switch (color % 10) {
-    case 0:
-        snprintf(result, resultlen, "black");
-        return 0;
-    case 1:
-        snprintf(result, resultlen, "red");
-        return 0;
-    case 2:
-        snprintf(result, resultlen, "green");
-        return 0;
-    case 3:
-        snprintf(result, resultlen, "yellow");
-        return 0;
-    case 4:
-        snprintf(result, resultlen, "blue");
-        return 0;
-    case 5:
-        snprintf(result, resultlen, "magenta");
-        return 0;
-    case 6:
-        snprintf(result, resultlen, "cyan");
-        return 0;
-    case 7:
-        snprintf(result, resultlen, "white");
-        return 0;
-    case 9:
-        snprintf(result, resultlen, "default");
-        return 0;
-    default:
-        snprintf(result, resultlen, "unknown");
+    static const char trailer[] = "\nScript done";
+    char buffer[sizeof(trailer) - 1];
+
+    if (job->follow.writer_closed)
         return 1;
-    }
+    long offset = ftell(job->recording.typescriptfile);
+    if (offset >= 0 && pread(fileno(job->recording.typescriptfile), buffer, sizeof(buffer), offset) == (ssize_t)sizeof(buffer) && memcmp(buffer, trailer, sizeof(buffer)) == 0)
+        return 1;
+    return follow_abandoned(&job->follow);
 }
 
-int process_controlsequence(char final_byte, char *intermediate_bytes, char *parameter_bytes)
+/**
+ * In follow mode, wait for 'script' to write more data.
+ * Everything converted so far is flushed before waiting.
+ */
+static void wait_for_data(struct job *job)
 {
-    char buffer[BUFFER_SIZE];
-
-    switch (final_byte) {
-    case 0x48: {
-        int row = 1, col = 1;
-        if (*parameter_bytes != 0) {
-            int len = 0;
-            while (*parameter_bytes != ';' && *parameter_bytes != 0) buffer[len++] = *parameter_bytes++;
-            buffer[len++] = 0;
-            row = ascii_to_dec(buffer, &len);
-            col = 1;
-            if (*parameter_bytes == ';') {
-                parameter_bytes++;
-                len = 0;
-                while (*parameter_bytes != 0) buffer[len++] = *parameter_bytes++;
-                buffer[len++] = 0;
-                col = ascii_to_dec(buffer, &len);
-            }
+    xmloutput_flush(&job->xmloutput);
+    job->unflushed_since = -1;
+    clearerr(job->recording.timefile);
+    clearerr(job->recording.typescriptfile);
+    follow_wait(&job->follow, job->latency);
+}
+
+/**
+ * Read one complete line from the timing file into @p line.
+ * In follow mode, wait for the writer to complete partial lines.
+ * Returns 0 on success, 1 at the end of the timing file and
+ * 2 on error.
+ */
+static int read_timingline(struct job *job, char *line, int size)
+{
+    int len = 0;
+    for (;;) {
+        if (fgets(line + len, size - len, job->recording.timefile) != NULL) {
+            len += strlen(line + len);
+            if (line[len - 1] == '\n')
+                return 0;
+            if (len == size - 1)
+                return 2; ///< line too long
         }
-        if (debug_output) fprintf(stderr, "Moving cursor to position row=%d, column=%d\n", row, col);
-        fprintf(xmloutputfile, "<cursor absoluterow=\"%d\" absolutecolumn=\"%d\" />\n", row, col);
+        if (ferror(job->recording.timefile))
+            return 2;
+        /// End of timing file reached
+        if (!job->follow_mode || recording_ended(job))
+            return len > 0 ? 0 : 1;
+        wait_for_data(job);
     }
-    return 0;
-    case 0x4a: {
-        /// ED -- Erase in Page (see 8.3.39 in ECMA-48 1991)
-        int len = 1;
-        int param = ascii_to_dec(parameter_bytes, &len);
-        if (len == 0) {
-            /// No parameter provided, assuming default value param=0
-            param = 0;
-            len = 1;
-        }
+}
 
-        if (len == 1) {
-            if (debug_output) fprintf(stderr, "Control Sequence: Erase in Page (param=%d)\n", param);
-            fprintf(xmloutputfile, "<erase scope=\"in_page\" range=\"%s\" />\n", param == 0 ? "cur_to_end" : (param == 1 ? "begin_to_cur" : "all"));
-        } else {
-            if (debug_output) fprintf(stderr, "Invalid len: %d\n", len);
+/**
+ * Read the next line from the timing file while it is still being
+ * written and extract its delay in microseconds and number of bytes.
+ * @p line_nr counts the lines read so far, @p line_offset is set to
+ * the position of the line in the timing file.
+ * Returns 0 on success, 1 at the end of the timing file and
+ * 2 on error.
+ */
+static int next_timingstep(struct job *job, size_t *line_nr, size_t *line_offset, long long *delay, size_t *blk)
+{
+    char line[BUFFER_SIZE];
+    for (;;) {
+        ++*line_nr;
+        long position = ftell(job->recording.timefile);
+        *line_offset = position > 0 ? (size_t)position : 0;
+        int lineret = read_timingline(job, line, BUFFER_SIZE);
+        if (lineret == 1)
             return 1;
+
+        size_t len = lineret == 0 ? strlen(line) : 0;
+        if (len > 0 && line[len - 1] == '\n')
+            --len;
+        int parseret = lineret == 0 ? timing_parse_line(line, len, delay, blk) : -1;
+        if (parseret == 1)
+            continue; ///< empty line
+        if (parseret != 0) {
+            fprintf(stderr, "Error while reading timimg file: unexpected format in line %zu\n", *line_nr);
+            return 2;
         }
+        return 0;
     }
-    return 0;
-    case 0x4b: {
-        /// EL -- Erase in Line (see 8.3.41 in ECMA-48 1991)
-        int len = 1;
-        int param = ascii_to_dec(parameter_bytes, &len);
-        if (len == 0) {
-            /// No parameter provided, assuming default value param=0
-            param = 0;
-            len = 1;
-        }
+}
 
-        if (len == 1) {
-            if (debug_output) fprintf(stderr, "Control Sequence: Erase in Page (param=%d)\n", param);
-            fprintf(xmloutputfile, "<erase scope=\"in_line\" range=\"%s\" />\n", param == 0 ? "cur_to_end" : (param == 1 ? "begin_to_cur" : "all"));
-        } else {
-            if (debug_output) fprintf(stderr, "Invalid len: %d\n", len);
+/**
+ * Start a timing step of @p delay microseconds found in timing
+ * file line @p line at @p timing_offset. Add an entry to the seek
+ * index if one is due and, when seeking, start passing events on
+ * to the output once the requested time is reached.
+ */
+static void begin_timestep(struct job *job, struct parser_state *state, long long delay, size_t line, size_t timing_offset)
+{
+    /// Snapshots of the screen as it was before this step appeared
+    while (job->next_screen_time < job->screen_time_count && job->screen_times[job->next_screen_time] < job->recording_time + delay)
+        screen_write(&job->screen, job->screenfile, job->screen_times[job->next_screen_time++]);
+
+    if (job->index_filename != NULL && job->seek_time < 0 && state->mode == MODE_GROUND && state->utf8_pending_len == 0 && seekindex_due(&job->indexwriter, job->recording_time, job->recording.typescript.position)) {
+        struct seekindex_entry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.time = job->recording_time;
+        entry.line = line;
+        entry.timing_offset = timing_offset;
+        entry.typescript_offset = job->recording.typescript.position;
+        entry.output_offset = xmloutput_position(&job->xmloutput);
+        entry.attributes = job->tracker.attributes;
+        entry.pending_cr = (uint8_t)state->pending_cr;
+        entry.rendition = state->rendition;
+        entry.last_character_len = (uint8_t)state->last_character_len;
+        memcpy(entry.last_character, state->last_character, sizeof(entry.last_character));
+        seekindex_add(&job->indexwriter, &entry);
+    }
+
+    /// Keyframes go between timesteps; an index entry for the same
+    /// step points at the keyframe, not at the timestep
+    if ((job->keyframe_interval > 0 || job->keyframe_bytes > 0) && (job->seek_time < 0 || job->tracker.next.event != NULL)
+            && ((job->keyframe_interval > 0 && job->recording_time - job->last_keyframe_time >= job->keyframe_interval)
+                || (job->keyframe_bytes > 0 && job->recording.typescript.position - job->last_keyframe_position >= job->keyframe_bytes))) {
+        screen_write_keyframe(&job->screen, &job->xmloutput, job->recording_time);
+        job->last_keyframe_time = job->recording_time;
+        job->last_keyframe_position = job->recording.typescript.position;
+    }
+
+    job->recording_time += delay;
+    if (job->seek_time >= 0 && job->tracker.next.event == NULL && job->recording_time >= job->seek_time) {
+        /// First step to be written, bring attributes up to date within it
+        job->tracker.next = job->output_sink;
+        if (job->output_format == FORMAT_JSON)
+            job->jsonevents.time = job->recording_time - delay; ///< times as if nothing was left out
+        event_emit_timestep(&job->output_sink, delay);
+        seekindex_restore(&job->tracker.attributes, &job->output_sink);
+        return;
+    }
+    event_emit_timestep(&state->sink, delay);
+    if (job->clip_start) {
+        /// Whatever colors were set before are unknown to the parser,
+        /// readers start over from the defaults like it does
+        struct event reset = { .type = EVENT_COLOR, .kind = COLOR_RESET };
+        event_emit(&state->sink, &reset);
+        job->clip_start = 0;
+    }
+}
+
+/**
+ * Read and parse the bytes of one timing step.
+ * @param state parser state, kept across steps
+ * @param expected_size Number of bytes describing the event of the current step
+ */
+int process_typescript_step(struct job *job, struct parser_state *state, size_t expected_size)
+{
+    int ret = 0;
+    if (job->stats != NULL)
+        stats_count_step(job->stats, expected_size);
+
+    /// Get as many bytes from the typescript files as are expected
+    /// to describe the current step's events; with a memory-mapped
+    /// typescript this is a pointer into the mapping, not a copy,
+    /// otherwise the step is read in chunks of bounded size
+    for (size_t left = expected_size; ret == 0 && left > 0;) {
+        size_t rlen;
+        stats_enter(job->stats, STATS_READ);
+        const char *typescriptbuffer = typescript_input_next(&job->recording.typescript, left, &rlen);
+        stats_enter(job->stats, STATS_OTHER);
+        if (typescriptbuffer == NULL)
+            return 1;
+        if (rlen == 0) {
+            if (job->follow_mode && !job->follow.writer_closed) {
+                /// 'script' has not written all of this step's bytes yet
+                wait_for_data(job);
+                continue;
+            }
+            fprintf(stderr, "Expected to read %zu bytes from typescript file, got only %zu\n", expected_size, expected_size - left);
             return 1;
         }
+        left -= rlen;
+
+        stats_enter(job->stats, STATS_CLASSIFY);
+        ret = parse_typescript(state, typescriptbuffer, rlen);
+        stats_enter(job->stats, STATS_OTHER);
     }
-    return 0;
-    case 0x68:
-        if (intermediate_bytes[0] == 0) {
-            /// SM -- Set Mode (see 8.3.125 in ECMA-48 1991)
-            if (debug_output) fprintf(stderr, "Control Sequence: Set Mode (parameter length=%zu, intermediate length=%zu)\n", strlen(parameter_bytes), strlen(intermediate_bytes));
-
-            int dec_mode = 0;
-            if (*parameter_bytes == 0x3f) {
-                // DEC Private Mode Set (DECSET)
-                ++parameter_bytes;
-                dec_mode = 1;
-            } else {
-                // ANSI mode
-            }
 
-            int parameters[ARRAY_LENGTH];
-            int parameters_len = parameterstring_to_intarray(parameter_bytes, BUFFER_SIZE, parameters, ARRAY_LENGTH);
-
-            if (parameters_len == 1 && parameters[0] == 1) {
-                if (debug_output) fprintf(stderr, "Application takes over control of cursor keys\n");
-                fprintf(xmloutputfile, "<cursor key-control=\"application\" />\n");
-            } else if (parameters_len == 1 && parameters[0] == 12) {
-                if (debug_output) fprintf(stderr, "Start blinking cursor\n");
-                fprintf(xmloutputfile, "<cursor blinking=\"true\" />\n");
-            } else if (parameters_len == 1 && parameters[0] == 25) {
-                if (debug_output) fprintf(stderr, "Hide cursor cursor\n");
-                fprintf(xmloutputfile, "<cursor show=\"false\" />\n");
-            } else if (parameters_len == 1 && (parameters[0] == 47 || parameters[0] == 1047 || parameters[0] == 1049)) {
-                if (debug_output) fprintf(stderr, "Switching to alternate screen\n");
-                if (parameters[0] == 1049)
-                    fprintf(xmloutputfile, "<cursor state=\"save\" />\n");
-                fprintf(xmloutputfile, "<screen switchto=\"1\" />\n");
-            } else if (parameters_len == 1 && parameters[0] == 1034) {
-                if (debug_output) fprintf(stderr, "Interpret \"meta\" key, sets eighth bit\n");
-                fprintf(xmloutputfile, "<special state=\"8bit\" />\n");
-            } else if (parameters_len == 1 && parameters[0] == 1048) {
-                fprintf(xmloutputfile, "<cursor state=\"save\" />\n");
-            } else if (debug_output) {
-                fprintf(stderr, "dec_mode=%d\n", dec_mode);
-                fprintf(stderr, "parameters_len=%d\n", parameters_len);
-                for (int i = 0; i < parameters_len; ++i)
-                    fprintf(stderr, "parameters[%d]=%d\n", i, parameters[i]);
-            }
+    /// Text must not span timesteps in the XML structure, the
+    /// parser's state however is carried over to the next step
+    close_textsequence(state);
 
-            return 0;
-        } else {
-            if (debug_output) fprintf(stderr, "Unsupported Control Sequence that ends with 0x68\n");
-            return 0;
+    return ret;
+}
+
+/**
+ * Parser state at the end of a timing step, as far as needed
+ * to decide whether parsing can continue from there as if it
+ * had started in the initial state
+ */
+struct step_end {
+    size_t output_length; ///< length of segment output after this step
+    enum parser_mode mode;
+    int pending_cr;
+    size_t utf8_pending_len;
+    struct parser_rendition rendition;
+    char last_character[4];
+    size_t last_character_len;
+};
+
+/**
+ * Consecutive timing steps parsed by one thread, assuming the
+ * parser is in its initial state at the beginning of the segment
+ */
+struct segment {
+    size_t first_step, step_count;
+    size_t parsed_steps; ///< steps parsed completely, less than step_count on error
+    struct xmloutput output; ///< XML produced for the segment, kept in memory
+    struct step_end *step_ends; ///< one entry per step in the segment
+    struct parser_state end_state;
+    int ret; ///< result of parsing, non-zero if parsing stopped early
+    int done;
+};
+
+/**
+ * Everything shared between the writing main thread
+ * and the worker threads in parallel mode
+ */
+struct parallel {
+    struct xmloutput *output; ///< where segments are written in order
+    const char *map; ///< memory-mapped typescript
+    const struct timing_step *steps;
+    enum parser_invalid_utf8 invalid_utf8;
+    struct segment *segments;
+    size_t segment_count;
+    size_t next_segment; ///< next segment to be picked by a worker
+    size_t written_segments; ///< segments already written by the main thread
+    size_t window; ///< maximum number of segments kept in memory
+    pthread_mutex_t mutex;
+    pthread_cond_t segment_done, segment_written;
+};
+
+/**
+ * Parse the timing steps @p first to @p first + @p count - 1 into
+ * @p output, starting with the parser state given in @p state.
+ * If @p step_ends is not NULL, record the state after each step.
+ * Returns the number of steps parsed completely.
+ */
+static size_t parse_timingsteps(struct parser_state *state, struct xmloutput *output, const char *map, const struct timing_step *steps, size_t first, size_t count, struct step_end *step_ends, int *ret)
+{
+    *ret = 0;
+    state->sink.event = xmlevents_write;
+    state->sink.context = output;
+    for (size_t j = 0; j < count; ++j) {
+        const struct timing_step *step = steps + first + j;
+        event_emit_timestep(&state->sink, step->delay);
+        *ret = parse_typescript(state, map + step->offset, step->length);
+        close_textsequence(state);
+        if (*ret != 0)
+            return j;
+        event_emit_timestep_end(&state->sink);
+        if (step_ends != NULL) {
+            step_ends[j].output_length = output->length;
+            step_ends[j].mode = state->mode;
+            step_ends[j].pending_cr = state->pending_cr;
+            step_ends[j].utf8_pending_len = state->utf8_pending_len;
+            step_ends[j].rendition = state->rendition;
+            memcpy(step_ends[j].last_character, state->last_character, sizeof(state->last_character));
+            step_ends[j].last_character_len = state->last_character_len;
         }
-    case 0x6c:
-        /// RM -- Reset Mode (see 8.3.106 in ECMA-48 1991)
-        if (debug_output) fprintf(stderr, "Control Sequence: Reset Mode (parameter length=%zu, intermediate length=%zu)\n", strlen(parameter_bytes), strlen(intermediate_bytes));
-
-        int dec_mode = 0;
-        if (*parameter_bytes == 0x3f) {
-            // DEC Private Mode Set (DECSET)
-            ++parameter_bytes;
-            dec_mode = 1;
-        } else {
-            // ANSI mode
+    }
+    return count;
+}
+
+/**
+ * Worker thread: pick segments one after another and parse them
+ * from the initial parser state into memory
+ */
+static void *parallel_worker(void *arg)
+{
+    struct parallel *parallel = (struct parallel *)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&parallel->mutex);
+        /// Do not run too far ahead of the writing main thread
+        while (parallel->next_segment < parallel->segment_count && parallel->next_segment - parallel->written_segments >= parallel->window)
+            pthread_cond_wait(&parallel->segment_written, &parallel->mutex);
+        if (parallel->next_segment >= parallel->segment_count) {
+            pthread_mutex_unlock(&parallel->mutex);
+            return NULL;
+        }
+        struct segment *segment = parallel->segments + parallel->next_segment++;
+        pthread_mutex_unlock(&parallel->mutex);
+
+        segment->step_ends = (struct step_end *)malloc(segment->step_count * sizeof(struct step_end));
+        if (segment->step_ends == NULL || xmloutput_open(&segment->output, -1, 1 << 16) != 0)
+            segment->ret = 1;
+        else {
+            struct event_sink segment_sink = { xmlevents_write, &segment->output };
+            parser_init(&segment->end_state, &segment_sink);
+            segment->end_state.invalid_utf8 = parallel->invalid_utf8;
+            segment->parsed_steps = parse_timingsteps(&segment->end_state, &segment->output, parallel->map, parallel->steps, segment->first_step, segment->step_count, segment->step_ends, &segment->ret);
+            if (segment->output.error)
+                segment->ret = 1;
         }
 
-        int parameters[ARRAY_LENGTH];
-        int parameters_len = parameterstring_to_intarray(parameter_bytes, BUFFER_SIZE, parameters, ARRAY_LENGTH);
-        if (parameters_len == 1 && parameters[0] == 1) {
-            if (debug_output) fprintf(stderr, "Terminal takes over control of cursor keys\n");
-            fprintf(xmloutputfile, "<cursor key-control=\"terminal\" />\n");
-        } else if (parameters_len == 1 && parameters[0] == 12) {
-            if (debug_output) fprintf(stderr, "Stop blinking cursor\n");
-            fprintf(xmloutputfile, "<cursor blinking=\"false\" />\n");
-        } else if (parameters_len == 1 && parameters[0] == 25) {
-            if (debug_output) fprintf(stderr, "Show cursor cursor\n");
-            fprintf(xmloutputfile, "<cursor show=\"true\" />\n");
-        } else if (parameters_len == 1 && (parameters[0] == 47 || parameters[0] == 1047 || parameters[0] == 1049)) {
-            if (debug_output) fprintf(stderr, "Switching back from alternate screen\n");
-            if (parameters[0] == 1049)
-                fprintf(xmloutputfile, "<cursor state=\"restore\" />\n");
-            fprintf(xmloutputfile, "<screen switchto=\"0\" />\n");
-        } else if (parameters_len == 1 && parameters[0] == 1048) {
-            fprintf(xmloutputfile, "<cursor state=\"restore\" />\n");
-        } else if (debug_output) {
-            fprintf(stderr, "dec_mode=%d\n", dec_mode);
-            fprintf(stderr, "parameters_len=%d\n", parameters_len);
-            for (int i = 0; i < parameters_len; ++i)
-                fprintf(stderr, "parameters[%d]=%d\n", i, parameters[i]);
+        pthread_mutex_lock(&parallel->mutex);
+        segment->done = 1;
+        pthread_cond_broadcast(&parallel->segment_done);
+        pthread_mutex_unlock(&parallel->mutex);
+    }
+}
+
+/**
+ * Write a segment's output in the order of the recording. If the
+ * parser state at the end of the previous segment, @p carry, is not
+ * the initial state the segment was parsed with, re-parse the
+ * segment's first steps from @p carry until both parses agree again.
+ * @p carry is updated to the state at the end of this segment.
+ */
+static int write_segment(struct parallel *parallel, struct segment *segment, struct parser_state *carry)
+{
+    if (segment->step_ends == NULL || segment->output.buffer == NULL)
+        return 1; ///< worker could not allocate memory
+
+    /// Colors only change by differences to the rendition before,
+    /// so it is part of the state to agree on; its fields are bytes
+    /// without padding and can be compared as a whole
+    struct parser_rendition initial;
+    parser_rendition_init(&initial);
+
+    size_t spliced = 0; ///< offset in segment output to continue with
+    size_t j = 0;
+    /// A REP before the segment's first graphic character was dropped,
+    /// but would repeat the last character of the previous segment
+    if (carry->mode != MODE_GROUND || carry->pending_cr || carry->utf8_pending_len > 0 || memcmp(&carry->rendition, &initial, sizeof(initial)) != 0
+            || (segment->end_state.missed_repeat && carry->last_character_len > 0)) {
+        /// Seam: re-parse with the real state until it converges
+        struct xmloutput reparsed;
+        if (xmloutput_open(&reparsed, -1, 1 << 16) != 0)
+            return 1;
+        for (; j < segment->step_count; ++j) {
+            int ret;
+            if (parse_timingsteps(carry, &reparsed, parallel->map, parallel->steps, segment->first_step + j, 1, NULL, &ret) != 1) {
+                xmloutput_write(parallel->output, reparsed.buffer, reparsed.length);
+                xmloutput_close(&reparsed);
+                return ret;
+            }
+            const struct step_end *step_end = segment->step_ends + j;
+            if (j < segment->parsed_steps && carry->mode == MODE_GROUND && step_end->mode == MODE_GROUND && carry->pending_cr == step_end->pending_cr
+                    && carry->utf8_pending_len == 0 && step_end->utf8_pending_len == 0 && memcmp(&carry->rendition, &step_end->rendition, sizeof(struct parser_rendition)) == 0
+                    && carry->last_character_len == step_end->last_character_len && memcmp(carry->last_character, step_end->last_character, carry->last_character_len) == 0) {
+                /// Same state as in the speculative parse, rest of its output is valid
+                spliced = step_end->output_length;
+                ++j;
+                break;
+            }
         }
+        xmloutput_write(parallel->output, reparsed.buffer, reparsed.length);
+        xmloutput_close(&reparsed);
+        if (j == segment->step_count && spliced == 0) {
+            /// Never converged, @p carry is already the state at the end of the segment
+            return 0;
+        }
+    }
 
-        return 0;
-    case 0x6d: /* m */
-        /// SGR -- Select Graphics Rendition (see 8.3.117 in ECMA-48 1991)
-        if (debug_output) fprintf(stderr, "Control Sequence: Detected color change (parameter length=%zu, intermediate length=%zu)\n", strlen(parameter_bytes), strlen(intermediate_bytes));
+    xmloutput_write(parallel->output, segment->output.buffer + spliced, segment->output.length - spliced);
+    /// A segment without any graphic character leaves the last one
+    /// before it for a REP in a later segment
+    struct parser_state end_state = segment->end_state;
+    if (end_state.last_character_len == 0) {
+        memcpy(end_state.last_character, carry->last_character, sizeof(end_state.last_character));
+        end_state.last_character_len = carry->last_character_len;
+    }
+    *carry = end_state;
+    return segment->ret;
+}
+
+/**
+ * End of the segment starting at step @p first: the first step
+ * after it, taking steps of up to PARALLEL_SEGMENT_SIZE bytes
+ * together but at least one.
+ */
+static size_t segment_end(const struct timing_step *steps, size_t first, size_t step_count)
+{
+    size_t j = first, bytes = 0;
+    while (j < step_count && (bytes == 0 || bytes + steps[j].length <= PARALLEL_SEGMENT_SIZE))
+        bytes += steps[j++].length;
+    return j;
+}
 
-        int intense = 0, faint = 0, inverted = 0;
+/**
+ * Convert a memory-mapped typescript with several threads.
+ * The recording is split into segments at step boundaries of
+ * @p table, which are parsed in parallel and written in their
+ * original order.
+ */
+int process_timefile_parallel(struct job *job, struct parser_state *state, const struct timing_table *table)
+{
+    const struct timing_step *steps = table->steps;
+    size_t step_count = table->count;
+
+    /// Only steps completely inside the typescript are handled in
+    /// parallel; a truncated typescript is left for the serial code
+    size_t parallel_steps = 0;
+    while (parallel_steps < step_count && steps[parallel_steps].offset + steps[parallel_steps].length <= job->recording.typescript.map_size)
+        ++parallel_steps;
+
+    /// Split into segments of about PARALLEL_SEGMENT_SIZE bytes,
+    /// counting them first as each one holds a complete parser state
+    struct parallel parallel;
+    parallel.output = &job->xmloutput;
+    parallel.map = job->recording.typescript.map;
+    parallel.steps = steps;
+    parallel.invalid_utf8 = job->invalid_utf8;
+    parallel.segment_count = 0;
+    for (size_t j = 0; j < parallel_steps; ++parallel.segment_count)
+        j = segment_end(steps, j, parallel_steps);
+    parallel.segments = (struct segment *)calloc(parallel.segment_count + 1, sizeof(struct segment));
+    if (parallel.segments == NULL) {
+        fprintf(stderr, "Cannot allocate memory for segments\n");
+        return 1;
+    }
+    for (size_t k = 0, j = 0; k < parallel.segment_count; ++k) {
+        parallel.segments[k].first_step = j;
+        j = segment_end(steps, j, parallel_steps);
+        parallel.segments[k].step_count = j - parallel.segments[k].first_step;
+    }
+    parallel.next_segment = parallel.written_segments = 0;
+    parallel.window = 2 * job->threads;
+    pthread_mutex_init(&parallel.mutex, NULL);
+    pthread_cond_init(&parallel.segment_done, NULL);
+    pthread_cond_init(&parallel.segment_written, NULL);
+
+    pthread_t workers[job->threads];
+    int worker_count = 0;
+    for (; worker_count < job->threads; ++worker_count)
+        if (pthread_create(workers + worker_count, NULL, parallel_worker, &parallel) != 0)
+            break;
+    if (worker_count == 0) {
+        /// No threads at all, parse everything in this thread
+        parallel_worker(&parallel);
+    }
 
-        while (strlen(parameter_bytes) >= 2) {
-            int len = 2;
-            int color = ascii_to_dec(parameter_bytes, &len);
-            if (len != 2) break;
+    /// Write segments in order, reconciling parser state at seams
+    int ret = 0;
+    for (size_t k = 0; k < parallel.segment_count; ++k) {
+        struct segment *segment = parallel.segments + k;
+        pthread_mutex_lock(&parallel.mutex);
+        while (!segment->done)
+            pthread_cond_wait(&parallel.segment_done, &parallel.mutex);
+        pthread_mutex_unlock(&parallel.mutex);
+
+        if (ret == 0)
+            ret = write_segment(&parallel, segment, state);
+        free(segment->step_ends);
+        xmloutput_close(&segment->output);
+
+        pthread_mutex_lock(&parallel.mutex);
+        parallel.written_segments = k + 1;
+        pthread_cond_broadcast(&parallel.segment_written);
+        pthread_mutex_unlock(&parallel.mutex);
+    }
 
-            /// Normalize non-standard aixterm high-intensity colors
-            if ((color >= 90 && color <= 97) || (color >= 100 && color <= 107)) {
-                intense = 1;
-                color -= 60;
+    for (int i = 0; i < worker_count; ++i)
+        pthread_join(workers[i], NULL);
+    pthread_cond_destroy(&parallel.segment_written);
+    pthread_cond_destroy(&parallel.segment_done);
+    pthread_mutex_destroy(&parallel.mutex);
+    free(parallel.segments);
+
+    /// Steps not completely inside the typescript are handled
+    /// like in serial mode, including the error message
+    state->sink = job->output_sink;
+    if (ret == 0 && parallel_steps < step_count) {
+        job->recording.typescript.position = steps[parallel_steps].offset;
+        event_emit_timestep(&job->output_sink, steps[parallel_steps].delay);
+        ret = process_typescript_step(job, state, steps[parallel_steps].length);
+    }
+
+    return ret;
+}
+
+/**
+ * Convert the recording while it is being written, reading
+ * the timing file line by line as 'script' appends to it.
+ */
+static int process_timefile_follow(struct job *job, struct parser_state *state)
+{
+    size_t line_nr = 0;
+    for (;;) {
+        long long delay;
+        size_t blk, line_offset;
+        int stage = stats_enter(job->stats, STATS_TIMING);
+        int lineret = next_timingstep(job, &line_nr, &line_offset, &delay, &blk);
+        stats_leave(job->stats, stage);
+        if (lineret == 1)
+            break;
+        else if (lineret != 0)
+            return lineret;
+        if (job->to_time >= 0 && job->recording_time + delay > job->to_time)
+            break;
+
+        begin_timestep(job, state, delay, line_nr, line_offset);
+
+        int ret = process_typescript_step(job, state, blk);
+        if (ret != 0)
+            return ret;
+
+        event_emit_timestep_end(&state->sink);
+        timestep_written(job);
+    }
+
+    return 0;
+}
+
+int process_timefile(struct job *job)
+{
+    struct parser_state state;
+    struct event_sink sink = job->output_sink;
+    job->recording_time = 0;
+    if (job->index_filename != NULL || job->seek_time >= 0) {
+        /// Keep track of display attributes, when seeking
+        /// drop all events until the requested time
+        seekindex_attributes_init(&job->tracker.attributes);
+        job->tracker.next = job->output_sink;
+        if (job->seek_time >= 0)
+            job->tracker.next.event = NULL;
+        sink.event = seekindex_track;
+        sink.context = &job->tracker;
+    }
+    if (job->use_screen) {
+        /// The screen sees all events, also those dropped when seeking
+        job->screen.next = sink;
+        sink.event = screen_event;
+        sink.context = &job->screen;
+    }
+    parser_init(&state, &sink);
+    state.debug = job->debug_output;
+    state.invalid_utf8 = job->invalid_utf8;
+    state.stats = job->stats;
+
+    /// Ignore the first typescript line, contains just a comment
+    if (job->follow_mode) {
+        /// 'script' may not even have written it yet
+        for (int c; (c = fgetc(job->recording.typescriptfile)) != '\n';)
+            if (c == EOF) {
+                if (recording_ended(job))
+                    break;
+                wait_for_data(job);
             }
+        long position = ftell(job->recording.typescriptfile);
+        job->recording.typescript.position = position > 0 ? (size_t)position : 0;
+    } else
+        typescript_input_skipline(&job->recording.typescript);
+    job->last_keyframe_time = 0;
+    job->last_keyframe_position = job->recording.typescript.position;
 
-            if (color == 0) {
-                if (debug_output) fprintf(stderr, "Resetting colors\n");
-                fprintf(xmloutputfile, "<color operation=\"reset\" />\n");
-                intense = 0;
-                faint = 0;
-                inverted = 0;
-            } else if (color == 1) {
-                if (debug_output) fprintf(stderr, "Using intense colors\n");
-                intense = 1;
-                faint = 0;
-            } else if (color == 2) {
-                if (debug_output) fprintf(stderr, "Using faint colors\n");
-                intense = 0;
-                faint = 1;
-            } else if (color == 3) {
-                if (debug_output) fprintf(stderr, "Italic font not (yet) supported\n");
-            } else if (color == 4) {
-                if (debug_output) fprintf(stderr, "Underline text not (yet) supported\n");
-            } else if (color == 5 || color == 6) {
-                if (debug_output) fprintf(stderr, "Blinking text not (yet) supported\n");
-            } else if (color == 7) {
-                if (debug_output) fprintf(stderr, "Using negative/inverted colors\n");
-                inverted = 1;
-            } else if (color == 27) {
-                if (debug_output) fprintf(stderr, "Using positive/non-inverted colors\n");
-                inverted = 0;
-            } else if ((color >= 30 && color <= 37) || color == 39) {
-                char colorstring[BUFFER_SIZE];
-                colortostring(color, colorstring, BUFFER_SIZE);
-                if (debug_output) fprintf(stderr, "%s using color \"%s\" (%i)\n", inverted ? "Background (inverted foreground)" : "Foreground", colorstring, color);
-                fprintf(xmloutputfile, "<color %s=\"%s-%s\" />\n", inverted ? "background" : "foreground", intense == 0 ? (faint == 0 ? "normal" : "faint") : "intense", colorstring);
-            } else if (color == 38) {
-                if (debug_output) fprintf(stderr, "Future unsupported foreground color\n");
-                fprintf(xmloutputfile, "<color %s=\"normal-default\" />\n", inverted ? "background" : "foreground");
+    /// The timing file is line-based. In each line, there are
+    /// two fields: A time stamp representing the delay since the
+    /// previous line and a positive integer number representing
+    /// how many bytes are to be read from the typescript file
+
+    if (job->follow_mode)
+        return process_timefile_follow(job, &state);
+
+    /// Continue from the last index entry before the requested time,
+    /// unless the screen has to be built up from the beginning or
+    /// the input is compressed and cannot be positioned
+    size_t first_line = 1;
+    const struct seekindex_entry *entry = job->seekindex.map != NULL && !job->use_screen && job->recording.timing_compression == COMPRESSION_NONE && job->recording.typescript_compression == COMPRESSION_NONE ? seekindex_find(&job->seekindex, job->seek_time) : NULL;
+    if (entry != NULL) {
+        if (fseek(job->recording.timefile, (long)entry->timing_offset, SEEK_SET) != 0 || typescript_input_seek(&job->recording.typescript, entry->typescript_offset) != 0) {
+            fprintf(stderr, "Cannot seek to the index entry in the timing or typescript file\n");
+            return 1;
+        }
+        first_line = entry->line;
+        job->recording_time = entry->time;
+        state.pending_cr = entry->pending_cr;
+        state.rendition = entry->rendition;
+        state.last_character_len = entry->last_character_len <= sizeof(state.last_character) ? entry->last_character_len : 0;
+        memcpy(state.last_character, entry->last_character, sizeof(state.last_character));
+        job->tracker.attributes = entry->attributes;
+    }
+
+    /// Read the (rest of the) timing file into a table of steps first
+    stats_enter(job->stats, STATS_TIMING);
+    int ret = recording_read_timing(&job->recording, &job->table, first_line);
+    if (ret != 0)
+        return 1;
+    stats_enter(job->stats, STATS_OTHER);
+    if (job->stats != NULL)
+        job->stats->timing_table_bytes = job->table.size * sizeof(struct timing_step);
+
+    /// Find the steps between --from and --to by their delays alone;
+    /// the typescript before the first one is skipped, not parsed
+    size_t first_step = 0, end_step = job->table.count;
+    if (job->from_time >= 0 || job->to_time >= 0) {
+        long long time = job->recording_time;
+        for (size_t j = 0; j < job->table.count; ++j) {
+            time += job->table.steps[j].delay;
+            if (job->from_time >= 0 && first_step == j && time < job->from_time) {
+                first_step = j + 1;
+                job->recording_time = time;
+            } else if (job->to_time >= 0 && time > job->to_time) {
+                end_step = j;
                 break;
-            } else if ((color >= 40 && color <= 47) || color == 49) {
-                char colorstring[BUFFER_SIZE];
-                colortostring(color, colorstring, BUFFER_SIZE);
-                if (debug_output) fprintf(stderr, "%s using color \"%s\" (%i)\n", inverted ? "Foreground (inverted background)" : "Background", colorstring, color);
-                fprintf(xmloutputfile, "<color %s=\"%s-%s\" />\n", inverted ? "foreground" : "background", intense == 0 ? (faint == 0 ? "normal" : "faint") : "intense", colorstring);
-            } else if (color == 48) {
-                if (debug_output) fprintf(stderr, "Future unsupported background color\n");
-                fprintf(xmloutputfile, "<color %s=\"normal-default\" />\n", inverted ? "foreground" : "background");
-            } else {
-                if (debug_output) fprintf(stderr, "Unknown color code: %u\n", color);
-                fprintf(xmloutputfile, "<color operation=\"reset\" />\n");
             }
-            if (parameter_bytes[2] == ';')
-                parameter_bytes += 3;
-            else
-                break;
         }
+    }
+    if (job->from_time >= 0 && first_step < end_step) {
+        if (typescript_input_skip_to(&job->recording.typescript, job->table.steps[first_step].offset) != 0)
+            return 1;
+        if (job->output_format == FORMAT_JSON)
+            job->jsonevents.time = job->recording_time; ///< times as if nothing was left out
+        job->clip_start = 1;
+        job->last_keyframe_time = job->recording_time;
+        job->last_keyframe_position = job->recording.typescript.position;
+    }
 
-        return 0;
-    case 0x6e: {
-        /// DSR -- Device Status Report (see 8.3.35 in ECMA-48 1991)
-        int len = 1;
-        int param = ascii_to_dec(parameter_bytes, &len);
-        if (len == 0) {
-            /// No parameter provided, assuming default value param=0
-            param = 0;
-            len = 1;
+    if (job->threads > 1 && job->recording.typescript.map != NULL) {
+        struct timing_table window = job->table;
+        window.steps += first_step;
+        window.count = end_step - first_step;
+        ret = process_timefile_parallel(job, &state, &window);
+    } else if (job->pipeline && typescript_input_read_ahead(&job->recording.typescript) != 0)
+        ret = 1;
+    else
+        for (size_t j = first_step; ret == 0 && j < end_step; ++j) {
+            begin_timestep(job, &state, job->table.steps[j].delay, job->table.steps[j].line, job->table.steps[j].timing_offset);
+            ret = process_typescript_step(job, &state, job->table.steps[j].length);
+            if (ret == 0) {
+                event_emit_timestep_end(&state.sink);
+                timestep_written(job);
+            }
         }
 
-        if (len == 1) {
-            if (debug_output) fprintf(stderr, "Control Sequence: Device Status Report (param=%d)\n", param);
-        } else {
-            if (debug_output) fprintf(stderr, "Invalid len: %d\n", len);
-            return 1;
-        }
-    }
-    return 0;
-    default:
-        if (debug_output) fprintf(stderr, "Don't know Final Byte 0x%02x for Control Sequence (parameter length=%zu, intermediate length=%zu)\n", final_byte, strlen(parameter_bytes), strlen(intermediate_bytes));
-        return 0;
+    /// Steps before a malformed line have been converted anyway
+    if (ret == 0 && job->table.error_line > 0 && end_step == job->table.count) {
+        fprintf(stderr, "Error while reading timimg file: unexpected format in line %zu\n", job->table.error_line);
+        ret = 2;
     }
+
+    return ret;
 }
 
 /**
- * @param expected_size Number of bytes describing the event of the current step
+ * Order of recording times for qsort
  */
-int process_typescript_step(size_t expected_size)
+static int compare_times(const void *a, const void *b)
 {
-    char csi_parameter_bytes[BUFFER_SIZE];
-    char csi_intermediate_bytes[BUFFER_SIZE];
-    char osc_string[BUFFER_SIZE], dcs_string[BUFFER_SIZE];
-    char csi_final_byte;
-    int ret = 0;
-    int insidetextsequence = 0;
+    long long ta = *(const long long *)a, tb = *(const long long *)b;
+    return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
 
-    if (expected_size > typescriptbuffer_size) {
-        /// The current typescript buffer is too small.
-        /// Release and allocate a larger memory region.
-        free(typescriptbuffer);
-        typescriptbuffer_size = roundup_powerof2(expected_size + 2);
-        typescriptbuffer = (char *)calloc(typescriptbuffer_size, sizeof(char));
+/**
+ * Parse a non-negative time in seconds from @p text into
+ * @p time in microseconds. Returns 0 on success.
+ */
+static int parse_option_time(const char *text, long long *time)
+{
+    char *end;
+    double seconds = strtod(text, &end);
+    if (end == text || *end != '\0' || !(seconds >= 0.0 && seconds < 1e12))
+        return 1;
+    *time = (long long)(seconds * 1e6 + 0.5);
+    return 0;
+}
+
+/**
+ * Parse a comma-separated list of times in seconds into
+ * @c screen_times, sorted in ascending order.
+ * Returns 0 on success.
+ */
+static int parse_screen_times(struct job *job, const char *list)
+{
+    while (*list != '\0') {
+        char *end;
+        double seconds = strtod(list, &end);
+        if (end == list || (*end != ',' && *end != '\0') || !(seconds >= 0.0 && seconds < 1e12))
+            return 1;
+        long long *new_times = (long long *)realloc(job->screen_times, (job->screen_time_count + 1) * sizeof(long long));
+        if (new_times == NULL)
+            return 1;
+        job->screen_times = new_times;
+        job->screen_times[job->screen_time_count++] = (long long)(seconds * 1e6 + 0.5);
+        list = *end == ',' ? end + 1 : end;
     }
+    qsort(job->screen_times, job->screen_time_count, sizeof(long long), compare_times);
+    return job->screen_time_count > 0 ? 0 : 1;
+}
 
-    /// Read as many bytes from the typescript files as are expected
-    /// to describe the current step's events
-    size_t rlen = fread(typescriptbuffer, sizeof(char), expected_size, typescriptfile);
-    if (rlen < expected_size) {
-        fprintf(stderr, "Expected to read %zu bytes from typescript file, got only %zu\n", expected_size, rlen);
+/**
+ * Convert one recording with the options set in @p job from
+ * @p timefilename and @p typescriptfilename to @p xmloutputfilename,
+ * "-" for stdout. The buffers @p job keeps are reused.
+ * Returns 0 on success.
+ */
+static int run_job(struct job *job, const char *timefilename, const char *typescriptfilename, const char *xmloutputfilename)
+{
+    job->unflushed_since = -1;
+    job->next_screen_time = 0;
+
+    if (recording_open(&job->recording, timefilename, typescriptfilename, job->use_mmap) != 0)
+        return 1;
+    if (job->follow_mode && (job->recording.timing_compression != COMPRESSION_NONE || job->recording.typescript_compression != COMPRESSION_NONE)) {
+        recording_close(&job->recording);
+        fprintf(stderr, "Cannot follow a compressed recording\n");
         return 1;
     }
 
-    /// Go through every byte in the typescript buffer ...
-    for (size_t i = 0; ret == 0 && i < rlen; ++i) {
-        if (typescriptbuffer[i] == 0x0a) {
-            if (debug_output) fprintf(stderr, "char: Line Feed  (%zu of %zu)\n", i, rlen - 1);
-            if (insidetextsequence == 1) {
-                /// If open, close current <text> environment
-                fprintf(xmloutputfile, "</text>\n");
-                insidetextsequence = 0;
-            }
-            fprintf(xmloutputfile, "<newline />\n");
-        } else if (typescriptbuffer[i] == 0x0d) {
-            if (debug_output) fprintf(stderr, "char: Carriage Return  (%zu of %zu)\n", i, rlen - 1);
-            if (insidetextsequence == 1) {
-                /// If open, close current <text> environment
-                fprintf(xmloutputfile, "</text>\n");
-                insidetextsequence = 0;
-            }
-            if (i < rlen - 1 && typescriptbuffer[i + 1] != 0x0a) ///< lonely CR without following LF
-                fprintf(xmloutputfile, "<newline />\n");
-        } else if (typescriptbuffer[i] >= 32 && typescriptbuffer[i] < 128) {
-            if (debug_output) fprintf(stderr, "char: %c  (%zu of %zu)\n", typescriptbuffer[i], i, rlen - 1);
-            if (insidetextsequence == 0) {
-                /// If not open, open a <text> environment
-                fprintf(xmloutputfile, "<text>");
-                insidetextsequence = 1;
-            }
-            /// Handle XML entities correctly
-            xmlized_print(xmloutputfile, typescriptbuffer[i]);
-        } else if (typescriptbuffer[i] == 0x1b /* ESCAPE */ && i < rlen - 1 /* and more bytes follow */) {
-            if (insidetextsequence == 1) {
-                /// If open, close current <text> environment
-                fprintf(xmloutputfile, "</text>\n");
-                insidetextsequence = 0;
-            }
+    if (job->threads > 1 && (job->debug_output || job->follow_mode || !job->use_mmap || job->recording.typescript_compression != COMPRESSION_NONE || job->output_format != FORMAT_XML || job->index_filename != NULL || job->seek_time >= 0 || job->from_time >= 0 || job->use_screen || job->stats != NULL || job->text_index_filename != NULL)) {
+        fprintf(stderr, "Parallel parsing requires a memory-mapped, uncompressed typescript, XML output and no debug output, index, seeking, screen, statistics or text index, using a single thread\n");
+        job->threads = 1;
+    }
+    if (job->pipeline && (job->follow_mode || job->threads > 1)) {
+        fprintf(stderr, "Pipelining cannot be combined with --follow or parallel parsing, converting without it\n");
+        job->pipeline = 0;
+    }
 
-            /// Escape sequence
-            if (typescriptbuffer[i + 1] == 0x5b /* 05/11 from 7-bit C1 set */) {
-                /// CSI -- Command Sequence Introducer (see 5.4 in ECMA-48 1991)
-                if (debug_output) fprintf(stderr, "CSI at position %zu of %zu\n", i, rlen - 1);
-                i += 2;
-
-                size_t sequence_len;
-                /// Reading optional Parameter Bytes that have to be in value range 0x30 .. 0x3f
-                sequence_len = 0;
-                while (sequence_len < BUFFER_SIZE - 1 && i < rlen && typescriptbuffer[i] >= 0x30 && typescriptbuffer[i] <= 0x3f) {
-                    csi_parameter_bytes[sequence_len++] = typescriptbuffer[i++];
-                }
-                csi_parameter_bytes[sequence_len++] = 0; ///< null-terminated
-                /// Reading optional Intermediate Bytes that have to be in value range 0x20 .. 0x2f
-                sequence_len = 0;
-                while (sequence_len < BUFFER_SIZE - 1 && i < rlen && typescriptbuffer[i] >= 0x20 && typescriptbuffer[i] <= 0x2f)  {
-                    csi_intermediate_bytes[sequence_len++] = typescriptbuffer[i++];
-                }
-                csi_intermediate_bytes[sequence_len++] = 0;
-                /// Reading Final Byte that has to be in value range 0x40 .. 0x7f
-                if (i < rlen && typescriptbuffer[i] >= 0x40 && typescriptbuffer[i] <= 0x7f) {
-                    /// Found Final Byte
-                    csi_final_byte = typescriptbuffer[i++];
-
-                    ret = process_controlsequence(csi_final_byte, csi_intermediate_bytes, csi_parameter_bytes);
-                    --i; /// Compensate for for-loop's ++i
-                } else if (debug_output)
-                    fprintf(stderr, "Final Byte expected at position %zu of %zu, but byte 0x%02x found instead\n", i, rlen - 1, typescriptbuffer[i]);
-            } else if (typescriptbuffer[i + 1] == 0x50 /* 05/00 from 7-bit C1 set */) {
-                /// DCS -- Device Control String (see 8.3.27 in ECMA-48 1991)
-                if (debug_output) fprintf(stderr, "DCS at position %zu of %zu\n", i, rlen - 1);
-                i += 2;
-
-                /// Read command string
-                size_t dcs_string_len = 0;
-                while (i < rlen && dcs_string_len < BUFFER_SIZE - 1 && ((typescriptbuffer[i] >= 0x08 /* 00/08 */ && typescriptbuffer[i] <= 0x0d /* 00/13 */) || (typescriptbuffer[i] >= 0x20 /* 02/00 */ && typescriptbuffer[i] <= 0x7e /* 07/14 */)))
-                    dcs_string[dcs_string_len++] = typescriptbuffer[i++];
-                dcs_string[dcs_string_len] = '\0';
-
-                if (debug_output) {
-                    fprintf(stderr, "unknown device control string=");
-                    for (size_t j = 0; j < dcs_string_len; ++j) {
-                        if (dcs_string[j] >= 0x20 /* 02/00 */ && dcs_string[j] <= 0x7e /* 07/14 */)
-                            fprintf(stderr, "%c", dcs_string[j]);
-                        else
-                            fprintf(stderr, "[%02x]", dcs_string[j]);
-                    }
-                    fprintf(stderr, "\n");
-                }
-
-                /// Read String Terminator
-                if (i < rlen && typescriptbuffer[i] == 0x9c) {
-                    /// 8-bit single-byte String Terminator (see 8.3.143 in ECMA-48 1991)
-                    ++i;
-
-                    --i; /// Compensate for for-loop's ++i
-                } else if (i < rlen - 1 && typescriptbuffer[i] == 0x1b && typescriptbuffer[i + 1] == 0x5c) {
-                    /// 7-bit double-byte String Terminator (see 8.3.143 in ECMA-48 1991)
-                    i += 2;
-
-                    --i; /// Compensate for for-loop's ++i
-                } else if (i < rlen && typescriptbuffer[i] == 0x07) {
-                    /// Sometimes a BEL is acceptable as an alternative to a String Terminator
-                    ++i;
-
-                    --i; /// Compensate for for-loop's ++i
-                } else if (i < rlen - 1) {
-                    /// Bytes left to read but no valid String Terminator
-                    if (debug_output) fprintf(stderr, "String Terminator expected at position %zu of %zu, but byte 0x%02x found instead\n", i, rlen - 1,  typescriptbuffer[i]);
-                }
-            } else if (typescriptbuffer[i + 1] == 0x5d /* 05/13 from 7-bit C1 set */) {
-                /// OSC -- Operating System Command (see 8.3.89 in ECMA-48 1991)
-                if (debug_output) fprintf(stderr, "OSC at position %zu of %zu\n", i, rlen - 1);
-                i += 2;
-
-                /// Read command string
-                size_t osc_string_len = 0;
-                while (i < rlen && osc_string_len < BUFFER_SIZE - 1 && ((typescriptbuffer[i] >= 0x08 /* 00/08 */ && typescriptbuffer[i] <= 0x0d /* 00/13 */) || (typescriptbuffer[i] >= 0x20 /* 02/00 */ && typescriptbuffer[i] <= 0x7e /* 07/14 */)))
-                    osc_string[osc_string_len++] = typescriptbuffer[i++];
-                osc_string[osc_string_len] = '\0';
-
-                if (osc_string_len > 3 && osc_string[0] == '0' && osc_string[1] == ';') {
-                    /// OSC starting with '0;' sets the window title, the remaining
-                    /// printable characters are the title
-
-                    if (insidetextsequence == 1) {
-                        /// If open, close current <text> environment
-                        fprintf(xmloutputfile, "</text>\n");
-                        insidetextsequence = 0;
-                    }
-                    if (debug_output) fprintf(stderr, "Window title=");
-                    fprintf(xmloutputfile, "<osc type=\"windowtitle\">");
-                    for (size_t j = 2; j < osc_string_len; ++j)
-                        if (osc_string[j] >= 0x20 /* 02/00 */ && osc_string[j] <= 0x7e /* 07/14 */) {
-                            /// Write out printable characters only
-                            if (debug_output) fprintf(stderr, "%c", osc_string[j]);
-                            /// Handle XML entities correctly
-                            xmlized_print(xmloutputfile, osc_string[j]);
-                        }
-                    if (debug_output) fprintf(stderr, "\n");
-                    fprintf(xmloutputfile, "</osc>\n");
-                } else if (debug_output) {
-                    fprintf(stderr, "unknown command string=");
-                    for (size_t j = 0; j < osc_string_len; ++j) {
-                        if (osc_string[j] >= 0x20 /* 02/00 */ && osc_string[j] <= 0x7e /* 07/14 */)
-                            fprintf(stderr, "%c", osc_string[j]);
-                        else
-                            fprintf(stderr, "[%02x]", osc_string[j]);
-                    }
-                    fprintf(stderr, "\n");
-                }
-
-                /// Read String Terminator
-                if (i < rlen && typescriptbuffer[i] == 0x9c) {
-                    /// 8-bit single-byte String Terminator (see 8.3.143 in ECMA-48 1991)
-                    ++i;
-
-                    --i; /// Compensate for for-loop's ++i
-                } else if (i < rlen - 1 && typescriptbuffer[i] == 0x1b && typescriptbuffer[i + 1] == 0x5c) {
-                    /// 7-bit double-byte String Terminator (see 8.3.143 in ECMA-48 1991)
-                    i += 2;
-
-                    --i; /// Compensate for for-loop's ++i
-                } else if (i < rlen && typescriptbuffer[i] == 0x07) {
-                    /// Sometimes a BEL is acceptable as an alternative to a String Terminator
-                    ++i;
-
-                    --i; /// Compensate for for-loop's ++i
-                } else if (i < rlen - 1) {
-                    /// Bytes left to read but no valid String Terminator
-                    if (debug_output) fprintf(stderr, "String Terminator expected at position %zu of %zu, but byte 0x%02x found instead\n", i, rlen - 1,  typescriptbuffer[i]);
-                }
-            } else if (typescriptbuffer[i + 1] >= 0x3c /* 03/12 */ && typescriptbuffer[i + 1] <= 0x3f /* 03/15 */) {
-                if (debug_output) fprintf(stderr, "Private parameter string: %c%c\n", typescriptbuffer[i + 1], typescriptbuffer[i + 2]);
-                /// Assuming 2-byte sequence
-                i += 2;
-                --i; /// Compensate for for-loop's ++i
-            } else {
-                fprintf(stdout, "Unknown escape sequence: 0x%02x='%c' at position %zu of %zu\n", typescriptbuffer[i + 1], typescriptbuffer[i + 1], i, rlen - 1);
-                /// Assuming 2-byte sequence
-                i += 2;
-                --i; /// Compensate for for-loop's ++i
-            }
+    /// Binary output completes its header with pwrite at the end,
+    /// so it is written by the converting thread itself
+    int pipelined_output = job->pipeline && job->output_compression == COMPRESSION_NONE && job->output_format != FORMAT_BINARY;
+    int xmloutputfd;
+    if (xmloutputfilename[0] == '-' && xmloutputfilename[1] == '\0') {
+        /// Write to stdout instead of to a file
+        xmloutputfd = STDOUT_FILENO;
+    } else {
+        /// Write to a plain text file
+        xmloutputfd = open(xmloutputfilename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    if (xmloutputfd < 0 || xmloutput_reopen(&job->xmloutput, xmloutputfd, XMLOUTPUT_BUFFER_SIZE) != 0
+            || (job->output_format == FORMAT_BINARY && binaryoutput_open(&job->binaryoutput, &job->xmloutput) != 0)
+            || (job->output_compression != COMPRESSION_NONE && compressed_output_open(&job->compressedoutput, xmloutputfd, job->output_compression, job->compress_level, job->compress_threads, job->compress_seekable) != 0)
+            || (pipelined_output && pipelined_output_open(&job->pipelinedoutput, xmloutputfd) != 0)) {
+        if (xmloutputfd >= 0)
+            xmloutput_flush(&job->xmloutput);
+        if (xmloutputfd > STDOUT_FILENO)
+            close(xmloutputfd);
+        recording_close(&job->recording);
+        fprintf(stderr, "Cannot open xmloutputfilename \"%s\"\n", xmloutputfilename);
+        return 1;
+    } else if (job->output_format == FORMAT_BINARY) {
+        job->output_sink.event = binaryoutput_write;
+        job->output_sink.context = &job->binaryoutput;
+    } else {
+        if (job->output_compression != COMPRESSION_NONE) {
+            /// Full buffers are compressed by worker threads
+            job->xmloutput.writer = compressed_output_write;
+            job->xmloutput.writer_context = &job->compressedoutput;
+        } else if (pipelined_output) {
+            /// Full buffers are written by a thread of their own
+            job->xmloutput.writer = pipelined_output_write;
+            job->xmloutput.writer_context = &job->pipelinedoutput;
+        }
+        if (job->output_format == FORMAT_JSON) {
+            jsonevents_open(&job->jsonevents, &job->xmloutput, 0);
+            job->output_sink.event = jsonevents_write;
+            job->output_sink.context = &job->jsonevents;
         } else {
-            if (insidetextsequence == 1) {
-                fprintf(xmloutputfile, "</text>\n");
-                insidetextsequence = 0;
-            }
+            xmlevents_begin(&job->xmloutput);
+            job->output_sink.event = xmlevents_write;
+            job->output_sink.context = &job->xmloutput;
+        }
+    }
+    if (job->stats != NULL) {
+        /// Count events and attribute the time writing them to STATS_OUTPUT
+        job->stats_counter.stats = job->stats;
+        job->stats_counter.next = job->output_sink;
+        job->output_sink.event = stats_output;
+        job->output_sink.context = &job->stats_counter;
+    }
+    if (job->text_index_filename != NULL) {
+        /// Collect the text as it is written, at the time of its timestep
+        textindex_begin(&job->textindex, &job->output_sink, &job->recording_time);
+        job->output_sink.event = textindex_collect;
+        job->output_sink.context = &job->textindex;
+    }
 
-            if (debug_output) {
-                if (typescriptbuffer[i] & 0x80)
-                    fprintf(stderr, "8-bit char: 0x%02x  (%zu of %zu)\n", typescriptbuffer[i] & 0xff, i, rlen - 1);
-                else
-                    fprintf(stderr, "char: 0x%02x  (%zu of %zu)\n", typescriptbuffer[i], i, rlen - 1);
-            }
+    if (job->follow_mode)
+        follow_open(&job->follow, timefilename, typescriptfilename, job->latency);
+
+    /// When seeking, an index is read, otherwise it is written
+    int ret = 0;
+    job->seekindex.map = NULL;
+    job->indexwriter.file = NULL;
+    if (job->index_filename != NULL)
+        ret = job->seek_time >= 0 ? seekindex_open(&job->seekindex, job->index_filename, timefilename, typescriptfilename) : seekindex_create(&job->indexwriter, job->index_filename);
+    if (ret == 0 && job->use_screen)
+        ret = screen_init(&job->screen, job->screen_rows, job->screen_columns);
+    if (ret == 0 && job->screen_filename != NULL) {
+        job->screenfile = strcmp(job->screen_filename, "-") == 0 ? stdout : fopen(job->screen_filename, "w");
+        if (job->screenfile == NULL) {
+            fprintf(stderr, "Cannot open screen file \"%s\"\n", job->screen_filename);
+            ret = 1;
+        }
+    }
+    if (ret == 0)
+        ret = process_timefile(job);
+    if (job->screenfile != NULL) {
+        /// Screen as it is after the last step converted
+        if (job->screen_time_count == 0)
+            screen_write(&job->screen, job->screenfile, job->recording_time);
+        while (job->next_screen_time < job->screen_time_count)
+            screen_write(&job->screen, job->screenfile, job->screen_times[job->next_screen_time++]);
+        if ((job->screenfile != stdout ? fclose(job->screenfile) : fflush(job->screenfile)) != 0 && ret == 0) {
+            fprintf(stderr, "Cannot write screen file \"%s\"\n", job->screen_filename);
+            ret = 1;
         }
+        job->screenfile = NULL;
     }
+    if (job->use_screen)
+        screen_free(&job->screen);
+    if (job->follow_mode)
+        follow_close(&job->follow);
+    seekindex_close(&job->seekindex);
+    if (job->indexwriter.file != NULL && seekindex_finish(&job->indexwriter, timefilename, typescriptfilename) != 0 && ret == 0)
+        ret = 1;
+    /// Text converted before an error is worth finding as well
+    if (job->text_index_filename != NULL && textindex_append(&job->textindex, job->text_index_filename, typescriptfilename) != 0 && ret == 0)
+        ret = 1;
+    if (ret != 0) {
+        /// Keep the timesteps converted so far usable
+        if (job->output_format == FORMAT_BINARY)
+            binaryoutput_close(&job->binaryoutput);
+        xmloutput_flush(&job->xmloutput);
+        if (job->output_compression != COMPRESSION_NONE)
+            compressed_output_close(&job->compressedoutput);
+        if (pipelined_output)
+            pipelined_output_close(&job->pipelinedoutput);
+        if (xmloutputfd != STDOUT_FILENO)
+            close(xmloutputfd);
+        recording_close(&job->recording);
+        return ret;
+    }
+
+    stats_enter(job->stats, STATS_OUTPUT);
+    if (job->output_format == FORMAT_BINARY)
+        ret = binaryoutput_close(&job->binaryoutput);
+    else if (job->output_format == FORMAT_XML)
+        xmlevents_end(&job->xmloutput);
+
+    if (xmloutput_flush(&job->xmloutput) != 0)
+        ret = 1;
+    if (job->output_compression != COMPRESSION_NONE && compressed_output_close(&job->compressedoutput) != 0)
+        ret = 1;
+    if (pipelined_output && pipelined_output_close(&job->pipelinedoutput) != 0)
+        ret = 1;
+    if (xmloutputfd != STDOUT_FILENO)
+        close(xmloutputfd);
+    recording_close(&job->recording);
+    stats_enter(job->stats, STATS_OTHER);
+
+    return ret;
+}
+
+/**
+ * Release the buffers a job keeps for the next one.
+ */
+static void job_free(struct job *job)
+{
+    if (job->xmloutput.buffer != NULL)
+        xmloutput_close(&job->xmloutput);
+    timing_table_free(&job->table);
+    textindex_builder_free(&job->textindex);
+}
+
+/// One recording to convert in batch mode
+struct batch_entry {
+    char *timefilename, *typescriptfilename, *outputfilename;
+    int ret; ///< result of run_job
+    long milliseconds; ///< wall-clock time of the conversion
+};
+
+/**
+ * Recordings of a batch and the options to convert them with,
+ * shared by the worker threads
+ */
+struct batch {
+    const struct job *options; ///< copied by each worker into its own job
+    struct stats *stats; ///< totals of all recordings for --stats, or NULL
+    struct batch_entry *entries;
+    size_t count, size;
+    size_t next_entry; ///< next entry to be picked by a worker
+    pthread_mutex_t mutex;
+};
 
-    if (insidetextsequence == 1) {
-        /// If open, close current <text> environment
-        fprintf(xmloutputfile, "</text>\n");
-        insidetextsequence = 0;
+/**
+ * Append a recording to the batch, taking over the file names.
+ * Returns 0 on success.
+ */
+static int batch_add(struct batch *batch, char *timefilename, char *typescriptfilename, char *outputfilename)
+{
+    if (batch->count == batch->size) {
+        size_t new_size = batch->size > 0 ? batch->size * 2 : 64;
+        struct batch_entry *new_entries = (struct batch_entry *)realloc(batch->entries, new_size * sizeof(struct batch_entry));
+        if (new_entries != NULL) {
+            batch->entries = new_entries;
+            batch->size = new_size;
+        }
     }
+    if (timefilename == NULL || typescriptfilename == NULL || outputfilename == NULL || batch->count == batch->size) {
+        free(timefilename);
+        free(typescriptfilename);
+        free(outputfilename);
+        fprintf(stderr, "Cannot allocate memory for batch\n");
+        return 1;
+    }
+
+    struct batch_entry *entry = batch->entries + batch->count++;
+    entry->timefilename = timefilename;
+    entry->typescriptfilename = typescriptfilename;
+    entry->outputfilename = outputfilename;
+    entry->ret = -1;
+    entry->milliseconds = 0;
+    return 0;
+}
 
+/**
+ * Read a manifest with one recording per line, given as the
+ * names of its timing file, typescript file and output file
+ * separated by white space. Empty lines and lines starting
+ * with '#' are ignored.
+ * Returns 0 on success.
+ */
+static int batch_read_manifest(struct batch *batch, const char *filename)
+{
+    FILE *manifest = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (manifest == NULL) {
+        fprintf(stderr, "Cannot open manifest \"%s\"\n", filename);
+        return 1;
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    int ret = 0;
+    for (size_t line_nr = 1; ret == 0 && getline(&line, &line_size, manifest) >= 0; ++line_nr) {
+        char *fields[4] = { NULL, NULL, NULL, NULL };
+        int count = 0;
+        for (char *p = line; count < 4;) {
+            while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+                ++p;
+            if (*p == '\0' || (count == 0 && *p == '#'))
+                break;
+            fields[count++] = p;
+            while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+                ++p;
+            if (*p != '\0')
+                *p++ = '\0';
+        }
+        if (count == 0)
+            continue;
+        if (count != 3) {
+            fprintf(stderr, "Manifest \"%s\", line %zu: expected timing file, typescript file and output file\n", filename, line_nr);
+            ret = 1;
+        } else if (strcmp(fields[2], "-") == 0) {
+            fprintf(stderr, "Manifest \"%s\", line %zu: cannot write to stdout in batch mode\n", filename, line_nr);
+            ret = 1;
+        } else
+            ret = batch_add(batch, strdup(fields[0]), strdup(fields[1]), strdup(fields[2]));
+    }
+    if (ret == 0 && ferror(manifest)) {
+        fprintf(stderr, "Error while reading manifest \"%s\"\n", filename);
+        ret = 1;
+    }
+    free(line);
+    if (manifest != stdin)
+        fclose(manifest);
     return ret;
 }
 
-int process_timefile()
+/**
+ * Concatenate up to three strings into newly allocated memory.
+ */
+static char *concatenate(const char *a, const char *b, const char *c)
 {
-    /// Ignore the first typescript line, contains just a comment
-    skipline(typescriptfile);
+    size_t len_a = strlen(a), len_b = strlen(b), len_c = strlen(c);
+    char *result = (char *)malloc(len_a + len_b + len_c + 1);
+    if (result != NULL) {
+        memcpy(result, a, len_a);
+        memcpy(result + len_a, b, len_b);
+        memcpy(result + len_a + len_b, c, len_c + 1);
+    }
+    return result;
+}
 
-    /// The timing file is line-based. In each line, there are
-    /// two fields: A time stamp representing the delay since the
-    /// previous line and a positive integer number representing
-    /// how many bytes are to be read from the typescript file
+/**
+ * Order of batch entries by timing file name for qsort
+ */
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const struct batch_entry *)a)->timefilename, ((const struct batch_entry *)b)->timefilename);
+}
 
-    for (int line_nr = 0; ; ++line_nr) {
-        double delay;
-        size_t blk;
-        char nl;
-        if (fscanf(timefile, "%lf %zu%c\n", &delay, &blk, &nl) != 3 ||
-                nl != '\n') {
-            if (feof(timefile))
+/**
+ * Collect all recordings in @p directory, pairing each
+ * NAME.timing with NAME.typescript, either of them optionally
+ * compressed with a .gz or .zst suffix. Output is written to
+ * NAME.xml (or .bin) in @p output_directory, with a suffix for
+ * the compression of the output.
+ * Returns 0 on success.
+ */
+static int batch_read_directory(struct batch *batch, const char *directory, const char *output_directory, const char *output_suffix)
+{
+    static const char *compression_suffixes[] = { "", ".gz", ".zst" };
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Cannot open directory \"%s\"\n", directory);
+        return 1;
+    }
+    int ret = 0;
+    for (struct dirent *dirent; ret == 0 && (dirent = readdir(dir)) != NULL;) {
+        /// NAME.timing with an optional compression suffix
+        const char *suffix = strstr(dirent->d_name, ".timing");
+        if (suffix == NULL || suffix == dirent->d_name)
+            continue;
+        int known_suffix = 0;
+        for (size_t s = 0; s < sizeof(compression_suffixes) / sizeof(compression_suffixes[0]); ++s)
+            if (strcmp(suffix + 7, compression_suffixes[s]) == 0)
+                known_suffix = 1;
+        if (!known_suffix)
+            continue;
+        size_t name_len = (size_t)(suffix - dirent->d_name);
+
+        char *path = concatenate(directory, "/", dirent->d_name);
+        char *typescriptfilename = NULL;
+        for (size_t s = 0; path != NULL && typescriptfilename == NULL && s < sizeof(compression_suffixes) / sizeof(compression_suffixes[0]); ++s) {
+            typescriptfilename = (char *)malloc(strlen(directory) + name_len + 24);
+            if (typescriptfilename == NULL)
                 break;
-            if (ferror(timefile)) {
-                fprintf(stderr, "Error while reading timimg file: unexpected format in line %d\n", line_nr);
-                return 2;
+            sprintf(typescriptfilename, "%s/%.*s.typescript%s", directory, (int)name_len, dirent->d_name, compression_suffixes[s]);
+            if (access(typescriptfilename, R_OK) != 0) {
+                free(typescriptfilename);
+                typescriptfilename = NULL;
             }
         }
+        if (path != NULL && typescriptfilename == NULL) {
+            fprintf(stderr, "No typescript for \"%s\", skipping it\n", path);
+            free(path);
+            continue;
+        }
+        char *outputfilename = (char *)malloc(strlen(output_directory) + name_len + strlen(output_suffix) + 2);
+        if (outputfilename != NULL)
+            sprintf(outputfilename, "%s/%.*s%s", output_directory, (int)name_len, dirent->d_name, output_suffix);
+        ret = batch_add(batch, path, typescriptfilename, outputfilename);
+    }
+    closedir(dir);
+    if (ret == 0)
+        qsort(batch->entries, batch->count, sizeof(struct batch_entry), compare_entries);
+    return ret;
+}
 
-        fprintf(xmloutputfile, "<timestep delay=\"%.3f\">\n", delay);
-
-        int ret = process_typescript_step(blk);
-        if (ret != 0)
-            return ret;
+/**
+ * Worker thread in batch mode: convert recordings until none
+ * is left, reusing the buffers of its job for all of them.
+ */
+static void *batch_worker(void *arg)
+{
+    struct batch *batch = (struct batch *)arg;
+    struct job job = *batch->options;
+    struct stats stats;
+    stats_init(&stats);
+    if (batch->stats != NULL)
+        job.stats = &stats;
+    for (;;) {
+        pthread_mutex_lock(&batch->mutex);
+        struct batch_entry *entry = batch->next_entry < batch->count ? batch->entries + batch->next_entry++ : NULL;
+        pthread_mutex_unlock(&batch->mutex);
+        if (entry == NULL)
+            break;
+
+        long start = monotonic_ms();
+        entry->ret = run_job(&job, entry->timefilename, entry->typescriptfilename, entry->outputfilename);
+        entry->milliseconds = monotonic_ms() - start;
+    }
+    job_free(&job);
+    if (batch->stats != NULL) {
+        pthread_mutex_lock(&batch->mutex);
+        stats_add(batch->stats, &stats);
+        pthread_mutex_unlock(&batch->mutex);
+    }
+    return NULL;
+}
 
-        fprintf(xmloutputfile, "</timestep>\n");
+/**
+ * Convert all recordings of @p source, a manifest or a directory,
+ * with @p thread_count threads and print a summary on stdout.
+ * Returns 0 if all recordings were converted successfully.
+ */
+static int run_batch(const struct job *options, const char *source, const char *output_directory, int thread_count)
+{
+    struct batch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.options = options;
+    batch.stats = options->stats;
+
+    struct stat st;
+    int ret;
+    if (stat(source, &st) == 0 && S_ISDIR(st.st_mode)) {
+        const char *output_suffix = options->output_format == FORMAT_BINARY ? ".bin" : (options->output_format == FORMAT_JSON ? ".ndjson" : ".xml");
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "%s%s", output_suffix, options->output_compression == COMPRESSION_GZIP ? ".gz" : (options->output_compression == COMPRESSION_ZSTD ? ".zst" : ""));
+        if (output_directory == NULL) {
+            fprintf(stderr, "Converting a directory requires --output-dir=DIR\n");
+            return 1;
+        }
+        ret = batch_read_directory(&batch, source, output_directory, suffix);
+    } else
+        ret = batch_read_manifest(&batch, source);
+
+    if (ret == 0) {
+        if ((size_t)thread_count > batch.count)
+            thread_count = batch.count > 0 ? (int)batch.count : 1;
+        pthread_mutex_init(&batch.mutex, NULL);
+        long start = monotonic_ms();
+        pthread_t *workers = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+        int started = 0;
+        if (workers != NULL)
+            for (; started < thread_count; ++started)
+                if (pthread_create(workers + started, NULL, batch_worker, &batch) != 0)
+                    break;
+        if (started == 0) {
+            /// No threads available, convert everything on this one
+            batch_worker(&batch);
+        }
+        for (int t = 0; t < started; ++t)
+            pthread_join(workers[t], NULL);
+        free(workers);
+        pthread_mutex_destroy(&batch.mutex);
+
+        size_t failed = 0;
+        for (size_t j = 0; j < batch.count; ++j) {
+            const struct batch_entry *entry = batch.entries + j;
+            printf("%-6s %8.3f s  %s\n", entry->ret == 0 ? "ok" : "failed", entry->milliseconds / 1000.0, entry->outputfilename);
+            if (entry->ret != 0)
+                ++failed;
+        }
+        printf("%zu of %zu recordings converted in %.3f s with %d threads\n", batch.count - failed, batch.count, (monotonic_ms() - start) / 1000.0, thread_count);
+        ret = failed > 0 ? 1 : 0;
     }
 
-    return 0;
+    for (size_t j = 0; j < batch.count; ++j) {
+        free(batch.entries[j].timefilename);
+        free(batch.entries[j].typescriptfilename);
+        free(batch.entries[j].outputfilename);
+    }
+    free(batch.entries);
+    return ret;
 }
 
 int main(int argc, char *argv[])
 {
-    debug_output = 0;
+    struct job options;
+    memset(&options, 0, sizeof(options));
+    struct job *job = &options;
+    job->use_mmap = 1;
+    int flush_mode_set = 0;
+    job->flush_mode = FLUSH_FULL;
+    job->latency = 100;
+    job->unflushed_since = -1;
+    job->threads = 1;
+    job->output_format = FORMAT_XML;
+    job->seek_time = -1;
+    job->from_time = job->to_time = -1;
+    job->screen_rows = SCREEN_DEFAULT_ROWS;
+    job->screen_columns = SCREEN_DEFAULT_COLUMNS;
+    struct stats stats;
+    stats_init(&stats);
+    int stats_json = 0;
+    job->output_compression = COMPRESSION_NONE;
+    const char *batch_source = NULL, *output_directory = NULL;
+    long batch_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /// In batch mode, all parameters are options
+    int positional = 3;
+    for (int argi = 1; argi < argc; ++argi)
+        if (strncmp("--batch=", argv[argi], 8) == 0)
+            positional = 0;
 
     /// Require three parameters passed to this program.
-    if (argc < 4) {
+    if (argc < 4 && positional > 0) {
         fprintf(stderr, "Require three parameters: timefilename typescriptfilename xmloutputfilename, got %d parameters\n", argc - 1);
+        fprintf(stderr, "The timing and typescript files may be compressed with gzip or zstd.\n");
         fprintf(stderr, "Optionally, there may be a '--debug' as the first parameter to enable debug output.\n");
+        fprintf(stderr, "Optionally, there may be a '--no-mmap' to read the typescript with fread instead of memory-mapping it.\n");
+        fprintf(stderr, "Optionally, there may be a '--follow' to convert a recording while 'script' is still writing it.\n");
+        fprintf(stderr, "Optionally, there may be a '--latency=MS' to write each timestep within MS milliseconds in follow mode (default: 100).\n");
+        fprintf(stderr, "Optionally, there may be a '--flush=full|latency|step' to control when output is flushed (default: latency in follow mode, full otherwise).\n");
+        fprintf(stderr, "Optionally, there may be a '-j N' to parse a memory-mapped typescript with N threads.\n");
+        fprintf(stderr, "Optionally, there may be a '--pipeline' to read the typescript, parse it and write the output on three threads.\n");
+        fprintf(stderr, "Optionally, there may be a '--format=xml|binary|json' to choose the output format (default: xml); binary output needs a seekable file, json writes one JSON object per line and event.\n");
+        fprintf(stderr, "Optionally, there may be a '--invalid-utf8=replace|drop|latin1' to replace bytes that are not valid UTF-8 by U+FFFD, leave them out or take them as ISO 8859-1 (default: replace).\n");
+        fprintf(stderr, "Optionally, there may be a '--index=FILE' to write a seek index for the recording to FILE.\n");
+        fprintf(stderr, "Optionally, there may be a '--seek=SECONDS' to start output at that time of the recording, using the index given with '--index=FILE' if any.\n");
+        fprintf(stderr, "Optionally, there may be a '--from=SECONDS' to start output at that time of the recording without parsing anything before it.\n");
+        fprintf(stderr, "Optionally, there may be a '--to=SECONDS' to stop converting after that time of the recording.\n");
+        fprintf(stderr, "Optionally, there may be a '--text-index=FILE' to append the text of the recording to the text index FILE, to be searched with 'searchtext'.\n");
+        fprintf(stderr, "Optionally, there may be a '--screen=FILE' to write the text on the terminal's screen at the end of the recording to FILE.\n");
+        fprintf(stderr, "Optionally, there may be a '--screen-at=SECONDS[,SECONDS...]' to write the screen at those times instead.\n");
+        fprintf(stderr, "Optionally, there may be a '--screen-size=ROWSxCOLUMNS' to set the size of the screen (default: %dx%d).\n", SCREEN_DEFAULT_ROWS, SCREEN_DEFAULT_COLUMNS);
+        fprintf(stderr, "Optionally, there may be a '--keyframes=SECONDS' to add the complete terminal state to the XML output every SECONDS of the recording.\n");
+        fprintf(stderr, "Optionally, there may be a '--keyframe-bytes=BYTES' to add the complete terminal state to the XML output every BYTES of typescript.\n");
+        fprintf(stderr, "Optionally, there may be a '--compress=gzip|zstd|zstd-seekable' to compress the XML output in independent blocks, zstd-seekable adds a seek table.\n");
+        fprintf(stderr, "Optionally, there may be a '--compress-level=N' to set the compression level (default: 6 for gzip, 3 for zstd).\n");
+        fprintf(stderr, "Optionally, there may be a '--compress-threads=N' to compress with N threads (default: number of processors).\n");
+        fprintf(stderr, "Optionally, there may be a '--stats' or '--stats=json' to report where time was spent and what the typescript contains on stderr.\n");
+        fprintf(stderr, "Alternatively, '--batch=MANIFEST' converts many recordings, one per line given as 'timefilename typescriptfilename outputfilename'.\n");
+        fprintf(stderr, "Alternatively, '--batch=DIRECTORY --output-dir=DIR' converts each NAME.timing with NAME.typescript in DIRECTORY to DIR/NAME.xml.\n");
+        fprintf(stderr, "Optionally, there may be a '--batch-threads=N' to convert N recordings at a time in batch mode (default: number of processors).\n");
         return 1;
     }
 
-    if (argc > 4 && strcmp("--debug", argv[argc - 4]) == 0) {
-        fprintf(stderr, "Enabling debug output\n");
-        debug_output = 1;
+    for (int argi = 1; argi < argc - positional; ++argi) {
+        if (strcmp("--debug", argv[argi]) == 0) {
+            fprintf(stderr, "Enabling debug output\n");
+            job->debug_output = 1;
+        } else if (strcmp("--no-mmap", argv[argi]) == 0) {
+            job->use_mmap = 0;
+        } else if (strcmp("-j", argv[argi]) == 0 && argi + 1 < argc - positional && atoi(argv[argi + 1]) > 0) {
+            job->threads = atoi(argv[++argi]);
+        } else if (strncmp("-j", argv[argi], 2) == 0 && atoi(argv[argi] + 2) > 0) {
+            job->threads = atoi(argv[argi] + 2);
+        } else if (strcmp("--pipeline", argv[argi]) == 0) {
+            job->pipeline = 1;
+        } else if (strcmp("--follow", argv[argi]) == 0) {
+            job->follow_mode = 1;
+        } else if (strncmp("--latency=", argv[argi], 10) == 0 && atoi(argv[argi] + 10) > 0) {
+            job->latency = atoi(argv[argi] + 10);
+        } else if (strncmp("--index=", argv[argi], 8) == 0 && argv[argi][8] != '\0') {
+            job->index_filename = argv[argi] + 8;
+        } else if (strncmp("--seek=", argv[argi], 7) == 0 && argv[argi][7] != '\0') {
+            char *end;
+            double seconds = strtod(argv[argi] + 7, &end);
+            if (*end != '\0' || !(seconds >= 0.0 && seconds < 1e12)) {
+                fprintf(stderr, "Invalid time \"%s\" for --seek\n", argv[argi] + 7);
+                return 1;
+            }
+            job->seek_time = (long long)(seconds * 1e6 + 0.5);
+        } else if ((strcmp("--from", argv[argi]) == 0 || strcmp("--to", argv[argi]) == 0) && argi + 1 < argc - positional) {
+            long long *time = argv[argi][2] == 'f' ? &job->from_time : &job->to_time;
+            if (parse_option_time(argv[argi + 1], time) != 0) {
+                fprintf(stderr, "Invalid time \"%s\" for %s\n", argv[argi + 1], argv[argi]);
+                return 1;
+            }
+            ++argi;
+        } else if (strncmp("--from=", argv[argi], 7) == 0 || strncmp("--to=", argv[argi], 5) == 0) {
+            const char *value = strchr(argv[argi], '=') + 1;
+            long long *time = argv[argi][2] == 'f' ? &job->from_time : &job->to_time;
+            if (parse_option_time(value, time) != 0) {
+                fprintf(stderr, "Invalid time \"%s\" for %.*s\n", value, (int)(value - 1 - argv[argi]), argv[argi]);
+                return 1;
+            }
+        } else if (strncmp("--text-index=", argv[argi], 13) == 0 && argv[argi][13] != '\0') {
+            job->text_index_filename = argv[argi] + 13;
+        } else if (strncmp("--screen=", argv[argi], 9) == 0 && argv[argi][9] != '\0') {
+            job->screen_filename = argv[argi] + 9;
+        } else if (strncmp("--screen-at=", argv[argi], 12) == 0) {
+            if (parse_screen_times(job, argv[argi] + 12) != 0) {
+                fprintf(stderr, "Invalid times \"%s\" for --screen-at\n", argv[argi] + 12);
+                return 1;
+            }
+        } else if (strncmp("--screen-size=", argv[argi], 14) == 0) {
+            char *end;
+            job->screen_rows = (int)strtol(argv[argi] + 14, &end, 10);
+            job->screen_columns = *end == 'x' ? (int)strtol(end + 1, &end, 10) : 0;
+            if (*end != '\0' || job->screen_rows < 1 || job->screen_rows > 10000 || job->screen_columns < 1 || job->screen_columns > 10000) {
+                fprintf(stderr, "Invalid size \"%s\" for --screen-size\n", argv[argi] + 14);
+                return 1;
+            }
+        } else if (strncmp("--keyframes=", argv[argi], 12) == 0) {
+            char *end;
+            double seconds = strtod(argv[argi] + 12, &end);
+            if (end == argv[argi] + 12 || *end != '\0' || !(seconds > 0.0 && seconds < 1e12)) {
+                fprintf(stderr, "Invalid interval \"%s\" for --keyframes\n", argv[argi] + 12);
+                return 1;
+            }
+            job->keyframe_interval = (long long)(seconds * 1e6 + 0.5);
+        } else if (strncmp("--keyframe-bytes=", argv[argi], 17) == 0) {
+            char *end;
+            unsigned long long bytes = strtoull(argv[argi] + 17, &end, 10);
+            if (end == argv[argi] + 17 || *end != '\0' || bytes == 0) {
+                fprintf(stderr, "Invalid size \"%s\" for --keyframe-bytes\n", argv[argi] + 17);
+                return 1;
+            }
+            job->keyframe_bytes = (size_t)bytes;
+        } else if (strcmp("--stats", argv[argi]) == 0 || strcmp("--stats=text", argv[argi]) == 0) {
+            job->stats = &stats;
+        } else if (strcmp("--stats=json", argv[argi]) == 0) {
+            job->stats = &stats;
+            stats_json = 1;
+        } else if (strcmp("--compress=gzip", argv[argi]) == 0) {
+            job->output_compression = COMPRESSION_GZIP;
+        } else if (strcmp("--compress=zstd", argv[argi]) == 0 || strcmp("--compress=zstd-seekable", argv[argi]) == 0) {
+            job->output_compression = COMPRESSION_ZSTD;
+            job->compress_seekable = argv[argi][15] != '\0';
+        } else if (strncmp("--compress-level=", argv[argi], 17) == 0 && atoi(argv[argi] + 17) > 0) {
+            job->compress_level = atoi(argv[argi] + 17);
+        } else if (strncmp("--compress-threads=", argv[argi], 19) == 0 && atoi(argv[argi] + 19) > 0) {
+            job->compress_threads = atoi(argv[argi] + 19);
+        } else if (strcmp("--format=xml", argv[argi]) == 0) {
+            job->output_format = FORMAT_XML;
+        } else if (strcmp("--format=binary", argv[argi]) == 0) {
+            job->output_format = FORMAT_BINARY;
+        } else if (strcmp("--format=json", argv[argi]) == 0) {
+            job->output_format = FORMAT_JSON;
+        } else if (strcmp("--invalid-utf8=replace", argv[argi]) == 0) {
+            job->invalid_utf8 = PARSER_UTF8_REPLACE;
+        } else if (strcmp("--invalid-utf8=drop", argv[argi]) == 0) {
+            job->invalid_utf8 = PARSER_UTF8_DROP;
+        } else if (strcmp("--invalid-utf8=latin1", argv[argi]) == 0) {
+            job->invalid_utf8 = PARSER_UTF8_LATIN1;
+        } else if (strcmp("--flush=full", argv[argi]) == 0) {
+            job->flush_mode = FLUSH_FULL;
+            flush_mode_set = 1;
+        } else if (strcmp("--flush=latency", argv[argi]) == 0) {
+            job->flush_mode = FLUSH_LATENCY;
+            flush_mode_set = 1;
+        } else if (strcmp("--flush=step", argv[argi]) == 0) {
+            job->flush_mode = FLUSH_STEP;
+            flush_mode_set = 1;
+        } else if (strncmp("--batch=", argv[argi], 8) == 0 && argv[argi][8] != '\0') {
+            batch_source = argv[argi] + 8;
+        } else if (strncmp("--batch-threads=", argv[argi], 16) == 0 && atoi(argv[argi] + 16) > 0) {
+            batch_threads = atoi(argv[argi] + 16);
+        } else if (strncmp("--output-dir=", argv[argi], 13) == 0 && argv[argi][13] != '\0') {
+            output_directory = argv[argi] + 13;
+        } else {
+            fprintf(stderr, "Unknown option \"%s\"\n", argv[argi]);
+            return 1;
+        }
     }
 
-    char *timefilename = argv[argc - 3];
-    timefile = fopen(timefilename, "r");
-    if (!timefile) {
-        fprintf(stderr, "Cannot open timefilename \"%s\"\n", timefilename);
+    if (job->follow_mode && (job->seek_time >= 0 || job->from_time >= 0)) {
+        fprintf(stderr, "Cannot seek in a recording that is still being written\n");
+        return 1;
+    }
+    if (job->from_time >= 0 && (job->seek_time >= 0 || job->index_filename != NULL)) {
+        fprintf(stderr, "Option --from cannot be combined with --seek or --index\n");
+        return 1;
+    }
+    if (job->from_time >= 0 && job->to_time >= 0 && job->to_time < job->from_time) {
+        fprintf(stderr, "Time given with --to is before the one given with --from\n");
         return 1;
     }
 
-    char *typescriptfilename = argv[argc - 2];
-    typescriptfile = fopen(typescriptfilename, "r");
-    if (!typescriptfile) {
-        fclose(timefile);
-        fprintf(stderr, "Cannot open typescriptfilename \"%s\"\n", typescriptfilename);
+    if (job->screen_time_count > 0 && job->screen_filename == NULL) {
+        fprintf(stderr, "Option --screen-at requires --screen=FILE\n");
         return 1;
     }
 
-    char *xmloutputfilename = argv[argc - 1];
-    if (xmloutputfilename[0] == '-' && xmloutputfilename[1] == '\0') {
-        /// Write to stdout instead of to a file
-        xmloutputfile = stdout;
-    } else {
-        /// Write to a plain text file
-        xmloutputfile = fopen(xmloutputfilename, "w");
+    if (job->output_compression != COMPRESSION_NONE && job->output_format == FORMAT_BINARY) {
+        fprintf(stderr, "Only XML and JSON output can be compressed\n");
+        return 1;
     }
-    if (!xmloutputfile) {
-        fclose(typescriptfile);
-        fclose(timefile);
-        fprintf(stderr, "Cannot open xmloutputfilename \"%s\"\n", xmloutputfilename);
+    if (job->compress_level == 0)
+        job->compress_level = job->output_compression == COMPRESSION_GZIP ? 6 : 3;
+    else if (job->compress_level > (job->output_compression == COMPRESSION_GZIP ? 9 : 22)) {
+        fprintf(stderr, "Invalid compression level %d for %s\n", job->compress_level, compression_name(job->output_compression));
         return 1;
-    } else {
-        fprintf(xmloutputfile, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
-        fprintf(xmloutputfile, "<script>\n");
+    }
+    if (job->compress_threads == 0) {
+        /// In batch mode, the recordings already keep all processors busy
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        job->compress_threads = batch_source != NULL || processors < 1 ? 1 : (int)processors;
     }
 
-    /// Initial size of buffer typescriptbuffer, will grow later
-    typescriptbuffer_size = 16;
-    typescriptbuffer = (char *)calloc(typescriptbuffer_size, sizeof(char));
+    if ((job->keyframe_interval > 0 || job->keyframe_bytes > 0) && job->output_format != FORMAT_XML) {
+        fprintf(stderr, "Keyframes can only be added to XML output\n");
+        return 1;
+    }
+    job->use_screen = job->screen_filename != NULL || job->keyframe_interval > 0 || job->keyframe_bytes > 0;
 
-    int ret = process_timefile();
-    if (ret != 0) {
-        if (xmloutputfile != stdout)
-            fclose(xmloutputfile);
-        fclose(timefile);
-        fclose(typescriptfile);
-        free(typescriptbuffer);
+    if (batch_source != NULL) {
+        if (job->follow_mode || job->index_filename != NULL || job->seek_time >= 0 || job->screen_filename != NULL) {
+            fprintf(stderr, "Options --follow, --index, --seek and --screen cannot be used in batch mode\n");
+            return 1;
+        }
+        if (job->threads > 1) {
+            fprintf(stderr, "Recordings are parsed with a single thread each in batch mode, use --batch-threads=N instead of -j\n");
+            job->threads = 1;
+        }
+        /// Every worker counts into its own statistics, added up at the end;
+        /// stages cannot be told apart with several conversions at once
+        if (job->stats != NULL)
+            stats_start(job->stats, 0);
+        int ret = run_batch(job, batch_source, output_directory, batch_threads > 0 ? (int)batch_threads : 1);
+        free(job->screen_times);
+        if (job->stats != NULL)
+            stats_report(job->stats, stderr, stats_json);
         return ret;
     }
 
-    fprintf(xmloutputfile, "</script>\n");
+    if (job->stats != NULL && stats_start(job->stats, 1) != 0) {
+        fprintf(stderr, "Cannot start sampling for --stats\n");
+        return 1;
+    }
+
+    if (job->follow_mode) {
+        /// A growing file cannot be memory-mapped once
+        job->use_mmap = 0;
+        if (!flush_mode_set)
+            job->flush_mode = FLUSH_LATENCY;
+    }
 
-    if (xmloutputfile != stdout)
-        fclose(xmloutputfile);
-    fclose(timefile);
-    fclose(typescriptfile);
-    free(typescriptbuffer);
+    int ret = run_job(job, argv[argc - 3], argv[argc - 2], argv[argc - 1]);
+    job_free(job);
+    free(job->screen_times);
+    if (job->stats != NULL)
+        stats_report(job->stats, stderr, stats_json);
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,112 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "textindex.h"
+#include "timingfile.h"
+
+/// Bytes of text shown before and after a match by default
+#define SEARCHTEXT_DEFAULT_CONTEXT 40
+
+/**
+ * Print a match as the recording, the time it appeared and the
+ * line it is in, at most @p context bytes before and after it.
+ */
+static void print_hit(void *context, const struct textindex_hit *hit)
+{
+    size_t bytes = *(const size_t *)context;
+    const char *text = hit->text;
+
+    /// Stay within the line and do not cut UTF-8 characters in two
+    size_t start = hit->position > bytes ? hit->position - bytes : 0;
+    const char *lf = NULL;
+    for (size_t i = hit->position; i > start; --i)
+        if (text[i - 1] == '\n') {
+            lf = text + i - 1;
+            break;
+        }
+    if (lf != NULL)
+        start = (size_t)(lf - text) + 1;
+    while (start < hit->position && (text[start] & 0xc0) == 0x80)
+        ++start;
+
+    size_t end = hit->position + bytes < hit->text_length ? hit->position + bytes : hit->text_length;
+    lf = memchr(text + hit->position, '\n', end - hit->position);
+    if (lf != NULL)
+        end = (size_t)(lf - text);
+    while (end < hit->text_length && end > hit->position && (text[end] & 0xc0) == 0x80)
+        --end;
+
+    char seconds[24];
+    timing_format_delay(seconds, hit->time);
+    printf("%.*s\t%s\t", (int)hit->name_length, hit->name, seconds);
+    /// Tabs in the text would look like another column
+    for (size_t i = start; i < end; ++i)
+        putchar(text[i] == '\t' ? ' ' : text[i]);
+    putchar('\n');
+}
+
+/**
+ * Search a text index written with 'scriptinterpreter
+ * --text-index=FILE' for a text and print every match with its
+ * recording, recording time and the text around it.
+ */
+int main(int argc, char *argv[])
+{
+    size_t context = SEARCHTEXT_DEFAULT_CONTEXT;
+    int argi = 1;
+    for (; argi < argc - 2; ++argi) {
+        if (strncmp("--context=", argv[argi], 10) != 0) {
+            fprintf(stderr, "Unknown option \"%s\"\n", argv[argi]);
+            return 2;
+        }
+        char *end;
+        context = strtoul(argv[argi] + 10, &end, 10);
+        if (end == argv[argi] + 10 || *end != '\0') {
+            fprintf(stderr, "Invalid size \"%s\" for --context\n", argv[argi] + 10);
+            return 2;
+        }
+    }
+    if (argc - argi != 2) {
+        fprintf(stderr, "Require two parameters: textindexfilename text, got %d parameters\n", argc - argi);
+        fprintf(stderr, "Each match is printed as recording, time in seconds and the text around it, separated by tabs.\n");
+        fprintf(stderr, "Optionally, there may be a '--context=BYTES' to show up to BYTES of the line before and after a match (default: %d).\n", SEARCHTEXT_DEFAULT_CONTEXT);
+        fprintf(stderr, "The exit code is 0 if there are matches, 1 if there are none and 2 on errors.\n");
+        return 2;
+    }
+
+    struct textindex index;
+    if (textindex_open(&index, argv[argi]) != 0)
+        return 2;
+    size_t hits = textindex_search(&index, argv[argi + 1], strlen(argv[argi + 1]), print_hit, &context);
+    textindex_close(&index);
+
+    if (fflush(stdout) != 0) {
+        fprintf(stderr, "Cannot write matches\n");
+        return 2;
+    }
+    return hits > 0 ? 0 : 1;
+}
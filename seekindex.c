@@ -0,0 +1,319 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "seekindex.h"
+
+/**
+ * Set @p attributes to those of a freshly started terminal.
+ */
+void seekindex_attributes_init(struct seekindex_attributes *attributes)
+{
+    memset(attributes, 0, sizeof(struct seekindex_attributes));
+    attributes->foreground = attributes->background = 9; ///< default color
+    attributes->foreground_intensity = attributes->background_intensity = COLOR_NORMAL;
+}
+
+/**
+ * Event sink callback for a struct seekindex_tracker passed
+ * as @p context.
+ */
+void seekindex_track(void *context, const struct event *event)
+{
+    struct seekindex_tracker *tracker = (struct seekindex_tracker *)context;
+    struct seekindex_attributes *attributes = &tracker->attributes;
+
+    switch (event->type) {
+    case EVENT_COLOR:
+        if (event->kind == COLOR_RESET) {
+            attributes->foreground = attributes->background = 9;
+            attributes->foreground_intensity = attributes->background_intensity = COLOR_NORMAL;
+        } else if (event->kind == COLOR_FOREGROUND) {
+            attributes->foreground = (uint8_t)event->value;
+            attributes->foreground_intensity = (uint8_t)event->intensity;
+        } else {
+            attributes->background = (uint8_t)event->value;
+            attributes->background_intensity = (uint8_t)event->intensity;
+        }
+        break;
+    case EVENT_SCREEN:
+        attributes->screen = (uint8_t)event->value;
+        break;
+    case EVENT_CURSOR:
+        if (event->kind == CURSOR_SHOW)
+            attributes->cursor_hidden = !event->value;
+        else if (event->kind == CURSOR_BLINKING)
+            attributes->cursor_blinking = (uint8_t)event->value;
+        else if (event->kind == CURSOR_KEY_CONTROL)
+            attributes->cursor_application_keys = (uint8_t)event->value;
+        break;
+    default:
+        break;
+    }
+
+    if (tracker->next.event != NULL)
+        event_emit(&tracker->next, event);
+}
+
+/**
+ * Pass events on to @p sink that change the attributes of a
+ * freshly started terminal to @p attributes.
+ */
+void seekindex_restore(const struct seekindex_attributes *attributes, const struct event_sink *sink)
+{
+    struct event event;
+    if (attributes->screen != 0) {
+        event = (struct event) { .type = EVENT_SCREEN, .value = attributes->screen };
+        event_emit(sink, &event);
+    }
+    if (attributes->foreground != 9 || attributes->foreground_intensity != COLOR_NORMAL) {
+        event = (struct event) { .type = EVENT_COLOR, .kind = COLOR_FOREGROUND, .value = attributes->foreground, .intensity = attributes->foreground_intensity };
+        event_emit(sink, &event);
+    }
+    if (attributes->background != 9 || attributes->background_intensity != COLOR_NORMAL) {
+        event = (struct event) { .type = EVENT_COLOR, .kind = COLOR_BACKGROUND, .value = attributes->background, .intensity = attributes->background_intensity };
+        event_emit(sink, &event);
+    }
+    if (attributes->cursor_hidden) {
+        event = (struct event) { .type = EVENT_CURSOR, .kind = CURSOR_SHOW, .value = 0 };
+        event_emit(sink, &event);
+    }
+    if (attributes->cursor_blinking) {
+        event = (struct event) { .type = EVENT_CURSOR, .kind = CURSOR_BLINKING, .value = 1 };
+        event_emit(sink, &event);
+    }
+    if (attributes->cursor_application_keys) {
+        event = (struct event) { .type = EVENT_CURSOR, .kind = CURSOR_KEY_CONTROL, .value = 1 };
+        event_emit(sink, &event);
+    }
+}
+
+/**
+ * Create the index file @p filename. Returns 0 on success.
+ */
+int seekindex_create(struct seekindex_writer *writer, const char *filename)
+{
+    writer->file = fopen(filename, "wb");
+    if (writer->file == NULL) {
+        fprintf(stderr, "Cannot create index file \"%s\"\n", filename);
+        return 1;
+    }
+    writer->entry_count = 0;
+    writer->last_time = 0;
+    writer->last_typescript_offset = 0;
+
+    /// Placeholder, an incomplete file is recognized by its missing magic
+    struct seekindex_header header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, writer->file);
+    return 0;
+}
+
+/**
+ * Whether a new entry should be added for a step starting at
+ * @p time and @p typescript_offset.
+ */
+int seekindex_due(const struct seekindex_writer *writer, int64_t time, uint64_t typescript_offset)
+{
+    return writer->entry_count == 0 || time - writer->last_time >= SEEKINDEX_INTERVAL
+           || typescript_offset - writer->last_typescript_offset >= SEEKINDEX_BYTES;
+}
+
+/**
+ * Append @p entry to the index.
+ */
+void seekindex_add(struct seekindex_writer *writer, const struct seekindex_entry *entry)
+{
+    fwrite(entry, sizeof(struct seekindex_entry), 1, writer->file);
+    ++writer->entry_count;
+    writer->last_time = entry->time;
+    writer->last_typescript_offset = entry->typescript_offset;
+}
+
+/**
+ * Add the bytes @p data to the FNV-1a hash @p hash
+ */
+static uint64_t hash_bytes(uint64_t hash, const unsigned char *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/**
+ * Describe the file @p filename in @p source.
+ * Returns 0 on success.
+ */
+static int describe_source(struct seekindex_source *source, const char *filename)
+{
+    memset(source, 0, sizeof(struct seekindex_source));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open \"%s\"\n", filename);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 0;
+    }
+
+    /// The beginning and the end, without reading all of a large file
+    unsigned char block[SEEKINDEX_HASH_BYTES];
+    uint64_t hash = 0xcbf29ce484222325ull;
+    off_t offsets[2] = { 0, st.st_size > SEEKINDEX_HASH_BYTES ? st.st_size - SEEKINDEX_HASH_BYTES : 0 };
+    for (int i = 0; i < 2; ++i) {
+        ssize_t len = pread(fd, block, sizeof(block), offsets[i]);
+        if (len < 0) {
+            close(fd);
+            fprintf(stderr, "Cannot read \"%s\"\n", filename);
+            return 1;
+        }
+        hash = hash_bytes(hash, block, (size_t)len);
+    }
+    close(fd);
+    source->size = (uint64_t)st.st_size;
+    source->hash = hash;
+    return 0;
+}
+
+/**
+ * Complete the header, describing the recording's files
+ * @p timefilename and @p typescriptfilename as they are now,
+ * and close the file. Returns 0 on success.
+ */
+int seekindex_finish(struct seekindex_writer *writer, const char *timefilename, const char *typescriptfilename)
+{
+    struct seekindex_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEEKINDEX_MAGIC, sizeof(header.magic));
+    header.version = SEEKINDEX_VERSION;
+    header.byte_order = SEEKINDEX_BYTE_ORDER;
+    header.entry_count = writer->entry_count;
+    header.entry_offset = sizeof(header);
+
+    int ret = describe_source(&header.timing, timefilename) != 0 || describe_source(&header.typescript, typescriptfilename) != 0;
+    if (fflush(writer->file) != 0 || ferror(writer->file) || fseek(writer->file, 0, SEEK_SET) != 0
+            || fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        fprintf(stderr, "Cannot write index file\n");
+        ret = 1;
+    }
+    if (fclose(writer->file) != 0)
+        ret = 1;
+    writer->file = NULL;
+    return ret;
+}
+
+/**
+ * Map the index file @p filename and check its header.
+ * If it was written for other files than @p timefilename and
+ * @p typescriptfilename, or for them before they changed, it is
+ * not used: a warning is printed and @c map is left NULL.
+ * Returns 0 on success, also in that case.
+ */
+int seekindex_open(struct seekindex *index, const char *filename, const char *timefilename, const char *typescriptfilename)
+{
+    index->map = NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open index file \"%s\"\n", filename);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct seekindex_header)) {
+        close(fd);
+        fprintf(stderr, "Index file \"%s\" is too short\n", filename);
+        return 1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Cannot map index file \"%s\"\n", filename);
+        return 1;
+    }
+    index->map = (const char *)map;
+    index->size = (size_t)st.st_size;
+
+    const struct seekindex_header *header = (const struct seekindex_header *)map;
+    if (memcmp(header->magic, SEEKINDEX_MAGIC, sizeof(header->magic)) != 0 || header->byte_order != SEEKINDEX_BYTE_ORDER
+            || header->version != SEEKINDEX_VERSION) {
+        fprintf(stderr, "\"%s\" is not a complete index file of a supported version\n", filename);
+    } else if (header->entry_offset % 8 != 0 || header->entry_offset > index->size
+               || header->entry_count > (index->size - header->entry_offset) / sizeof(struct seekindex_entry)) {
+        fprintf(stderr, "Index file \"%s\" is corrupt\n", filename);
+    } else {
+        struct seekindex_source timing, typescript;
+        if (describe_source(&timing, timefilename) != 0 || describe_source(&typescript, typescriptfilename) != 0) {
+            seekindex_close(index);
+            return 1;
+        }
+        if (memcmp(&timing, &header->timing, sizeof(timing)) != 0 || memcmp(&typescript, &header->typescript, sizeof(typescript)) != 0) {
+            /// Offsets into other files would seek to arbitrary places
+            fprintf(stderr, "Index file \"%s\" does not belong to this recording, parsing from the beginning\n", filename);
+            seekindex_close(index);
+            return 0;
+        }
+        index->entries = (const struct seekindex_entry *)(index->map + header->entry_offset);
+        index->entry_count = (size_t)header->entry_count;
+        return 0;
+    }
+
+    seekindex_close(index);
+    return 1;
+}
+
+/**
+ * Find the last entry for a step starting before @p time with
+ * binary search. Returns NULL if there is none, i.e. conversion
+ * has to start at the beginning.
+ */
+const struct seekindex_entry *seekindex_find(const struct seekindex *index, int64_t time)
+{
+    /// Number of entries with a time before @p time, entries are sorted by time
+    size_t low = 0, high = index->entry_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (index->entries[middle].time < time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low > 0 ? index->entries + low - 1 : NULL;
+}
+
+/**
+ * Unmap the index file.
+ */
+void seekindex_close(struct seekindex *index)
+{
+    if (index->map != NULL)
+        munmap((void *)index->map, index->size);
+    index->map = NULL;
+}
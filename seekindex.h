@@ -0,0 +1,188 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_SEEKINDEX_H
+#define SCRIPTINTERPRETER_SEEKINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "events.h"
+#include "parser.h"
+
+/**
+ * A seek index is a sidecar file written while converting a
+ * recording. At regular intervals it records where a timing step
+ * starts in the timing file, the typescript and the output, together
+ * with everything needed to continue parsing from there. Entries are
+ * only taken at steps where the parser is not inside an escape
+ * sequence, so apart from a pending CR, the graphic rendition and
+ * the last character no parser state is needed.
+ * The header describes the timing and typescript file the index was
+ * written for, so that it is not used for another recording.
+ * All numbers are stored in the byte order of the writing machine.
+ */
+#define SEEKINDEX_MAGIC "SISEEKIX"
+#define SEEKINDEX_VERSION 4
+#define SEEKINDEX_BYTE_ORDER 0x01020304u
+/// Recording time in microseconds after which a new entry is due
+#define SEEKINDEX_INTERVAL 1000000
+/// Typescript bytes after which a new entry is due, no matter the time
+#define SEEKINDEX_BYTES (1 << 20)
+/// Bytes at the start and at the end of a file that its hash covers
+#define SEEKINDEX_HASH_BYTES 4096
+
+/**
+ * Display attributes in effect at an index entry, set by events
+ * before it. Colors are numbered like in struct event.
+ */
+struct seekindex_attributes {
+    uint8_t foreground, foreground_intensity;
+    uint8_t background, background_intensity;
+    uint8_t screen;
+    uint8_t cursor_hidden;
+    uint8_t cursor_blinking;
+    uint8_t cursor_application_keys;
+};
+
+/**
+ * A file of the recording as it was when the index was written.
+ * Files that are not regular files have a size and hash of 0.
+ */
+struct seekindex_source {
+    uint64_t size;
+    uint64_t hash; ///< FNV-1a hash of the first and last SEEKINDEX_HASH_BYTES bytes
+};
+
+struct seekindex_header {
+    char magic[8]; ///< SEEKINDEX_MAGIC without terminating null character
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t entry_count, entry_offset;
+    struct seekindex_source timing, typescript;
+};
+
+struct seekindex_entry {
+    int64_t time; ///< recording time in microseconds before the step's delay
+    uint64_t line; ///< line number of the step in the timing file
+    uint64_t timing_offset; ///< offset of that line in the timing file
+    uint64_t typescript_offset; ///< offset of the step's bytes in the typescript
+    uint64_t output_offset; ///< bytes of output written before the step
+    struct seekindex_attributes attributes;
+    uint8_t pending_cr; ///< parser has seen a CR at the end of the previous step
+    struct parser_rendition rendition; ///< colors set by SGR, parser side of @c attributes
+    uint8_t last_character_len; ///< bytes in @c last_character, 0 if none
+    char last_character[4]; ///< last graphic character, repeated by REP
+    uint8_t reserved[4];
+};
+
+/**
+ * Event sink passing events on to @c next (if set) while keeping
+ * track of the display attributes they change.
+ */
+struct seekindex_tracker {
+    struct seekindex_attributes attributes;
+    struct event_sink next; ///< events are dropped if @c next.event is NULL
+};
+
+/**
+ * Writer of a seek index file
+ */
+struct seekindex_writer {
+    FILE *file;
+    uint64_t entry_count;
+    int64_t last_time; ///< time of the last entry
+    uint64_t last_typescript_offset; ///< typescript offset of the last entry
+};
+
+/**
+ * A memory-mapped seek index file
+ */
+struct seekindex {
+    const char *map;
+    size_t size;
+    const struct seekindex_entry *entries;
+    size_t entry_count;
+};
+
+/**
+ * Set @p attributes to those of a freshly started terminal.
+ */
+void seekindex_attributes_init(struct seekindex_attributes *attributes);
+
+/**
+ * Event sink callback for a struct seekindex_tracker passed
+ * as @p context.
+ */
+void seekindex_track(void *context, const struct event *event);
+
+/**
+ * Pass events on to @p sink that change the attributes of a
+ * freshly started terminal to @p attributes.
+ */
+void seekindex_restore(const struct seekindex_attributes *attributes, const struct event_sink *sink);
+
+/**
+ * Create the index file @p filename. Returns 0 on success.
+ */
+int seekindex_create(struct seekindex_writer *writer, const char *filename);
+
+/**
+ * Whether a new entry should be added for a step starting at
+ * @p time and @p typescript_offset.
+ */
+int seekindex_due(const struct seekindex_writer *writer, int64_t time, uint64_t typescript_offset);
+
+/**
+ * Append @p entry to the index.
+ */
+void seekindex_add(struct seekindex_writer *writer, const struct seekindex_entry *entry);
+
+/**
+ * Complete the header, describing the recording's files
+ * @p timefilename and @p typescriptfilename as they are now,
+ * and close the file. Returns 0 on success.
+ */
+int seekindex_finish(struct seekindex_writer *writer, const char *timefilename, const char *typescriptfilename);
+
+/**
+ * Map the index file @p filename and check its header.
+ * If it was written for other files than @p timefilename and
+ * @p typescriptfilename, or for them before they changed, it is
+ * not used: a warning is printed and @c map is left NULL.
+ * Returns 0 on success, also in that case.
+ */
+int seekindex_open(struct seekindex *index, const char *filename, const char *timefilename, const char *typescriptfilename);
+
+/**
+ * Find the last entry for a step starting before @p time with
+ * binary search. Returns NULL if there is none, i.e. conversion
+ * has to start at the beginning.
+ */
+const struct seekindex_entry *seekindex_find(const struct seekindex *index, int64_t time);
+
+/**
+ * Unmap the index file.
+ */
+void seekindex_close(struct seekindex *index);
+
+#endif // SCRIPTINTERPRETER_SEEKINDEX_H
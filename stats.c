@@ -0,0 +1,263 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "stats.h"
+
+/// Statistics whose stage is sampled, the timers and signal
+/// handlers exist once per process
+static struct stats *volatile sampled_stats;
+static struct timespec start_time;
+static struct rusage start_usage;
+static const char *stage_names[STATS_STAGE_COUNT] = { "other", "timing", "read", "classify", "dispatch", "output" };
+
+/**
+ * Signal handler for SIGALRM, counting a sample of wall-clock time
+ */
+static void sample_wall(int signal)
+{
+    (void)signal;
+    ++sampled_stats->wall_samples[sampled_stats->stage];
+}
+
+/**
+ * Signal handler for SIGPROF, counting a sample of CPU time
+ */
+static void sample_cpu(int signal)
+{
+    (void)signal;
+    ++sampled_stats->cpu_samples[sampled_stats->stage];
+}
+
+/**
+ * Set all counters of @p stats to zero.
+ */
+void stats_init(struct stats *stats)
+{
+    memset(stats, 0, sizeof(struct stats));
+    stats->stage = STATS_OTHER;
+}
+
+/**
+ * Add the counters of @p stats to those of @p total, taking
+ * the larger of the peak values.
+ */
+void stats_add(struct stats *total, const struct stats *stats)
+{
+    for (int i = 0; i < 128; ++i) {
+        total->csi_count[i] += stats->csi_count[i];
+        total->csi_bytes[i] += stats->csi_bytes[i];
+        total->sgr_count[i] += stats->sgr_count[i];
+    }
+    total->osc_count += stats->osc_count;
+    total->osc_bytes += stats->osc_bytes;
+    total->dcs_count += stats->dcs_count;
+    total->dcs_bytes += stats->dcs_bytes;
+    total->escape_count += stats->escape_count;
+    total->text_bytes += stats->text_bytes;
+    total->control_bytes += stats->control_bytes;
+    total->invalid_utf8_bytes += stats->invalid_utf8_bytes;
+    total->steps += stats->steps;
+    for (int i = 0; i < STATS_HISTOGRAM_SIZE; ++i)
+        total->step_sizes[i] += stats->step_sizes[i];
+    total->events += stats->events;
+    if (stats->largest_step > total->largest_step)
+        total->largest_step = stats->largest_step;
+    if (stats->largest_sequence > total->largest_sequence)
+        total->largest_sequence = stats->largest_sequence;
+    if (stats->largest_command_string > total->largest_command_string)
+        total->largest_command_string = stats->largest_command_string;
+    if (stats->timing_table_bytes > total->timing_table_bytes)
+        total->timing_table_bytes = stats->timing_table_bytes;
+    if (stats->output_buffer_bytes > total->output_buffer_bytes)
+        total->output_buffer_bytes = stats->output_buffer_bytes;
+    for (int i = 0; i < STATS_STAGE_COUNT; ++i) {
+        total->wall_samples[i] += stats->wall_samples[i];
+        total->cpu_samples[i] += stats->cpu_samples[i];
+    }
+}
+
+/**
+ * Event sink callback counting an event and passing it on for
+ * the struct stats_counter passed as @p context, in STATS_OUTPUT.
+ */
+void stats_output(void *context, const struct event *event)
+{
+    struct stats_counter *counter = (struct stats_counter *)context;
+    int previous = stats_enter(counter->stats, STATS_OUTPUT);
+    ++counter->stats->events;
+    event_emit(&counter->next, event);
+    stats_leave(counter->stats, previous);
+}
+
+/**
+ * Add a timing step of @p length bytes to the histogram.
+ */
+void stats_count_step(struct stats *stats, size_t length)
+{
+    int bucket = 0;
+    while (bucket < STATS_HISTOGRAM_SIZE - 1 && (length >> bucket) != 0)
+        ++bucket;
+    ++stats->step_sizes[bucket];
+    ++stats->steps;
+    if (length > stats->largest_step)
+        stats->largest_step = length;
+}
+
+/**
+ * Start measuring time and, if @p sample_stages is non-zero,
+ * sampling the stage of @p stats, which only works for one
+ * struct stats per process at a time. Returns 0 on success.
+ */
+int stats_start(struct stats *stats, int sample_stages)
+{
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    getrusage(RUSAGE_SELF, &start_usage);
+    stats->stage = STATS_OTHER;
+    if (!sample_stages)
+        return 0;
+    sampled_stats = stats;
+
+    /// Interrupted reads and writes are restarted
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    action.sa_handler = sample_wall;
+    if (sigaction(SIGALRM, &action, NULL) != 0)
+        return 1;
+    action.sa_handler = sample_cpu;
+    if (sigaction(SIGPROF, &action, NULL) != 0)
+        return 1;
+
+    struct itimerval interval = { { 0, 1000000 / STATS_SAMPLE_RATE }, { 0, 1000000 / STATS_SAMPLE_RATE } };
+    return setitimer(ITIMER_REAL, &interval, NULL) != 0 || setitimer(ITIMER_PROF, &interval, NULL) != 0;
+}
+
+/**
+ * Difference between two times of struct timeval in seconds
+ */
+static double seconds_between(const struct timeval *from, const struct timeval *to)
+{
+    return (double)(to->tv_sec - from->tv_sec) + (to->tv_usec - from->tv_usec) / 1e6;
+}
+
+/**
+ * Stop sampling and write the report on @p stats to @p file,
+ * as JSON if @p json is non-zero.
+ */
+void stats_report(struct stats *stats, FILE *file, int json)
+{
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_REAL, &off, NULL);
+    setitimer(ITIMER_PROF, &off, NULL);
+
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    struct rusage end_usage;
+    getrusage(RUSAGE_SELF, &end_usage);
+    double wall = (double)(end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    double user = seconds_between(&start_usage.ru_utime, &end_usage.ru_utime);
+    double system = seconds_between(&start_usage.ru_stime, &end_usage.ru_stime);
+
+    /// Stage times are the totals split up like the samples
+    long wall_total = 0, cpu_total = 0;
+    for (int i = 0; i < STATS_STAGE_COUNT; ++i) {
+        wall_total += stats->wall_samples[i];
+        cpu_total += stats->cpu_samples[i];
+    }
+    double stage_wall[STATS_STAGE_COUNT], stage_cpu[STATS_STAGE_COUNT];
+    for (int i = 0; i < STATS_STAGE_COUNT; ++i) {
+        stage_wall[i] = wall_total > 0 ? wall * stats->wall_samples[i] / wall_total : 0.0;
+        stage_cpu[i] = cpu_total > 0 ? (user + system) * stats->cpu_samples[i] / cpu_total : 0.0;
+    }
+
+    unsigned long long sequences = 0, sequence_bytes = 0;
+    for (int i = 0; i < 128; ++i) {
+        sequences += stats->csi_count[i];
+        sequence_bytes += stats->csi_bytes[i];
+    }
+
+    if (json) {
+        fprintf(file, "{\n  \"wall_seconds\": %.6f,\n  \"cpu_seconds\": %.6f,\n  \"user_seconds\": %.6f,\n  \"system_seconds\": %.6f,\n", wall, user + system, user, system);
+        fprintf(file, "  \"stages\": {");
+        for (int i = 0; i < STATS_STAGE_COUNT; ++i)
+            fprintf(file, "%s\n    \"%s\": { \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"wall_samples\": %d, \"cpu_samples\": %d }", i > 0 ? "," : "",
+                    stage_names[i], stage_wall[i], stage_cpu[i], (int)stats->wall_samples[i], (int)stats->cpu_samples[i]);
+        fprintf(file, "\n  },\n  \"steps\": %llu,\n  \"events\": %llu,\n  \"text_bytes\": %llu,\n  \"control_bytes\": %llu,\n  \"invalid_utf8_bytes\": %llu,\n  \"escape_sequences\": %llu,\n",
+                stats->steps, stats->events, stats->text_bytes, stats->control_bytes, stats->invalid_utf8_bytes, stats->escape_count);
+        fprintf(file, "  \"csi\": {");
+        for (int i = 0, first = 1; i < 128; ++i)
+            if (stats->csi_count[i] > 0) {
+                fprintf(file, "%s\n    \"%s%c\": { \"count\": %llu, \"bytes\": %llu }", first ? "" : ",", i == '\\' || i == '"' ? "\\" : "", i, stats->csi_count[i], stats->csi_bytes[i]);
+                first = 0;
+            }
+        fprintf(file, "\n  },\n  \"sgr\": {");
+        for (int i = 0, first = 1; i < 128; ++i)
+            if (stats->sgr_count[i] > 0) {
+                fprintf(file, "%s \"%d\": %llu", first ? "" : ",", i, stats->sgr_count[i]);
+                first = 0;
+            }
+        fprintf(file, " },\n  \"osc\": { \"count\": %llu, \"bytes\": %llu },\n  \"dcs\": { \"count\": %llu, \"bytes\": %llu },\n",
+                stats->osc_count, stats->osc_bytes, stats->dcs_count, stats->dcs_bytes);
+        fprintf(file, "  \"step_sizes\": [");
+        for (int i = 0, first = 1; i < STATS_HISTOGRAM_SIZE; ++i)
+            if (stats->step_sizes[i] > 0) {
+                fprintf(file, "%s { \"below\": %llu, \"count\": %llu }", first ? "" : ",", 1ULL << i, stats->step_sizes[i]);
+                first = 0;
+            }
+        fprintf(file, " ],\n  \"peak\": { \"step_bytes\": %zu, \"control_sequence_bytes\": %zu, \"command_string_bytes\": %zu, \"timing_table_bytes\": %zu, \"output_buffer_bytes\": %zu }\n}\n",
+                stats->largest_step, stats->largest_sequence, stats->largest_command_string, stats->timing_table_bytes, stats->output_buffer_bytes);
+        return;
+    }
+
+    fprintf(file, "Wall time %.3f s, CPU time %.3f s (user %.3f s, system %.3f s)\n", wall, user + system, user, system);
+    if (wall_total > 0 || cpu_total > 0) {
+        /// Stages are not sampled while several conversions run at once
+        fprintf(file, "%-10s %10s %10s   (%d samples per second)\n", "stage", "wall s", "CPU s", STATS_SAMPLE_RATE);
+        for (int i = 0; i < STATS_STAGE_COUNT; ++i)
+            fprintf(file, "%-10s %10.3f %10.3f\n", stage_names[i], stage_wall[i], stage_cpu[i]);
+    }
+    fprintf(file, "%llu steps, %llu events, %llu text bytes, %llu control characters, %llu invalid UTF-8 bytes, %llu other escape sequences\n",
+            stats->steps, stats->events, stats->text_bytes, stats->control_bytes, stats->invalid_utf8_bytes, stats->escape_count);
+    fprintf(file, "%llu control sequences with %llu bytes:\n", sequences, sequence_bytes);
+    for (int i = 0; i < 128; ++i)
+        if (stats->csi_count[i] > 0)
+            fprintf(file, "  CSI %c %12llu sequences %14llu bytes\n", i, stats->csi_count[i], stats->csi_bytes[i]);
+    fprintf(file, "SGR codes:");
+    for (int i = 0; i < 128; ++i)
+        if (stats->sgr_count[i] > 0)
+            fprintf(file, " %d:%llu", i, stats->sgr_count[i]);
+    fprintf(file, "\nOSC %llu strings with %llu bytes, DCS %llu strings with %llu bytes\n", stats->osc_count, stats->osc_bytes, stats->dcs_count, stats->dcs_bytes);
+    fprintf(file, "Step sizes:");
+    for (int i = 0; i < STATS_HISTOGRAM_SIZE; ++i)
+        if (stats->step_sizes[i] > 0)
+            fprintf(file, " <%llu:%llu", 1ULL << i, stats->step_sizes[i]);
+    fprintf(file, "\nLargest step %zu bytes, control sequence %zu bytes, command string %zu bytes\n", stats->largest_step, stats->largest_sequence, stats->largest_command_string);
+    fprintf(file, "Timing table %zu bytes, output buffer filled up to %zu bytes\n", stats->timing_table_bytes, stats->output_buffer_bytes);
+}
@@ -0,0 +1,144 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_STATS_H
+#define SCRIPTINTERPRETER_STATS_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "events.h"
+
+/**
+ * Stages of a conversion. Time is attributed to the stage in
+ * struct stats by sampling it regularly, so switching stages costs
+ * a single store and nothing is measured per byte or per event.
+ */
+enum stats_stage {
+    STATS_OTHER, ///< setup and anything not covered below
+    STATS_TIMING, ///< reading and parsing the timing file
+    STATS_READ, ///< reading the typescript
+    STATS_CLASSIFY, ///< going through the typescript byte by byte
+    STATS_DISPATCH, ///< handling complete control sequences and command strings
+    STATS_OUTPUT, ///< writing events in the output format
+    STATS_STAGE_COUNT
+};
+
+/// Number of buckets of the step size histogram, powers of two
+#define STATS_HISTOGRAM_SIZE 33
+/// Times per second the current stage is sampled
+#define STATS_SAMPLE_RATE 1000
+
+/**
+ * Counters collected during a conversion. Each conversion has its
+ * own, passed to its parser, so that several may run at once.
+ */
+struct stats {
+    unsigned long long csi_count[128], csi_bytes[128]; ///< control sequences by final byte
+    unsigned long long sgr_count[128]; ///< SGR parameters by code
+    unsigned long long osc_count, osc_bytes;
+    unsigned long long dcs_count, dcs_bytes;
+    unsigned long long escape_count; ///< other escape sequences
+    unsigned long long text_bytes; ///< printable characters
+    unsigned long long control_bytes; ///< CR, LF and other control characters
+    unsigned long long invalid_utf8_bytes; ///< bytes not forming valid UTF-8, see enum parser_invalid_utf8
+    unsigned long long steps;
+    unsigned long long step_sizes[STATS_HISTOGRAM_SIZE]; ///< bucket i: less than 2^i bytes, at least 2^(i-1)
+    unsigned long long events;
+    size_t largest_step;
+    size_t largest_sequence; ///< longest control sequence in bytes
+    size_t largest_command_string;
+    size_t timing_table_bytes; ///< memory held by the timing table
+    size_t output_buffer_bytes; ///< largest output buffer fill before flushing
+    volatile sig_atomic_t stage; ///< stage running right now
+    volatile sig_atomic_t wall_samples[STATS_STAGE_COUNT];
+    volatile sig_atomic_t cpu_samples[STATS_STAGE_COUNT];
+};
+
+/**
+ * Event sink counting events into @c stats before passing
+ * them on to @c next, see stats_output.
+ */
+struct stats_counter {
+    struct stats *stats;
+    struct event_sink next;
+};
+
+/**
+ * Switch @p stats to @p stage, returning the stage left, to be
+ * restored with stats_leave afterwards. Nothing is written if
+ * @p stats is NULL, as it is if no statistics are collected.
+ */
+static inline int stats_enter(struct stats *stats, int stage)
+{
+    if (stats == NULL)
+        return STATS_OTHER;
+    int previous = stats->stage;
+    stats->stage = stage;
+    return previous;
+}
+
+/**
+ * Return to @p stage, as returned by stats_enter.
+ */
+static inline void stats_leave(struct stats *stats, int stage)
+{
+    if (stats != NULL)
+        stats->stage = stage;
+}
+
+/**
+ * Set all counters of @p stats to zero.
+ */
+void stats_init(struct stats *stats);
+
+/**
+ * Add the counters of @p stats to those of @p total, taking
+ * the larger of the peak values.
+ */
+void stats_add(struct stats *total, const struct stats *stats);
+
+/**
+ * Event sink callback counting an event and passing it on for
+ * the struct stats_counter passed as @p context, in STATS_OUTPUT.
+ */
+void stats_output(void *context, const struct event *event);
+
+/**
+ * Add a timing step of @p length bytes to the histogram.
+ */
+void stats_count_step(struct stats *stats, size_t length);
+
+/**
+ * Start measuring time and, if @p sample_stages is non-zero,
+ * sampling the stage of @p stats, which only works for one
+ * struct stats per process at a time. Returns 0 on success.
+ */
+int stats_start(struct stats *stats, int sample_stages);
+
+/**
+ * Stop sampling and write the report on @p stats to @p file,
+ * as JSON if @p json is non-zero.
+ */
+void stats_report(struct stats *stats, FILE *file, int json);
+
+#endif // SCRIPTINTERPRETER_STATS_H
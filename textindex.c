@@ -0,0 +1,588 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "textindex.h"
+
+/// Size of the text buffer allocated first, it grows by doubling
+#define TEXTINDEX_INITIAL_TEXT_SIZE (1 << 16)
+/// Blocks are sorted in 24 bits of trigram above the 40 bits of block number
+#define TEXTINDEX_BLOCK_BITS 40
+
+/// Appends of threads of this process, file locks only keep other processes out
+static pthread_mutex_t append_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Start collecting the text of a new recording, passing events
+ * on to @p next. @p time is read at each timestep, it is the
+ * recording time of the step. Memory of an earlier recording is
+ * reused, @p builder must be initialized to all zero before the
+ * first call.
+ */
+void textindex_begin(struct textindex_builder *builder, const struct event_sink *next, const long long *time)
+{
+    builder->next = *next;
+    builder->time = time;
+    builder->text_length = builder->time_count = 0;
+    builder->error = 0;
+}
+
+/**
+ * Make room for @p more bytes of text, returns 0 on success.
+ */
+static int reserve_text(struct textindex_builder *builder, size_t more)
+{
+    if (builder->text_length + more <= builder->text_size)
+        return 0;
+    size_t size = builder->text_size > 0 ? builder->text_size : TEXTINDEX_INITIAL_TEXT_SIZE;
+    while (size < builder->text_length + more)
+        size *= 2;
+    char *text = (char *)realloc(builder->text, size);
+    if (text == NULL)
+        return 1;
+    builder->text = text;
+    builder->text_size = size;
+    return 0;
+}
+
+/**
+ * Append @p length bytes of @p text, noting the time of the
+ * current timestep if it differs from that of the text before.
+ */
+static void append_text(struct textindex_builder *builder, const char *text, size_t length)
+{
+    long long time = *builder->time;
+    if (builder->time_count == 0 || builder->times[builder->time_count - 1].time != time) {
+        if (builder->time_count == builder->time_size) {
+            size_t size = builder->time_size > 0 ? builder->time_size * 2 : 1024;
+            struct textindex_time *times = (struct textindex_time *)realloc(builder->times, size * sizeof(struct textindex_time));
+            if (times == NULL) {
+                builder->error = 1;
+                return;
+            }
+            builder->times = times;
+            builder->time_size = size;
+        }
+        builder->times[builder->time_count].text_offset = builder->text_length;
+        builder->times[builder->time_count].time = time;
+        ++builder->time_count;
+    }
+    if (reserve_text(builder, length) != 0) {
+        builder->error = 1;
+        return;
+    }
+    memcpy(builder->text + builder->text_length, text, length);
+    builder->text_length += length;
+}
+
+/**
+ * Separate the text before from the text after by @p separator,
+ * a line break or a tab, unless there is no text before or it
+ * already ends with a line break.
+ */
+static void append_separator(struct textindex_builder *builder, char separator)
+{
+    if (builder->text_length == 0 || builder->text[builder->text_length - 1] == '\n')
+        return;
+    if (reserve_text(builder, 1) != 0) {
+        builder->error = 1;
+        return;
+    }
+    builder->text[builder->text_length++] = separator;
+}
+
+/**
+ * Event sink callback for a struct textindex_builder passed
+ * as @p context.
+ */
+void textindex_collect(void *context, const struct event *event)
+{
+    struct textindex_builder *builder = (struct textindex_builder *)context;
+
+    if (!builder->error) {
+        if (event->type == EVENT_TEXT)
+            append_text(builder, event->text, event->length);
+        else if (event->type == EVENT_NEWLINE || event->type == EVENT_SCREEN
+                 || (event->type == EVENT_CURSOR && (event->kind == CURSOR_POSITION || event->kind == CURSOR_ROW)))
+            append_separator(builder, '\n'); ///< text after it is not on the same line
+        else if (event->type == EVENT_CURSOR && event->kind == CURSOR_TAB)
+            append_separator(builder, '\t');
+        if (builder->error)
+            fprintf(stderr, "Cannot allocate memory for the text index, the rest of the text is left out\n");
+    }
+
+    event_emit(&builder->next, event);
+}
+
+/**
+ * Sort @p count trigram keys by their upper 24 bits, keeping
+ * the order of equal trigrams, using @p temp of the same size.
+ * Returns the array that holds the sorted keys.
+ */
+static uint64_t *sort_keys(uint64_t *keys, uint64_t *temp, size_t count)
+{
+    for (int shift = TEXTINDEX_BLOCK_BITS; shift < 64; shift += 12) {
+        size_t starts[1 << 12];
+        memset(starts, 0, sizeof(starts));
+        for (size_t i = 0; i < count; ++i)
+            ++starts[(keys[i] >> shift) & 0xfff];
+        size_t sum = 0;
+        for (int b = 0; b < 1 << 12; ++b) {
+            size_t n = starts[b];
+            starts[b] = sum;
+            sum += n;
+        }
+        for (size_t i = 0; i < count; ++i)
+            temp[starts[(keys[i] >> shift) & 0xfff]++] = keys[i];
+        uint64_t *swap = keys;
+        keys = temp;
+        temp = swap;
+    }
+    return keys;
+}
+
+/**
+ * Number of bytes @p value takes with 7 bits per byte
+ */
+static size_t varint_size(uint64_t value)
+{
+    size_t size = 1;
+    for (; value >= 0x80; value >>= 7)
+        ++size;
+    return size;
+}
+
+/**
+ * Whether the bytes at @p segment, of which @p available are
+ * in the file, form a complete segment
+ */
+static int segment_valid(const char *segment, uint64_t available)
+{
+    if (available < sizeof(struct textindex_header))
+        return 0;
+    struct textindex_header header;
+    memcpy(&header, segment, sizeof(header));
+    uint64_t size = header.segment_size;
+    return memcmp(header.magic, TEXTINDEX_MAGIC, sizeof(header.magic)) == 0 && header.byte_order == TEXTINDEX_BYTE_ORDER
+           && header.version == TEXTINDEX_VERSION && size % 8 == 0 && size >= sizeof(header) && size <= available && header.block_size > 0
+           && header.time_offset % 8 == 0 && header.trigram_offset % 8 == 0
+           && header.name_offset <= size && header.name_length <= size - header.name_offset
+           && header.text_offset <= size && header.text_length <= size - header.text_offset
+           && header.time_offset <= size && header.time_count <= (size - header.time_offset) / sizeof(struct textindex_time)
+           && header.trigram_offset <= size && header.trigram_count <= (size - header.trigram_offset) / sizeof(struct textindex_trigram)
+           && header.postings_offset <= size && header.postings_size <= size - header.postings_offset
+           && (header.text_length == 0 || header.time_count > 0);
+}
+
+/**
+ * Write all @p length bytes of @p data to @p fd.
+ * Returns 0 on success.
+ */
+static int write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return 1;
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Append a segment of @p size bytes to the index file: @p tables
+ * of @p tables_size bytes, the @p text_length bytes of @p text and
+ * zero bytes up to @p size. An incomplete segment an interrupted
+ * append may have left at the end of the file is cut off first.
+ * Returns 0 on success.
+ */
+static int append_segment(const char *filename, const char *tables, size_t tables_size, const char *text, size_t text_length, size_t size)
+{
+    int fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open text index file \"%s\"\n", filename);
+        return 1;
+    }
+
+    pthread_mutex_lock(&append_mutex);
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    int ret = 0;
+    while ((ret = fcntl(fd, F_SETLKW, &lock)) != 0 && errno == EINTR)
+        ;
+
+    /// Walk the headers of the segments already there
+    struct stat st;
+    if (ret == 0 && fstat(fd, &st) == 0) {
+        uint64_t end = (uint64_t)st.st_size, offset = 0;
+        while (offset < end) {
+            struct textindex_header header;
+            if (pread(fd, &header, sizeof(header), (off_t)offset) != (ssize_t)sizeof(header)
+                    || memcmp(header.magic, TEXTINDEX_MAGIC, sizeof(header.magic)) != 0 || header.segment_size % 8 != 0
+                    || header.segment_size < sizeof(header) || header.segment_size > end - offset)
+                break;
+            offset += header.segment_size;
+        }
+        if (offset < end && ftruncate(fd, (off_t)offset) != 0)
+            ret = 1;
+    } else
+        ret = 1;
+    static const char padding[8];
+    if (ret == 0)
+        ret = write_all(fd, tables, tables_size) || write_all(fd, text, text_length) || write_all(fd, padding, size - tables_size - text_length);
+
+    lock.l_type = F_UNLCK;
+    fcntl(fd, F_SETLK, &lock);
+    pthread_mutex_unlock(&append_mutex);
+    if (close(fd) != 0)
+        ret = 1;
+    if (ret != 0)
+        fprintf(stderr, "Cannot append to text index file \"%s\"\n", filename);
+    return ret;
+}
+
+/**
+ * Append a segment with the text collected so far to the index
+ * file @p filename, creating it if it does not exist yet, under
+ * the recording name @p name. Nothing is written for recordings
+ * without text. Several processes and threads may append to the
+ * same file at the same time.
+ * Returns 0 on success.
+ */
+int textindex_append(struct textindex_builder *builder, const char *filename, const char *name)
+{
+    const char *text = builder->text;
+    size_t text_length = builder->text_length;
+    if (text_length == 0)
+        return 0;
+
+    /// One key per trigram and block it starts in, trigram above
+    /// block number; blocks are added in order and sorting keeps
+    /// them ascending. @c seen marks trigrams of the current block.
+    size_t count = 0, key_size = text_length / 16 + 1024;
+    uint64_t *keys = (uint64_t *)malloc(key_size * sizeof(uint64_t));
+    uint8_t *seen = (uint8_t *)calloc(1 << 21, 1);
+    uint32_t trigram = 0;
+    size_t unbroken = 0; ///< bytes since the last line break
+    size_t block = 0, block_end = TEXTINDEX_BLOCK_SIZE, block_keys = 0;
+    for (size_t j = 0; keys != NULL && seen != NULL && j < text_length; ++j) {
+        trigram = (trigram << 8 | (uint8_t)text[j]) & 0xffffff;
+        unbroken = text[j] == '\n' ? 0 : unbroken + 1;
+        if (unbroken < 3)
+            continue;
+        if (j - 2 >= block_end) {
+            /// Trigram starts in the next block, forget those of this one
+            for (size_t k = block_keys; k < count; ++k) {
+                uint32_t old = (uint32_t)(keys[k] >> TEXTINDEX_BLOCK_BITS);
+                seen[old >> 3] &= (uint8_t)~(1 << (old & 7));
+            }
+            block = (j - 2) / TEXTINDEX_BLOCK_SIZE;
+            block_end = (block + 1) * TEXTINDEX_BLOCK_SIZE;
+            block_keys = count;
+        }
+        if (seen[trigram >> 3] & (1 << (trigram & 7)))
+            continue;
+        seen[trigram >> 3] |= (uint8_t)(1 << (trigram & 7));
+        if (count == key_size) {
+            uint64_t *new_keys = (uint64_t *)realloc(keys, 2 * key_size * sizeof(uint64_t));
+            if (new_keys == NULL) {
+                free(keys);
+                keys = NULL;
+                break;
+            }
+            keys = new_keys;
+            key_size *= 2;
+        }
+        keys[count++] = (uint64_t)trigram << TEXTINDEX_BLOCK_BITS | block;
+    }
+    uint64_t *temp = keys != NULL && seen != NULL ? (uint64_t *)malloc((count + 1) * sizeof(uint64_t)) : NULL;
+    free(seen);
+    if (temp == NULL) {
+        free(keys);
+        fprintf(stderr, "Cannot allocate memory for the text index\n");
+        return 1;
+    }
+    uint64_t *sorted = sort_keys(keys, temp, count);
+
+    /// Sizes of the trigram table and the postings
+    const uint64_t block_mask = ((uint64_t)1 << TEXTINDEX_BLOCK_BITS) - 1;
+    size_t trigram_count = 0, postings_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        int first = i == 0 || sorted[i] >> TEXTINDEX_BLOCK_BITS != sorted[i - 1] >> TEXTINDEX_BLOCK_BITS;
+        trigram_count += first;
+        postings_size += varint_size((sorted[i] & block_mask) - (first ? 0 : sorted[i - 1] & block_mask));
+    }
+
+    struct textindex_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TEXTINDEX_MAGIC, sizeof(header.magic));
+    header.version = TEXTINDEX_VERSION;
+    header.byte_order = TEXTINDEX_BYTE_ORDER;
+    header.block_size = TEXTINDEX_BLOCK_SIZE;
+    header.time_count = builder->time_count;
+    header.time_offset = sizeof(header);
+    header.trigram_count = trigram_count;
+    header.trigram_offset = header.time_offset + header.time_count * sizeof(struct textindex_time);
+    header.postings_size = postings_size;
+    header.postings_offset = header.trigram_offset + trigram_count * sizeof(struct textindex_trigram);
+    header.name_length = strlen(name);
+    header.name_offset = header.postings_offset + postings_size;
+    header.text_length = text_length;
+    header.text_offset = header.name_offset + header.name_length;
+    header.segment_size = (header.text_offset + text_length + 7) / 8 * 8;
+
+    /// Everything but the text, which is written from where it was collected
+    char *tables = (char *)malloc(header.text_offset);
+    if (tables == NULL) {
+        free(keys);
+        free(temp);
+        fprintf(stderr, "Cannot allocate memory for the text index\n");
+        return 1;
+    }
+    memcpy(tables, &header, sizeof(header));
+    memcpy(tables + header.time_offset, builder->times, header.time_count * sizeof(struct textindex_time));
+    memcpy(tables + header.name_offset, name, header.name_length);
+
+    struct textindex_trigram *trigrams = (struct textindex_trigram *)(tables + header.trigram_offset);
+    uint8_t *postings = (uint8_t *)(tables + header.postings_offset), *p = postings;
+    for (size_t i = 0, t = 0; i < count; ++i) {
+        int first = i == 0 || sorted[i] >> TEXTINDEX_BLOCK_BITS != sorted[i - 1] >> TEXTINDEX_BLOCK_BITS;
+        if (first) {
+            trigrams[t].trigram = (uint32_t)(sorted[i] >> TEXTINDEX_BLOCK_BITS);
+            trigrams[t].count = 0;
+            trigrams[t].postings = (uint64_t)(p - postings);
+            ++t;
+        }
+        ++trigrams[t - 1].count;
+        uint64_t delta = (sorted[i] & block_mask) - (first ? 0 : sorted[i - 1] & block_mask);
+        for (; delta >= 0x80; delta >>= 7)
+            *p++ = (uint8_t)(delta | 0x80);
+        *p++ = (uint8_t)delta;
+    }
+    free(keys);
+    free(temp);
+
+    int ret = append_segment(filename, tables, header.text_offset, text, text_length, header.segment_size);
+    free(tables);
+    return ret;
+}
+
+/**
+ * Release the memory held by the builder.
+ */
+void textindex_builder_free(struct textindex_builder *builder)
+{
+    free(builder->text);
+    free(builder->times);
+    builder->text = NULL;
+    builder->times = NULL;
+    builder->text_size = builder->text_length = builder->time_size = builder->time_count = 0;
+}
+
+/**
+ * Map the index file @p filename. Returns 0 on success.
+ */
+int textindex_open(struct textindex *index, const char *filename)
+{
+    index->map = NULL;
+    index->size = 0;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open text index file \"%s\"\n", filename);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        fprintf(stderr, "Cannot open text index file \"%s\"\n", filename);
+        return 1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0; ///< no recordings yet
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Cannot map text index file \"%s\"\n", filename);
+        return 1;
+    }
+    index->map = (const char *)map;
+    index->size = (size_t)st.st_size;
+    return 0;
+}
+
+/**
+ * Report a match at @p position of the segment to @p callback.
+ */
+static void report_hit(const char *segment, const struct textindex_header *header, size_t position, void (*callback)(void *context, const struct textindex_hit *hit), void *context)
+{
+    /// Last time entry for text at or before the match
+    const struct textindex_time *times = (const struct textindex_time *)(segment + header->time_offset);
+    size_t low = 0, high = (size_t)header->time_count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (times[middle].text_offset <= position)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    struct textindex_hit hit;
+    hit.name = segment + header->name_offset;
+    hit.name_length = (size_t)header->name_length;
+    hit.time = times[low].time;
+    hit.text = segment + header->text_offset;
+    hit.text_length = (size_t)header->text_length;
+    hit.position = position;
+    callback(context, &hit);
+}
+
+/**
+ * Compare @p query with the text of the segment at all positions
+ * from @p from to before @p to. Returns the number of matches.
+ */
+static size_t scan_text(const char *segment, const struct textindex_header *header, const char *query, size_t length, size_t from, size_t to, void (*callback)(void *context, const struct textindex_hit *hit), void *context)
+{
+    const char *text = segment + header->text_offset;
+    size_t hits = 0;
+    for (const char *p = text + from, *end = text + to; p < end && (p = memchr(p, query[0], (size_t)(end - p))) != NULL; ++p)
+        if (memcmp(p, query, length) == 0) {
+            report_hit(segment, header, (size_t)(p - text), callback, context);
+            ++hits;
+        }
+    return hits;
+}
+
+/**
+ * Find @p query in one segment. Returns the number of matches.
+ */
+static size_t search_segment(const char *segment, const char *query, size_t length, void (*callback)(void *context, const struct textindex_hit *hit), void *context)
+{
+    struct textindex_header header;
+    memcpy(&header, segment, sizeof(header));
+    size_t text_length = (size_t)header.text_length, hits = 0;
+    if (length > text_length)
+        return 0;
+    size_t last_start = text_length - length + 1; ///< end of positions a match can start at
+
+    /// The query's rarest trigram without line break, if it has any;
+    /// all of them must occur in the text
+    const struct textindex_trigram *trigrams = (const struct textindex_trigram *)(segment + header.trigram_offset);
+    const struct textindex_trigram *rarest = NULL;
+    size_t rarest_at = 0;
+    for (size_t k = 0; k + 3 <= length; ++k) {
+        if (query[k] == '\n' || query[k + 1] == '\n' || query[k + 2] == '\n')
+            continue;
+        uint32_t trigram = (uint32_t)(uint8_t)query[k] << 16 | (uint32_t)(uint8_t)query[k + 1] << 8 | (uint8_t)query[k + 2];
+        size_t low = 0, high = (size_t)header.trigram_count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (trigrams[middle].trigram < trigram)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        if (low == header.trigram_count || trigrams[low].trigram != trigram)
+            return 0;
+        if (rarest == NULL || trigrams[low].count < rarest->count) {
+            rarest = trigrams + low;
+            rarest_at = k;
+        }
+    }
+    if (rarest == NULL)
+        return scan_text(segment, &header, query, length, 0, last_start, callback, context); ///< too short for trigrams
+
+    /// Matches whose rarest trigram starts in one of its blocks
+    const uint8_t *p = (const uint8_t *)(segment + header.postings_offset), *end = p + header.postings_size;
+    if (rarest->postings > header.postings_size)
+        return 0;
+    p += rarest->postings;
+    uint64_t block = 0;
+    for (uint32_t i = 0; i < rarest->count; ++i) {
+        uint64_t delta = 0;
+        int shift = 0;
+        do {
+            if (p == end || shift > 63)
+                return hits; ///< damaged postings
+            delta |= (uint64_t)(*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        block += delta;
+        if (block > text_length / header.block_size)
+            return hits;
+
+        size_t first = (size_t)(block * header.block_size);
+        if (first + header.block_size <= rarest_at)
+            continue;
+        size_t from = first > rarest_at ? first - rarest_at : 0;
+        size_t to = first + header.block_size - rarest_at;
+        hits += scan_text(segment, &header, query, length, from, to < last_start ? to : last_start, callback, context);
+    }
+    return hits;
+}
+
+/**
+ * Find all occurrences of @p query of @p length bytes in all
+ * recordings of the index and pass them to @p callback with
+ * @p context, in the order of the index and of the text.
+ * Incomplete or damaged segments at the end of the file, as left
+ * behind by an interrupted append, are skipped.
+ * Returns the number of matches.
+ */
+size_t textindex_search(const struct textindex *index, const char *query, size_t length, void (*callback)(void *context, const struct textindex_hit *hit), void *context)
+{
+    size_t hits = 0;
+    if (length == 0)
+        return 0;
+    for (size_t offset = 0; offset < index->size && segment_valid(index->map + offset, index->size - offset);) {
+        hits += search_segment(index->map + offset, query, length, callback, context);
+        offset += ((const struct textindex_header *)(index->map + offset))->segment_size;
+    }
+    return hits;
+}
+
+/**
+ * Unmap the index file.
+ */
+void textindex_close(struct textindex *index)
+{
+    if (index->map != NULL)
+        munmap((void *)index->map, index->size);
+    index->map = NULL;
+    index->size = 0;
+}
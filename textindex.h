@@ -0,0 +1,161 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_TEXTINDEX_H
+#define SCRIPTINTERPRETER_TEXTINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "events.h"
+
+/**
+ * A text index file is a sequence of segments, one per converted
+ * recording, so recordings can be appended to it at any time.
+ * A segment holds the name of the recording, the text of all its
+ * text events, a table of the recording times at which parts of the
+ * text appeared and an inverted index of the text: for every
+ * trigram, i.e. sequence of three bytes, the numbers of the blocks
+ * of @c block_size bytes of text it starts in, as differences to
+ * the previous block number coded in 7 bits per byte, least
+ * significant first, the eighth bit set in all but the last byte of
+ * a number. A search compares the text in the blocks of the rarest
+ * trigram of what is searched for.
+ * Line breaks, cursor positioning and the start of a screen become
+ * a single line break in the text, trigrams spanning one are not
+ * indexed; tabs become tab characters. All numbers are stored in the byte order of the writing
+ * machine, offsets are relative to the start of the segment.
+ */
+#define TEXTINDEX_MAGIC "SITEXTIX"
+#define TEXTINDEX_VERSION 1
+#define TEXTINDEX_BYTE_ORDER 0x01020304u
+/// Bytes of text per block in segments written
+#define TEXTINDEX_BLOCK_SIZE 4096
+
+struct textindex_header {
+    char magic[8]; ///< TEXTINDEX_MAGIC without terminating null character
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t segment_size; ///< bytes in the segment including this header, a multiple of 8
+    uint64_t block_size; ///< bytes of text per block in the postings
+    uint64_t name_length, name_offset;
+    uint64_t text_length, text_offset;
+    uint64_t time_count, time_offset;
+    uint64_t trigram_count, trigram_offset;
+    uint64_t postings_size, postings_offset;
+};
+
+/// Text from @c text_offset on appeared at recording time @c time
+struct textindex_time {
+    uint64_t text_offset;
+    int64_t time; ///< in microseconds
+};
+
+/// Occurrences of a trigram, entries are sorted by @c trigram
+struct textindex_trigram {
+    uint32_t trigram; ///< first byte in bits 16 to 23, last byte in bits 0 to 7
+    uint32_t count; ///< number of blocks
+    uint64_t postings; ///< offset of the first block number relative to @c postings_offset
+};
+
+/**
+ * Event sink collecting the text of a recording for the index
+ * while passing events on to @c next
+ */
+struct textindex_builder {
+    struct event_sink next;
+    const long long *time; ///< recording time in microseconds of the current timestep
+    char *text;
+    size_t text_length, text_size;
+    struct textindex_time *times;
+    size_t time_count, time_size;
+    int error; ///< memory ran out, the text is incomplete
+};
+
+/**
+ * A memory-mapped text index file
+ */
+struct textindex {
+    const char *map;
+    size_t size;
+};
+
+/// A match of a search in a text index
+struct textindex_hit {
+    const char *name; ///< recording, not null-terminated
+    size_t name_length;
+    int64_t time; ///< recording time in microseconds at which the match appeared
+    const char *text; ///< all text of the recording
+    size_t text_length;
+    size_t position; ///< offset of the match in @c text
+};
+
+/**
+ * Start collecting the text of a new recording, passing events
+ * on to @p next. @p time is read at each timestep, it is the
+ * recording time of the step. Memory of an earlier recording is
+ * reused, @p builder must be initialized to all zero before the
+ * first call.
+ */
+void textindex_begin(struct textindex_builder *builder, const struct event_sink *next, const long long *time);
+
+/**
+ * Event sink callback for a struct textindex_builder passed
+ * as @p context.
+ */
+void textindex_collect(void *context, const struct event *event);
+
+/**
+ * Append a segment with the text collected so far to the index
+ * file @p filename, creating it if it does not exist yet, under
+ * the recording name @p name. Nothing is written for recordings
+ * without text. Several processes and threads may append to the
+ * same file at the same time.
+ * Returns 0 on success.
+ */
+int textindex_append(struct textindex_builder *builder, const char *filename, const char *name);
+
+/**
+ * Release the memory held by the builder.
+ */
+void textindex_builder_free(struct textindex_builder *builder);
+
+/**
+ * Map the index file @p filename. Returns 0 on success.
+ */
+int textindex_open(struct textindex *index, const char *filename);
+
+/**
+ * Find all occurrences of @p query of @p length bytes in all
+ * recordings of the index and pass them to @p callback with
+ * @p context, in the order of the index and of the text.
+ * Incomplete or damaged segments at the end of the file, as left
+ * behind by an interrupted append, are skipped.
+ * Returns the number of matches.
+ */
+size_t textindex_search(const struct textindex *index, const char *query, size_t length, void (*callback)(void *context, const struct textindex_hit *hit), void *context);
+
+/**
+ * Unmap the index file.
+ */
+void textindex_close(struct textindex *index);
+
+#endif // SCRIPTINTERPRETER_TEXTINDEX_H
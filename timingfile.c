@@ -0,0 +1,273 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "timingfile.h"
+
+/// Size of blocks when reading a timing file that cannot be memory-mapped
+#define TIMING_READ_SIZE (1 << 20)
+/// Largest integer part of a delay accepted, about 30 years in seconds
+#define TIMING_MAX_SECONDS 1000000000LL
+
+/**
+ * Parse a single line of a timing file (without the line break)
+ * consisting of a decimal delay in seconds and a number of bytes.
+ * Returns 0 on success, 1 if the line is empty or white space
+ * only, and -1 if the line is malformed.
+ */
+int timing_parse_line(const char *line, size_t len, long long *delay, size_t *length)
+{
+    const char *p = line, *end = line + len;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    if (p == end)
+        return 1;
+
+    /// Delay: integer part, optionally followed by a fraction,
+    /// only microsecond precision is kept (rounded)
+    long long seconds = 0, micros = 0;
+    int digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+        seconds = seconds * 10 + (*p - '0');
+        if (seconds > TIMING_MAX_SECONDS)
+            return -1;
+    }
+    if (p < end && *p == '.') {
+        int fraction_digits = 0;
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits, ++fraction_digits) {
+            if (fraction_digits < 6)
+                micros = micros * 10 + (*p - '0');
+            else if (fraction_digits == 6 && *p >= '5')
+                ++micros; ///< round on the first digit dropped
+        }
+        for (; fraction_digits < 6; ++fraction_digits)
+            micros *= 10;
+    }
+    if (digits == 0)
+        return -1;
+
+    /// Separating white space
+    if (p == end || (*p != ' ' && *p != '\t'))
+        return -1;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+
+    /// Number of bytes
+    size_t bytes = 0;
+    digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+        if (bytes > (SIZE_MAX - (size_t)(*p - '0')) / 10)
+            return -1;
+        bytes = bytes * 10 + (size_t)(*p - '0');
+    }
+    if (digits == 0)
+        return -1;
+
+    /// Nothing but white space may follow
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    if (p != end)
+        return -1;
+
+    *delay = seconds * 1000000 + micros;
+    *length = bytes;
+    return 0;
+}
+
+/**
+ * Go through all lines in @p data, which starts at @p data_offset
+ * in the timing file, and append their steps to @p table, stopping
+ * at the first malformed line.
+ */
+static int parse_timing_data(struct timing_table *table, const char *data, size_t len, size_t data_offset, size_t first_offset, size_t first_line)
+{
+    size_t offset = first_offset;
+    const char *p = data, *end = data + len;
+    for (size_t line_nr = first_line; p < end; ++line_nr) {
+        const char *lf = memchr(p, '\n', end - p);
+        const char *line_end = lf != NULL ? lf : end;
+
+        if (table->count == table->size) {
+            size_t new_size = table->size * 2;
+            struct timing_step *new_steps = (struct timing_step *)realloc(table->steps, new_size * sizeof(struct timing_step));
+            if (new_steps == NULL) {
+                fprintf(stderr, "Cannot allocate memory for timing steps\n");
+                return 1;
+            }
+            table->steps = new_steps;
+            table->size = new_size;
+        }
+
+        struct timing_step *step = table->steps + table->count;
+        int lineret = timing_parse_line(p, line_end - p, &step->delay, &step->length);
+        if (lineret < 0) {
+            table->error_line = line_nr;
+            break;
+        } else if (lineret == 0) {
+            step->offset = offset;
+            step->line = line_nr;
+            step->timing_offset = data_offset + (size_t)(p - data);
+            offset += step->length;
+            ++table->count;
+        }
+
+        p = line_end + 1;
+    }
+    return 0;
+}
+
+/**
+ * Build the table of steps of a timing file already in memory,
+ * @p data of @p len bytes starting at @p data_offset in the file.
+ * @p first_offset is the typescript offset of the first step's
+ * bytes, @p first_line the number of the first line in @p data.
+ * Parsing stops at the first malformed line, whose number is
+ * stored in @c error_line. The memory of steps from an earlier
+ * call is reused, @p table must be initialized to all zero before
+ * the first call.
+ * Returns 0 on success, also if a malformed line was found.
+ */
+int timing_table_parse(struct timing_table *table, const char *data, size_t len, size_t data_offset, size_t first_offset, size_t first_line)
+{
+    table->count = 0;
+    table->error_line = 0;
+    /// Guess number of steps, about 10 characters per line
+    size_t size = len / 10 + 16;
+    if (table->size < size) {
+        struct timing_step *steps = (struct timing_step *)realloc(table->steps, size * sizeof(struct timing_step));
+        if (steps == NULL) {
+            fprintf(stderr, "Cannot allocate memory for timing steps\n");
+            return 1;
+        }
+        table->steps = steps;
+        table->size = size;
+    }
+    return parse_timing_data(table, data, len, data_offset, first_offset, first_line);
+}
+
+/**
+ * Read the timing file from its current position to the end and
+ * build the table of its steps in one pass. Regular files are
+ * memory-mapped, everything else is read in large blocks.
+ * @p first_offset is the typescript offset of the first step's
+ * bytes, @p first_line the number of the first line read.
+ * Reading stops at the first malformed line, whose number is
+ * stored in @c error_line. Like with timing_table_parse,
+ * the memory of an earlier call is reused.
+ * Returns 0 on success, also if a malformed line was found.
+ */
+int timing_table_read(struct timing_table *table, FILE *file, size_t first_offset, size_t first_line)
+{
+    table->count = table->error_line = 0;
+    long position = ftell(file);
+
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (map != MAP_FAILED) {
+            posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            size_t start = position > 0 && position < st.st_size ? (size_t)position : (position > 0 ? (size_t)st.st_size : 0);
+            int ret = timing_table_parse(table, (const char *)map + start, (size_t)st.st_size - start, start, first_offset, first_line);
+            munmap(map, (size_t)st.st_size);
+            return ret;
+        }
+    }
+
+    /// Not memory-mappable, read everything in large blocks
+    size_t len = 0, size = TIMING_READ_SIZE;
+    char *data = (char *)malloc(size);
+    for (;;) {
+        if (data == NULL) {
+            fprintf(stderr, "Cannot allocate memory for timing file\n");
+            return 1;
+        }
+        len += fread(data + len, 1, size - len, file);
+        if (len < size)
+            break;
+        char *new_data = (char *)realloc(data, size * 2);
+        if (new_data == NULL)
+            free(data);
+        data = new_data;
+        size *= 2;
+    }
+    if (ferror(file)) {
+        fprintf(stderr, "Error while reading timing file\n");
+        free(data);
+        return 1;
+    }
+    int ret = timing_table_parse(table, data, len, position > 0 ? (size_t)position : 0, first_offset, first_line);
+    free(data);
+    return ret;
+}
+
+/**
+ * Release the memory held by the table.
+ */
+void timing_table_free(struct timing_table *table)
+{
+    free(table->steps);
+    table->steps = NULL;
+    table->count = table->size = 0;
+}
+
+/**
+ * Write @p delay microseconds as seconds with three decimals,
+ * rounded to the nearest millisecond, like "12.345".
+ * @p buffer must hold at least 24 characters.
+ * Returns the number of characters written, excluding the
+ * terminating null character.
+ */
+size_t timing_format_delay(char *buffer, long long delay)
+{
+    /// Exact ties like 0.0055 are rounded like printf does on the
+    /// nearest double, which keeps the output of earlier versions
+    if (delay % 1000 == 500)
+        return (size_t)snprintf(buffer, 24, "%.3f", (double)delay / 1e6);
+
+    long long millis = (delay + 500) / 1000;
+    long long seconds = millis / 1000;
+    char digits[24];
+    size_t n = 0, len = 0;
+
+    /// Integer part, digits collected in reverse order
+    do {
+        digits[n++] = '0' + seconds % 10;
+        seconds /= 10;
+    } while (seconds > 0);
+    while (n > 0)
+        buffer[len++] = digits[--n];
+
+    buffer[len++] = '.';
+    buffer[len++] = '0' + (millis / 100) % 10;
+    buffer[len++] = '0' + (millis / 10) % 10;
+    buffer[len++] = '0' + millis % 10;
+    buffer[len] = '\0';
+    return len;
+}
@@ -0,0 +1,94 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_TIMINGFILE_H
+#define SCRIPTINTERPRETER_TIMINGFILE_H
+
+#include <stdio.h>
+
+/// A timing file entry, with the typescript offset of its bytes
+struct timing_step {
+    long long delay; ///< delay since previous step in microseconds
+    size_t offset; ///< offset of the step's first byte in the typescript
+    size_t length; ///< number of bytes in the typescript
+    size_t line; ///< line number in the timing file
+    size_t timing_offset; ///< offset of the line in the timing file
+};
+
+/**
+ * All steps of a timing file, in the order of the file.
+ */
+struct timing_table {
+    struct timing_step *steps;
+    size_t count; ///< number of valid entries in @c steps
+    size_t size; ///< capacity of @c steps
+    size_t error_line; ///< number of first malformed line, 0 if none
+};
+
+/**
+ * Parse a single line of a timing file (without the line break)
+ * consisting of a decimal delay in seconds and a number of bytes.
+ * Returns 0 on success, 1 if the line is empty or white space
+ * only, and -1 if the line is malformed.
+ */
+int timing_parse_line(const char *line, size_t len, long long *delay, size_t *length);
+
+/**
+ * Build the table of steps of a timing file already in memory,
+ * @p data of @p len bytes starting at @p data_offset in the file.
+ * @p first_offset is the typescript offset of the first step's
+ * bytes, @p first_line the number of the first line in @p data.
+ * Parsing stops at the first malformed line, whose number is
+ * stored in @c error_line. The memory of steps from an earlier
+ * call is reused, @p table must be initialized to all zero before
+ * the first call.
+ * Returns 0 on success, also if a malformed line was found.
+ */
+int timing_table_parse(struct timing_table *table, const char *data, size_t len, size_t data_offset, size_t first_offset, size_t first_line);
+
+/**
+ * Read the timing file from its current position to the end and
+ * build the table of its steps in one pass. Regular files are
+ * memory-mapped, everything else is read in large blocks.
+ * @p first_offset is the typescript offset of the first step's
+ * bytes, @p first_line the number of the first line read.
+ * Reading stops at the first malformed line, whose number is
+ * stored in @c error_line. Like with timing_table_parse,
+ * the memory of an earlier call is reused.
+ * Returns 0 on success, also if a malformed line was found.
+ */
+int timing_table_read(struct timing_table *table, FILE *file, size_t first_offset, size_t first_line);
+
+/**
+ * Release the memory held by the table.
+ */
+void timing_table_free(struct timing_table *table);
+
+/**
+ * Write @p delay microseconds as seconds with three decimals,
+ * rounded to the nearest millisecond, like "12.345".
+ * @p buffer must hold at least 24 characters.
+ * Returns the number of characters written, excluding the
+ * terminating null character.
+ */
+size_t timing_format_delay(char *buffer, long long delay);
+
+#endif // SCRIPTINTERPRETER_TIMINGFILE_H
@@ -0,0 +1,351 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ring.h"
+#include "typescriptinput.h"
+
+/**
+ * A chunk of typescript read ahead, in a slot of the reader's ring
+ */
+struct typescript_chunk {
+    const char *data; ///< either @c bytes or a part of the memory-mapped file
+    size_t length; ///< 0 at the end of the typescript
+    int error; ///< reading failed, no chunk follows
+    char bytes[TYPESCRIPT_INPUT_CHUNK_SIZE];
+};
+
+/**
+ * Thread reading a typescript ahead of its parser
+ */
+struct typescript_reader {
+    struct typescript_input source; ///< the input as it was before, only used by @c thread
+    struct ring ring; ///< chunks read, but not yet handed out
+    int holding; ///< the oldest chunk in @c ring is being handed out
+    pthread_t thread;
+};
+
+/**
+ * Prepare reading from an already opened typescript file.
+ * If @p compressed is not NULL, the typescript is read from it
+ * instead of from @p file. Otherwise, if @p allow_mmap is non-zero
+ * and the file is a regular, non-empty file, the whole file will
+ * be memory-mapped, else the fread fallback will be used.
+ * Returns 0 on success.
+ */
+int typescript_input_open(struct typescript_input *input, FILE *file, int allow_mmap, struct compressed_input *compressed)
+{
+    input->file = file;
+    input->map = NULL;
+    input->map_size = 0;
+    input->position = 0;
+    input->buffer = NULL;
+    input->buffer_size = 0;
+    input->compressed = compressed;
+    input->chunk = NULL;
+    input->chunk_len = 0;
+    input->reader = NULL;
+    if (compressed != NULL)
+        return 0;
+
+    struct stat st;
+    if (allow_mmap && fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (map != MAP_FAILED) {
+            /// Steps are consumed front to back, let the kernel read ahead
+            posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            input->map = (const char *)map;
+            input->map_size = (size_t)st.st_size;
+            /// Start where the stream currently is, in case something was read already
+            long offset = ftell(file);
+            input->position = offset > 0 ? (size_t)offset : 0;
+            return 0;
+        }
+    }
+
+    /// Fixed-size fread buffer, steps larger than that are read in chunks
+    long offset = ftell(file);
+    input->position = offset > 0 ? (size_t)offset : 0;
+    input->buffer_size = TYPESCRIPT_INPUT_CHUNK_SIZE;
+    input->buffer = (char *)malloc(input->buffer_size);
+    return input->buffer == NULL ? 1 : 0;
+}
+
+/**
+ * Continue reading from the typescript, discarding all
+ * read data until there is a line break or the end of
+ * the typescript is reached.
+ */
+void typescript_input_skipline(struct typescript_input *input)
+{
+    if (input->compressed != NULL) {
+        for (;;) {
+            if (input->chunk_len == 0 && ((input->chunk = compressed_input_next(input->compressed, &input->chunk_len)) == NULL || input->chunk_len == 0))
+                return;
+            const char *lf = memchr(input->chunk, '\n', input->chunk_len);
+            size_t skip = lf == NULL ? input->chunk_len : (size_t)(lf - input->chunk) + 1;
+            input->chunk += skip;
+            input->chunk_len -= skip;
+            input->position += skip;
+            if (lf != NULL)
+                return;
+        }
+    }
+
+    if (input->map == NULL) {
+        for (int c; (c = fgetc(input->file)) != EOF;) {
+            ++input->position;
+            if (c == '\n')
+                break;
+        }
+        return;
+    }
+
+    const char *lf = memchr(input->map + input->position, '\n', input->map_size - input->position);
+    input->position = lf == NULL ? input->map_size : (size_t)(lf - input->map) + 1;
+}
+
+/**
+ * Return a pointer to up to @p expected_size next bytes of the
+ * typescript. The number of bytes actually available is written
+ * to @p rlen. It may be less than expected if the fread fallback
+ * is used (at most TYPESCRIPT_INPUT_CHUNK_SIZE bytes) or the
+ * typescript is compressed (the rest of a chunk) and is 0 at
+ * the end of the file. The returned memory remains valid until the
+ * next call. Returns NULL on error.
+ */
+const char *typescript_input_next(struct typescript_input *input, size_t expected_size, size_t *rlen)
+{
+    if (input->reader != NULL) {
+        /// Hand out the step from the chunk read ahead, the
+        /// slot is given back once the chunk is used up
+        struct typescript_reader *reader = input->reader;
+        if (input->chunk_len == 0) {
+            if (reader->holding) {
+                ring_release(&reader->ring);
+                reader->holding = 0;
+            }
+            const struct typescript_chunk *chunk = (const struct typescript_chunk *)ring_peek(&reader->ring);
+            if (chunk != NULL && chunk->error)
+                return NULL;
+            if (chunk == NULL || chunk->length == 0) {
+                *rlen = 0;
+                return ""; ///< end of the typescript
+            }
+            reader->holding = 1;
+            input->chunk = chunk->data;
+            input->chunk_len = chunk->length;
+        }
+        const char *step = input->chunk;
+        *rlen = expected_size < input->chunk_len ? expected_size : input->chunk_len;
+        input->chunk += *rlen;
+        input->chunk_len -= *rlen;
+        input->position += *rlen;
+        return step;
+    }
+
+    if (input->map != NULL) {
+        /// Hand out the step directly from the mapping, no copying
+        const char *step = input->map + input->position;
+        size_t left = input->map_size - input->position;
+        *rlen = expected_size < left ? expected_size : left;
+        input->position += *rlen;
+        return step;
+    }
+
+    if (input->compressed != NULL) {
+        /// Hand out the step from the current chunk, the next
+        /// chunk is only fetched once this one is used up
+        if (input->chunk_len == 0 && (input->chunk = compressed_input_next(input->compressed, &input->chunk_len)) == NULL) {
+            fprintf(stderr, "Error while reading typescript file\n");
+            return NULL;
+        }
+        const char *step = input->chunk;
+        *rlen = expected_size < input->chunk_len ? expected_size : input->chunk_len;
+        input->chunk += *rlen;
+        input->chunk_len -= *rlen;
+        input->position += *rlen;
+        return step;
+    }
+
+    /// Read as many bytes from the typescript files as are expected
+    /// to describe the current step's events, limited by buffer size
+    if (expected_size > input->buffer_size)
+        expected_size = input->buffer_size;
+    *rlen = fread(input->buffer, sizeof(char), expected_size, input->file);
+    if (*rlen < expected_size && ferror(input->file)) {
+        fprintf(stderr, "Error while reading typescript file\n");
+        return NULL;
+    }
+    input->position += *rlen;
+    return input->buffer;
+}
+
+/**
+ * Read chunks from the input as it was before reading ahead
+ * into the ring, until the end of the typescript, an error or
+ * until the parser is no longer interested.
+ */
+static void *read_ahead_thread(void *arg)
+{
+    struct typescript_reader *reader = (struct typescript_reader *)arg;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    /// Signals are for the parsing thread
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    for (;;) {
+        struct typescript_chunk *chunk = (struct typescript_chunk *)ring_acquire(&reader->ring);
+        if (chunk == NULL)
+            return NULL;
+        size_t len = 0;
+        const char *data = typescript_input_next(&reader->source, TYPESCRIPT_INPUT_CHUNK_SIZE, &len);
+        chunk->error = data == NULL;
+        chunk->length = len;
+        if (data != NULL && reader->source.map != NULL) {
+            /// Wait for the pages of the mapping here instead of in the parser
+            for (size_t i = 0; i < len; i += page_size > 0 ? (size_t)page_size : 4096)
+                (void)*(volatile const char *)(data + i);
+            chunk->data = data;
+        } else if (data != NULL) {
+            memcpy(chunk->bytes, data, len);
+            chunk->data = chunk->bytes;
+        }
+        ring_publish(&reader->ring);
+        if (data == NULL || len == 0) {
+            ring_close(&reader->ring);
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Read the rest of the typescript on a separate thread, in chunks
+ * of at most TYPESCRIPT_INPUT_CHUNK_SIZE bytes and up to
+ * TYPESCRIPT_INPUT_READ_AHEAD chunks ahead of typescript_input_next,
+ * so waiting for the file and parsing overlap. A memory-mapped
+ * typescript is not copied, the thread only touches its pages.
+ * Afterwards, the input cannot be positioned and no lines can be
+ * skipped. Returns 0 on success.
+ */
+int typescript_input_read_ahead(struct typescript_input *input)
+{
+    struct typescript_reader *reader = (struct typescript_reader *)malloc(sizeof(struct typescript_reader));
+    if (reader == NULL || ring_init(&reader->ring, TYPESCRIPT_INPUT_READ_AHEAD, sizeof(struct typescript_chunk)) != 0) {
+        fprintf(stderr, "Cannot allocate memory for reading the typescript ahead\n");
+        free(reader);
+        return 1;
+    }
+    /// The thread takes over the file, this input only hands out its chunks
+    reader->source = *input;
+    reader->holding = 0;
+    if (pthread_create(&reader->thread, NULL, read_ahead_thread, reader) != 0) {
+        fprintf(stderr, "Cannot start thread for reading the typescript\n");
+        ring_free(&reader->ring);
+        free(reader);
+        return 1;
+    }
+    input->map = NULL;
+    input->map_size = 0;
+    input->buffer = NULL;
+    input->buffer_size = 0;
+    input->compressed = NULL;
+    input->chunk = NULL;
+    input->chunk_len = 0;
+    input->reader = reader;
+    return 0;
+}
+
+/**
+ * Continue reading at byte @p offset of the typescript.
+ * Returns 0 on success, 1 if the file cannot be positioned
+ * (e.g. for pipes or compressed files).
+ */
+int typescript_input_seek(struct typescript_input *input, size_t offset)
+{
+    if (input->compressed != NULL || input->reader != NULL)
+        return 1;
+    else if (input->map != NULL)
+        input->position = offset < input->map_size ? offset : input->map_size;
+    else if (fseek(input->file, (long)offset, SEEK_SET) == 0)
+        input->position = offset;
+    else
+        return 1;
+    return 0;
+}
+
+/**
+ * Continue reading at byte @p offset of the typescript, which
+ * must not be before the current position. The file is positioned
+ * if possible, otherwise the bytes in between are read and thrown
+ * away without looking at them. Returns 0 on success, also if the
+ * typescript ends before @p offset, and 1 on read errors.
+ */
+int typescript_input_skip_to(struct typescript_input *input, size_t offset)
+{
+    if (offset <= input->position || typescript_input_seek(input, offset) == 0)
+        return 0;
+
+    /// Compressed input or a pipe, read up to @p offset
+    while (input->position < offset) {
+        size_t rlen;
+        if (typescript_input_next(input, offset - input->position, &rlen) == NULL)
+            return 1;
+        if (rlen == 0)
+            break;
+    }
+    return 0;
+}
+
+/**
+ * Stop reading ahead, release the mapping or buffer, but do not
+ * close the file.
+ */
+void typescript_input_close(struct typescript_input *input)
+{
+    if (input->reader != NULL) {
+        ring_cancel(&input->reader->ring);
+        pthread_join(input->reader->thread, NULL);
+        ring_free(&input->reader->ring);
+        typescript_input_close(&input->reader->source);
+        free(input->reader);
+        input->reader = NULL;
+    }
+    if (input->map != NULL)
+        munmap((void *)input->map, input->map_size);
+    free(input->buffer);
+    input->map = NULL;
+    input->buffer = NULL;
+    input->compressed = NULL;
+    input->chunk = NULL;
+    input->chunk_len = 0;
+    input->map_size = input->buffer_size = input->position = 0;
+}
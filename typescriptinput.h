@@ -0,0 +1,117 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_TYPESCRIPTINPUT_H
+#define SCRIPTINTERPRETER_TYPESCRIPTINPUT_H
+
+#include <stdio.h>
+
+#include "compressedinput.h"
+
+/// Size of the buffer used when the typescript cannot be memory-mapped
+#define TYPESCRIPT_INPUT_CHUNK_SIZE (1 << 16)
+/// Number of chunks a typescript may be read ahead of its parser
+#define TYPESCRIPT_INPUT_READ_AHEAD 16
+
+/**
+ * Source for the bytes describing each timing step's events.
+ * A typescript stored in a regular file is memory-mapped once
+ * and every step is handed out as a pointer into the mapping.
+ * Anything else (pipes, FIFOs, ...) is read with fread into a
+ * fixed-size buffer, large steps in several chunks. A compressed
+ * typescript is handed out from the chunks of decompressed data.
+ * Any of these may be read ahead on a separate thread.
+ */
+struct typescript_input {
+    FILE *file;
+    const char *map; ///< memory-mapped typescript file or NULL if using fread
+    size_t map_size; ///< length of @c map in bytes
+    size_t position; ///< offset of next unread byte in the typescript
+    char *buffer; ///< buffer for the fread fallback
+    size_t buffer_size; ///< length of @c buffer in bytes
+    struct compressed_input *compressed; ///< decompressed typescript or NULL
+    const char *chunk; ///< rest of the current chunk of decompressed data
+    size_t chunk_len; ///< length of @c chunk in bytes
+    struct typescript_reader *reader; ///< thread reading ahead, or NULL
+};
+
+/**
+ * Prepare reading from an already opened typescript file.
+ * If @p compressed is not NULL, the typescript is read from it
+ * instead of from @p file. Otherwise, if @p allow_mmap is non-zero
+ * and the file is a regular, non-empty file, the whole file will
+ * be memory-mapped, else the fread fallback will be used.
+ * Returns 0 on success.
+ */
+int typescript_input_open(struct typescript_input *input, FILE *file, int allow_mmap, struct compressed_input *compressed);
+
+/**
+ * Continue reading from the typescript, discarding all
+ * read data until there is a line break or the end of
+ * the typescript is reached.
+ */
+void typescript_input_skipline(struct typescript_input *input);
+
+/**
+ * Return a pointer to up to @p expected_size next bytes of the
+ * typescript. The number of bytes actually available is written
+ * to @p rlen. It may be less than expected if the fread fallback
+ * is used (at most TYPESCRIPT_INPUT_CHUNK_SIZE bytes) or the
+ * typescript is compressed (the rest of a chunk) and is 0 at
+ * the end of the file. The returned memory remains valid until the
+ * next call. Returns NULL on error.
+ */
+const char *typescript_input_next(struct typescript_input *input, size_t expected_size, size_t *rlen);
+
+/**
+ * Read the rest of the typescript on a separate thread, in chunks
+ * of at most TYPESCRIPT_INPUT_CHUNK_SIZE bytes and up to
+ * TYPESCRIPT_INPUT_READ_AHEAD chunks ahead of typescript_input_next,
+ * so waiting for the file and parsing overlap. A memory-mapped
+ * typescript is not copied, the thread only touches its pages.
+ * Afterwards, the input cannot be positioned and no lines can be
+ * skipped. Returns 0 on success.
+ */
+int typescript_input_read_ahead(struct typescript_input *input);
+
+/**
+ * Continue reading at byte @p offset of the typescript.
+ * Returns 0 on success, 1 if the file cannot be positioned
+ * (e.g. for pipes or compressed files).
+ */
+int typescript_input_seek(struct typescript_input *input, size_t offset);
+
+/**
+ * Continue reading at byte @p offset of the typescript, which
+ * must not be before the current position. The file is positioned
+ * if possible, otherwise the bytes in between are read and thrown
+ * away without looking at them. Returns 0 on success, also if the
+ * typescript ends before @p offset, and 1 on read errors.
+ */
+int typescript_input_skip_to(struct typescript_input *input, size_t offset);
+
+/**
+ * Stop reading ahead, release the mapping or buffer, but do not
+ * close the file.
+ */
+void typescript_input_close(struct typescript_input *input);
+
+#endif // SCRIPTINTERPRETER_TYPESCRIPTINPUT_H
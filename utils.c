@@ -22,18 +22,17 @@ If not, see <http://www.gnu.org/licenses/>.
 #include "utils.h"
 
 /**
- * For a given integer number n, return
- * - 1 if n is zero or negative
+ * For a given size n, return
+ * - 1 if n is zero
  * - n itself if n is a power of 2
  * - the next power of 2 larger than n
+ * - 0 if that power of 2 cannot be represented as size_t
  */
-int roundup_powerof2(int n)
+size_t roundup_powerof2(size_t n)
 {
-    int result = 1;
-    while (n > 0) {
-        n /= 2;
-        result *= 2;
-    }
+    size_t result = 1;
+    while (result != 0 && result < n)
+        result <<= 1;
     return result;
 }
 
@@ -49,28 +48,6 @@ void skipline(FILE *input)
     while ((c = fgetc(input)) != EOF && c != '\n');
 }
 
-/**
- * Write a character to an output file.
- * Replace special characters like '&' or '<' by
- * their escaped form like '&amp;' or '&lt;'.
- */
-void xmlized_print(FILE *output, char c)
-{
-    switch (c) {
-    case '<':
-        fprintf(output, "&lt;");
-        break;
-    case '>':
-        fprintf(output, "&gt;");
-        break;
-    case '&':
-        fprintf(output, "&amp;");
-        break;
-    default:
-        fprintf(output, "%c", c);
-    }
-}
-
 /**
  * Convert a sequence of characters into an integer number.
  * The sequence is limited by 'len' or the first appearance
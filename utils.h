@@ -25,12 +25,13 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 
 /**
- * For a given integer number n, return
- * - 1 if n is zero or negative
+ * For a given size n, return
+ * - 1 if n is zero
  * - n itself if n is a power of 2
  * - the next power of 2 larger than n
+ * - 0 if that power of 2 cannot be represented as size_t
  */
-int roundup_powerof2(int n);
+size_t roundup_powerof2(size_t n);
 
 /**
  * Continue reading from an input file,
@@ -40,13 +41,6 @@ int roundup_powerof2(int n);
  */
 void skipline(FILE *input);
 
-/**
- * Write a character to an output file.
- * Replace special characters like '&' or '<' by
- * their escaped form like '&amp;' or '&lt;'.
- */
-void xmlized_print(FILE *output, char c);
-
 /**
  * Convert a sequence of characters into an integer number.
  * The sequence is limited by 'len' or the first appearance
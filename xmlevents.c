@@ -0,0 +1,191 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#include "timingfile.h"
+#include "xmlevents.h"
+
+/**
+ * Write the XML declaration and open the <script> element.
+ */
+void xmlevents_begin(struct xmloutput *output)
+{
+    xmloutput_puts(output, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
+    xmloutput_puts(output, "<script>\n");
+}
+
+/**
+ * Close the <script> element.
+ */
+void xmlevents_end(struct xmloutput *output)
+{
+    xmloutput_puts(output, "</script>\n");
+}
+
+/**
+ * Write the opening tag of a timestep with its delay given
+ * in microseconds, shown as seconds with three decimals.
+ */
+static void write_timestep_start(struct xmloutput *output, long long delay)
+{
+    static const char tag[] = "<timestep delay=\"";
+    char buffer[sizeof(tag) + 32];
+    memcpy(buffer, tag, sizeof(tag) - 1);
+    size_t len = sizeof(tag) - 1;
+    len += timing_format_delay(buffer + len, delay);
+    memcpy(buffer + len, "\">\n", 3);
+    xmloutput_write(output, buffer, len + 3);
+}
+
+/**
+ * Write the non-negative number @p value in decimal to @p buffer,
+ * which must hold at least 11 characters. Returns the number of
+ * characters written, without a terminating null character.
+ */
+static size_t format_int(char *buffer, int value)
+{
+    char digits[12];
+    size_t n = 0, len = 0;
+    unsigned int u = value < 0 ? 0 : (unsigned int)value;
+    do {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    while (n > 0)
+        buffer[len++] = digits[--n];
+    return len;
+}
+
+/**
+ * Write an absolute cursor position without going through printf.
+ */
+static void write_cursor_position(struct xmloutput *output, int row, int column)
+{
+    static const char tag[] = "<cursor absoluterow=\"";
+    static const char middle[] = "\" absolutecolumn=\"";
+    char buffer[sizeof(tag) + sizeof(middle) + 32];
+    memcpy(buffer, tag, sizeof(tag) - 1);
+    size_t len = sizeof(tag) - 1;
+    len += format_int(buffer + len, row);
+    memcpy(buffer + len, middle, sizeof(middle) - 1);
+    len += sizeof(middle) - 1;
+    len += format_int(buffer + len, column);
+    memcpy(buffer + len, "\" />\n", 5);
+    xmloutput_write(output, buffer, len + 5);
+}
+
+/**
+ * Write a color change from constant fragments, the attribute
+ * with its intensity and the name of the color.
+ */
+static void write_color(struct xmloutput *output, const struct event *event)
+{
+    static const char *const prefixes[2][3] = {
+        { "<color foreground=\"normal-", "<color foreground=\"intense-", "<color foreground=\"faint-" },
+        { "<color background=\"normal-", "<color background=\"intense-", "<color background=\"faint-" }
+    };
+    int intensity = event->intensity == COLOR_INTENSE ? 1 : (event->intensity == COLOR_FAINT ? 2 : 0);
+    xmloutput_puts(output, prefixes[event->kind == COLOR_FOREGROUND ? 0 : 1][intensity]);
+    xmloutput_puts(output, event_color_name(event->value));
+    xmloutput_write(output, "\" />\n", 5);
+}
+
+/**
+ * Event sink callback writing @p event as XML to the
+ * struct xmloutput passed as @p context.
+ */
+void xmlevents_write(void *context, const struct event *event)
+{
+    struct xmloutput *output = (struct xmloutput *)context;
+
+    switch (event->type) {
+    case EVENT_TIMESTEP:
+        write_timestep_start(output, event->delay);
+        break;
+    case EVENT_TIMESTEP_END:
+        xmloutput_puts(output, "</timestep>\n");
+        break;
+    case EVENT_TEXT:
+        if (!event->continued)
+            xmloutput_puts(output, "<text>");
+        /// Handle XML entities correctly
+        xmloutput_escaped(output, event->text, event->length);
+        break;
+    case EVENT_TEXT_END:
+        xmloutput_puts(output, "</text>\n");
+        break;
+    case EVENT_NEWLINE:
+        xmloutput_puts(output, "<newline />\n");
+        break;
+    case EVENT_CURSOR:
+        switch (event->kind) {
+        case CURSOR_POSITION:
+            write_cursor_position(output, event->row, event->column);
+            break;
+        case CURSOR_KEY_CONTROL:
+            xmloutput_puts(output, event->value ? "<cursor key-control=\"application\" />\n" : "<cursor key-control=\"terminal\" />\n");
+            break;
+        case CURSOR_BLINKING:
+            xmloutput_puts(output, event->value ? "<cursor blinking=\"true\" />\n" : "<cursor blinking=\"false\" />\n");
+            break;
+        case CURSOR_SHOW:
+            xmloutput_puts(output, event->value ? "<cursor show=\"true\" />\n" : "<cursor show=\"false\" />\n");
+            break;
+        case CURSOR_SAVE:
+            xmloutput_puts(output, "<cursor state=\"save\" />\n");
+            break;
+        case CURSOR_RESTORE:
+            xmloutput_puts(output, "<cursor state=\"restore\" />\n");
+            break;
+        default:
+            break; ///< relative movements are for the screen model only
+        }
+        break;
+    case EVENT_ERASE: {
+        static const char *const tags[2][3] = {
+            { "<erase scope=\"in_line\" range=\"cur_to_end\" />\n", "<erase scope=\"in_line\" range=\"begin_to_cur\" />\n", "<erase scope=\"in_line\" range=\"all\" />\n" },
+            { "<erase scope=\"in_page\" range=\"cur_to_end\" />\n", "<erase scope=\"in_page\" range=\"begin_to_cur\" />\n", "<erase scope=\"in_page\" range=\"all\" />\n" }
+        };
+        xmloutput_puts(output, tags[event->kind == ERASE_IN_PAGE ? 1 : 0][event->value == ERASE_CUR_TO_END ? 0 : (event->value == ERASE_BEGIN_TO_CUR ? 1 : 2)]);
+        break;
+    }
+    case EVENT_COLOR:
+        if (event->kind == COLOR_RESET)
+            xmloutput_puts(output, "<color operation=\"reset\" />\n");
+        else
+            write_color(output, event);
+        break;
+    case EVENT_SCREEN:
+        xmloutput_puts(output, event->value ? "<screen switchto=\"1\" />\n" : "<screen switchto=\"0\" />\n");
+        break;
+    case EVENT_SPECIAL:
+        if (event->kind == SPECIAL_8BIT)
+            xmloutput_puts(output, "<special state=\"8bit\" />\n");
+        break;
+    case EVENT_OSC:
+        xmloutput_puts(output, "<osc type=\"windowtitle\">");
+        xmloutput_escaped(output, event->text, event->length);
+        xmloutput_puts(output, "</osc>\n");
+        break;
+    case EVENT_EDIT:
+    case EVENT_SCROLL_REGION:
+        break; ///< for the screen model only
+    }
+}
@@ -0,0 +1,44 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_XMLEVENTS_H
+#define SCRIPTINTERPRETER_XMLEVENTS_H
+
+#include "events.h"
+#include "xmloutput.h"
+
+/**
+ * Write the XML declaration and open the <script> element.
+ */
+void xmlevents_begin(struct xmloutput *output);
+
+/**
+ * Close the <script> element.
+ */
+void xmlevents_end(struct xmloutput *output);
+
+/**
+ * Event sink callback writing @p event as XML to the
+ * struct xmloutput passed as @p context.
+ */
+void xmlevents_write(void *context, const struct event *event);
+
+#endif // SCRIPTINTERPRETER_XMLEVENTS_H
@@ -0,0 +1,344 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XMLOUTPUT_X86 1
+#include <immintrin.h>
+#endif
+
+#include "xmloutput.h"
+
+/**
+ * Implementation of xmloutput_find_special to use, picked by
+ * select_find_special when the first output is opened.
+ */
+static size_t (*find_special)(const char *, size_t) = NULL;
+/// Outputs may be opened on several threads at once
+static pthread_once_t find_special_selected = PTHREAD_ONCE_INIT;
+static void select_find_special(void);
+
+/**
+ * Write all of @p iov to @p fd, retrying after
+ * partial writes and interruptions.
+ */
+static int writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Cannot write XML output: %s\n", strerror(errno));
+            return 1;
+        }
+        /// Skip over completely written vectors, adjust partially written one
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Pass all of @p iov on to the writer if there is one,
+ * to the file descriptor otherwise. Returns 0 on success.
+ */
+static int write_out(struct xmloutput *output, struct iovec *iov, int iovcnt)
+{
+    if (output->writer == NULL)
+        return writev_all(output->fd, iov, iovcnt);
+    for (int i = 0; i < iovcnt; ++i)
+        if (iov[i].iov_len > 0 && output->writer(output->writer_context, (const char *)iov[i].iov_base, iov[i].iov_len) != 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * Make room for at least @p len more bytes in the buffer,
+ * either by flushing it or, if output is kept in memory,
+ * by growing it. Returns 0 on success.
+ */
+static int reserve(struct xmloutput *output, size_t len)
+{
+    if (output->fd >= 0)
+        return xmloutput_flush(output);
+
+    if (len <= output->size - output->length)
+        return 0;
+    size_t new_size = output->size > 0 ? output->size : 1;
+    while (new_size - output->length < len)
+        new_size *= 2;
+    char *new_buffer = (char *)realloc(output->buffer, new_size);
+    if (new_buffer == NULL) {
+        fprintf(stderr, "Cannot allocate %zu bytes for XML output\n", new_size);
+        output->error = 1;
+        return 1;
+    }
+    output->buffer = new_buffer;
+    output->size = new_size;
+    return 0;
+}
+
+/**
+ * Prepare an output buffer of @p buffer_size bytes writing
+ * to file descriptor @p fd. Returns 0 on success.
+ * If @p fd is negative, all output is kept in memory and the
+ * buffer grows as needed.
+ */
+int xmloutput_open(struct xmloutput *output, int fd, size_t buffer_size)
+{
+    pthread_once(&find_special_selected, select_find_special);
+
+    output->fd = fd;
+    output->length = 0;
+    output->flushed = 0;
+    output->error = 0;
+    output->writer = NULL;
+    output->writer_context = NULL;
+    output->size = buffer_size;
+    output->buffer = (char *)malloc(buffer_size);
+    return output->buffer == NULL ? 1 : 0;
+}
+
+/**
+ * Like xmloutput_open, but keep the buffer of @p output if it
+ * holds at least @p buffer_size bytes. @p output must have been
+ * opened and flushed before, or be initialized to all zero.
+ */
+int xmloutput_reopen(struct xmloutput *output, int fd, size_t buffer_size)
+{
+    if (output->buffer == NULL || output->size < buffer_size) {
+        free(output->buffer);
+        return xmloutput_open(output, fd, buffer_size);
+    }
+    output->fd = fd;
+    output->length = 0;
+    output->flushed = 0;
+    output->error = 0;
+    output->writer = NULL;
+    output->writer_context = NULL;
+    return 0;
+}
+
+/**
+ * Write all buffered data to the file descriptor.
+ * Returns 0 on success.
+ */
+int xmloutput_flush(struct xmloutput *output)
+{
+    if (output->fd < 0)
+        return output->error; ///< output is kept in memory
+    if (output->length > 0 && output->error == 0) {
+        struct iovec iov = { output->buffer, output->length };
+        output->error = write_out(output, &iov, 1);
+    }
+    output->flushed += output->length;
+    output->length = 0;
+    return output->error;
+}
+
+/**
+ * Flush and release the buffer, but do not close the file
+ * descriptor. Returns 0 if all data has been written.
+ */
+int xmloutput_close(struct xmloutput *output)
+{
+    int result = xmloutput_flush(output);
+    free(output->buffer);
+    output->buffer = NULL;
+    output->size = 0;
+    return result;
+}
+
+/**
+ * Slow path of xmloutput_write for data not fitting into
+ * the remaining buffer space.
+ */
+void xmloutput_write_slow(struct xmloutput *output, const char *data, size_t len)
+{
+    if (output->fd < 0) {
+        /// Output is kept in memory, grow buffer
+        if (reserve(output, len) == 0) {
+            memcpy(output->buffer + output->length, data, len);
+            output->length += len;
+        }
+        return;
+    }
+
+    if (len < output->size / 2) {
+        /// Small piece of data, make room and buffer it
+        xmloutput_flush(output);
+        memcpy(output->buffer, data, len);
+        output->length = len;
+        return;
+    }
+
+    /// Large piece of data, pass it together with the
+    /// buffered data to the kernel without copying
+    if (output->error == 0) {
+        struct iovec iov[2] = { { output->buffer, output->length }, { (void *)data, len } };
+        output->error = write_out(output, iov, 2);
+    }
+    output->flushed += output->length + len;
+    output->length = 0;
+}
+
+/**
+ * Write formatted data like fprintf, without any escaping.
+ */
+void xmloutput_printf(struct xmloutput *output, const char *format, ...)
+{
+    va_list args;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        size_t space = output->size - output->length;
+        va_start(args, format);
+        int len = vsnprintf(output->buffer + output->length, space, format, args);
+        va_end(args);
+        if (len < 0)
+            return;
+        if ((size_t)len < space) {
+            output->length += len;
+            return;
+        }
+        /// Did not fit, make room and retry once
+        if (reserve(output, (size_t)len + 1) != 0)
+            return;
+    }
+}
+
+/**
+ * Scalar version of xmloutput_find_special.
+ */
+static size_t find_special_scalar(const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        if (data[i] == '<' || data[i] == '>' || data[i] == '&')
+            return i;
+    return len;
+}
+
+#ifdef XMLOUTPUT_X86
+/**
+ * SSE2 version of xmloutput_find_special, checks 16 bytes at once.
+ */
+__attribute__((target("sse2")))
+static size_t find_special_sse2(const char *data, size_t len)
+{
+    const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>'), amp = _mm_set1_epi8('&');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, gt)), _mm_cmpeq_epi8(chunk, amp));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + find_special_scalar(data + i, len - i);
+}
+
+/**
+ * AVX2 version of xmloutput_find_special, checks 32 bytes at once.
+ */
+__attribute__((target("avx2")))
+static size_t find_special_avx2(const char *data, size_t len)
+{
+    const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>'), amp = _mm256_set1_epi8('&');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, lt), _mm256_cmpeq_epi8(chunk, gt)), _mm256_cmpeq_epi8(chunk, amp));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + find_special_scalar(data + i, len - i);
+}
+#endif // XMLOUTPUT_X86
+
+/**
+ * Pick the fastest implementation the CPU supports.
+ */
+static void select_find_special(void)
+{
+#ifdef XMLOUTPUT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        find_special = find_special_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        find_special = find_special_sse2;
+    else
+#endif
+        find_special = find_special_scalar;
+}
+
+/**
+ * Return the position of the first '<', '>' or '&' in @p data
+ * or @p len if there is no such character.
+ */
+size_t xmloutput_find_special(const char *data, size_t len)
+{
+    return find_special(data, len);
+}
+
+/**
+ * Write @p len bytes of character data.
+ * Replace special characters like '&' or '<' by
+ * their escaped form like '&amp;' or '&lt;'.
+ */
+void xmloutput_escaped(struct xmloutput *output, const char *data, size_t len)
+{
+    while (len > 0) {
+        /// Copy run of characters not requiring escaping in one go
+        size_t clean = find_special(data, len);
+        xmloutput_write(output, data, clean);
+        if (clean == len)
+            break;
+
+        switch (data[clean]) {
+        case '<':
+            xmloutput_write(output, "&lt;", 4);
+            break;
+        case '>':
+            xmloutput_write(output, "&gt;", 4);
+            break;
+        default:
+            xmloutput_write(output, "&amp;", 5);
+        }
+        data += clean + 1;
+        len -= clean + 1;
+    }
+}
@@ -0,0 +1,127 @@
+/********************************************************************
+This file is part of ScriptInterpreter.
+https://github.com/thfi/ScriptInterpreter
+
+See file "AUTHORS" for a list of copyright holders.
+
+ScriptInterpreter is free software: you can redistribute it and/or
+modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+ScriptInterpreter is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ScriptInterpreter.
+If not, see <http://www.gnu.org/licenses/>.
+********************************************************************/
+
+#ifndef SCRIPTINTERPRETER_XMLOUTPUT_H
+#define SCRIPTINTERPRETER_XMLOUTPUT_H
+
+#include <stddef.h>
+#include <string.h>
+
+/// Default size of an output buffer in bytes
+#define XMLOUTPUT_BUFFER_SIZE (1 << 20)
+
+/**
+ * Buffered writer for the generated XML. Data is collected
+ * in a large buffer and passed to the kernel with write(2)
+ * or writev(2) only when the buffer is full or flushed, or to
+ * @c writer, like a compressor, if one is set after opening.
+ */
+struct xmloutput {
+    int fd; ///< file descriptor to write to, negative to keep output in memory
+    char *buffer;
+    size_t length; ///< number of bytes used in @c buffer
+    size_t size; ///< capacity of @c buffer
+    size_t flushed; ///< number of bytes already passed to the kernel
+    int error; ///< non-zero once writing failed
+    int (*writer)(void *context, const char *data, size_t len); ///< if not NULL, gets the data instead of @c fd
+    void *writer_context;
+};
+
+/**
+ * Prepare an output buffer of @p buffer_size bytes writing
+ * to file descriptor @p fd. Returns 0 on success.
+ * If @p fd is negative, all output is kept in memory and the
+ * buffer grows as needed.
+ */
+int xmloutput_open(struct xmloutput *output, int fd, size_t buffer_size);
+
+/**
+ * Like xmloutput_open, but keep the buffer of @p output if it
+ * holds at least @p buffer_size bytes. @p output must have been
+ * opened and flushed before, or be initialized to all zero.
+ */
+int xmloutput_reopen(struct xmloutput *output, int fd, size_t buffer_size);
+
+/**
+ * Write all buffered data to the file descriptor.
+ * Returns 0 on success.
+ */
+int xmloutput_flush(struct xmloutput *output);
+
+/**
+ * Flush and release the buffer, but do not close the file
+ * descriptor. Returns 0 if all data has been written.
+ */
+int xmloutput_close(struct xmloutput *output);
+
+/**
+ * Number of bytes written so far, including buffered ones.
+ */
+static inline size_t xmloutput_position(const struct xmloutput *output)
+{
+    return output->flushed + output->length;
+}
+
+/**
+ * Slow path of xmloutput_write for data not fitting into
+ * the remaining buffer space.
+ */
+void xmloutput_write_slow(struct xmloutput *output, const char *data, size_t len);
+
+/**
+ * Write @p len bytes as they are, without any escaping.
+ */
+static inline void xmloutput_write(struct xmloutput *output, const char *data, size_t len)
+{
+    if (len <= output->size - output->length) {
+        memcpy(output->buffer + output->length, data, len);
+        output->length += len;
+    } else
+        xmloutput_write_slow(output, data, len);
+}
+
+/**
+ * Write a null-terminated string as it is, without any escaping.
+ */
+static inline void xmloutput_puts(struct xmloutput *output, const char *str)
+{
+    xmloutput_write(output, str, strlen(str));
+}
+
+/**
+ * Write formatted data like fprintf, without any escaping.
+ */
+void xmloutput_printf(struct xmloutput *output, const char *format, ...);
+
+/**
+ * Write @p len bytes of character data.
+ * Replace special characters like '&' or '<' by
+ * their escaped form like '&amp;' or '&lt;'.
+ */
+void xmloutput_escaped(struct xmloutput *output, const char *data, size_t len);
+
+/**
+ * Return the position of the first '<', '>' or '&' in @p data
+ * or @p len if there is no such character.
+ */
+size_t xmloutput_find_special(const char *data, size_t len);
+
+#endif // SCRIPTINTERPRETER_XMLOUTPUT_H